@@ -4,17 +4,39 @@ CONFIG -= app_bundle
 CONFIG -= qt
 CONFIG += link_pkgconfig
 PKGCONFIG = opencv
-LIBS += -lboost_program_options
+LIBS += -lboost_program_options -lpthread
 
 
 SOURCES += main.cpp \
     parameters.cpp \
     image.cpp \
     experiment.cpp \
-    histogram.cpp
+    histogram.cpp \
+    feature_table.cpp \
+    frame_reader.cpp \
+    frame_cache.cpp \
+    frame_watcher.cpp \
+    roi_labels.cpp \
+    image_pool.cpp \
+    packed_histograms.cpp \
+    csv.cpp \
+    manifest.cpp \
+    metrics.cpp \
+    stage_graph.cpp
 
 HEADERS += \
     parameters.hpp \
     image.hpp \
     experiment.hpp \
-    histogram.hpp
+    histogram.hpp \
+    feature_table.hpp \
+    frame_reader.hpp \
+    frame_cache.hpp \
+    frame_watcher.hpp \
+    roi_labels.hpp \
+    image_pool.hpp \
+    packed_histograms.hpp \
+    csv.hpp \
+    manifest.hpp \
+    metrics.hpp \
+    stage_graph.hpp
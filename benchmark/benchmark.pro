@@ -0,0 +1,28 @@
+TEMPLATE = app
+TARGET = benchmark
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+CONFIG += link_pkgconfig
+PKGCONFIG = opencv
+LIBS += -lboost_program_options -lpthread
+INCLUDEPATH += ..
+
+
+SOURCES += main.cpp \
+    synthetic_data.cpp \
+    ../parameters.cpp \
+    ../image.cpp \
+    ../histogram.cpp \
+    ../feature_table.cpp \
+    ../frame_reader.cpp \
+    ../frame_cache.cpp \
+    ../roi_labels.cpp \
+    ../image_pool.cpp \
+    ../packed_histograms.cpp \
+    ../csv.cpp \
+    ../manifest.cpp \
+    ../metrics.cpp
+
+HEADERS += \
+    synthetic_data.hpp
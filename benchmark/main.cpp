@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "feature_table.hpp"
+#include "histogram.hpp"
+#include "image_pool.hpp"
+#include "metrics.hpp"
+#include "parameters.hpp"
+#include "synthetic_data.hpp"
+
+using namespace std;
+namespace po = boost::program_options;
+
+#define PO_SIZES "sizes"
+#define PO_ROIS "ROIs"
+#define PO_FRAMES "frames"
+#define PO_BEES "bees"
+#define PO_REPETITIONS "repetitions"
+#define PO_SEED "seed"
+#define PO_FOLDER "folder"
+#define PO_FOLDERS "folders"
+#define PO_GENERATE "generate"
+
+/**
+ * Same colour threshold of the counting benchmarks, the value used in the
+ * experiments.
+ */
+static const unsigned int SAME_COLOUR_THRESHOLD = 10;
+
+/**
+ * @brief The Case class holds the data of a frame size and number of regions
+ * of interest that every benchmark uses.
+ */
+class Case
+{
+public:
+	const RunParameters &run;
+	const UserParameters &user;
+	const vector<Image> &frames;
+	/**
+	 * @brief background_HE The equalised background cropped to the bounding
+	 * box of the regions of interest.
+	 */
+	Image background_HE;
+	/**
+	 * @brief ROIs_histograms The histograms of each region of interest of
+	 * every frame, as in the number of bees histogram files.
+	 */
+	HistogramMatrix ROIs_histograms;
+	CumulativeHistograms *ROIs_cumulative_histograms;
+	Case (const RunParameters &run, const UserParameters &user, const vector<Image> &frames);
+	~Case ();
+};
+
+struct Benchmark
+{
+	const char *name;
+	void (*run) (const Case &);
+	/**
+	 * @brief pixels Whether the benchmark processes the pixels of the frames,
+	 * otherwise only the frame rate is reported.
+	 */
+	bool pixels;
+};
+
+static void benchmark_compute_histogram (const Case &c);
+static void benchmark_compute_histogram_masks (const Case &c);
+static void benchmark_equalize_hist_absdiff (const Case &c);
+static void benchmark_equalise_histogram_lut (const Case &c);
+static void benchmark_label_histograms_raw (const Case &c);
+static void benchmark_label_histograms_HE (const Case &c);
+static void benchmark_count_differences_HE (const Case &c);
+static void benchmark_fold2_frames (const Case &c);
+static void benchmark_fold2_frames_ROIs (const Case &c);
+static void benchmark_cumulative_histograms (const Case &c);
+static void benchmark_feature_engine (const Case &c);
+static void benchmark_write_vector_histograms (const Case &c);
+static void benchmark_read_vector_histograms (const Case &c);
+static void benchmark_write_vector_histograms_binary (const Case &c);
+static void benchmark_read_vector_histograms_binary (const Case &c);
+static void benchmark_write_vector_histograms_compressed (const Case &c);
+
+/**
+ * Benchmarks in the order they run.  Benchmarks that read a histogram file
+ * come after the one that writes it.
+ */
+static const Benchmark BENCHMARKS [] = {
+	{"compute_histogram", benchmark_compute_histogram, true},
+	{"compute_histogram masks", benchmark_compute_histogram_masks, true},
+	{"equalizeHist+absdiff", benchmark_equalize_hist_absdiff, true},
+	{"equalise_histogram LUT", benchmark_equalise_histogram_lut, true},
+	{"label histograms raw", benchmark_label_histograms_raw, true},
+	{"label histograms HE", benchmark_label_histograms_HE, true},
+	{"count_differences HE", benchmark_count_differences_HE, true},
+	{"fold2_frames decode", benchmark_fold2_frames, true},
+	{"fold2_frames_ROIs", benchmark_fold2_frames_ROIs, false},
+	{"cumulative histograms", benchmark_cumulative_histograms, false},
+	{"feature engine", benchmark_feature_engine, false},
+	{"write CSV histograms", benchmark_write_vector_histograms, false},
+	{"read CSV histograms", benchmark_read_vector_histograms, false},
+	{"write binary histograms", benchmark_write_vector_histograms_binary, false},
+	{"read binary histograms", benchmark_read_vector_histograms_binary, false},
+	{"write packed histograms", benchmark_write_vector_histograms_compressed, false},
+	{"read packed histograms", benchmark_read_vector_histograms_binary, false},
+};
+
+static po::variables_map process_options (int argc, char *argv[]);
+static RunParameters *make_run_parameters (unsigned int number_ROIs, unsigned int number_frames);
+static void run_benchmarks (const Case &c, unsigned int repetitions);
+static void decode_frame (const Image &frame, const Case *c, uint64_t *checksum);
+static void count_ROI_pixels (unsigned int index_frame, unsigned int index_mask, const Case *c, double *sum);
+
+/**
+ * Benchmark the kernels and input output routines of the frame pass on
+ * synthetic data, for every combination of frame size and number of regions
+ * of interest.  The data of each combination is written to a folder of its
+ * own with a data CSV file, so that the program can also be run on it.  The
+ * data CSV file can list several folders, whose seeds follow the given one.
+ */
+int main (int argc, char *argv[])
+{
+	install_image_pool ();
+	po::variables_map vm = process_options (argc, argv);
+	string folder = vm [PO_FOLDER].as<string> ();
+	if (folder.empty () || folder [folder.size () - 1] != '/')
+		folder += "/";
+	const unsigned int number_frames = vm [PO_FRAMES].as<unsigned int> ();
+	if (number_frames < 2) {
+		cerr << "The number of frames must be at least 2!\n";
+		exit (EXIT_FAILURE);
+	}
+	if (!vm.count (PO_GENERATE))
+		printf ("%-26s %10s %5s %10s %12s %10s\n", "benchmark", "size", "ROIs", "ms/frame", "Mpixels/s", "frames/s");
+	for (const string &size : vm [PO_SIZES].as<vector<string> > ()) {
+		int width, height;
+		if (sscanf (size.c_str (), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+			cerr << "Invalid frame size " << size << ", it must be WIDTHxHEIGHT!\n";
+			exit (EXIT_FAILURE);
+		}
+		for (unsigned int number_ROIs : vm [PO_ROIS].as<vector<unsigned int> > ()) {
+			const string case_folder = folder + size + "_ROIs=" + to_string (number_ROIs) + "/";
+			const unsigned int number_folders = max (vm [PO_FOLDERS].as<unsigned int> (), 1u);
+			string rows;
+			for (unsigned int index_folder = 0; index_folder < number_folders; index_folder++) {
+				const SyntheticData data (width, height, number_ROIs, number_frames, vm [PO_BEES].as<unsigned int> (), vm [PO_SEED].as<unsigned int> () + index_folder);
+				rows += data.write (case_folder + "folder-" + to_string (index_folder + 1) + "/") + "\n";
+			}
+			FILE *csv = fopen ((case_folder + "data-analyse.csv").c_str (), "w");
+			if (csv == NULL || fprintf (csv, "\"folder\",x1,y1,x2,y2,use\n%s", rows.c_str ()) < 0 || fclose (csv) != 0) {
+				cerr << "Could not write the data CSV file of folder " << case_folder << "!\n";
+				exit (EXIT_FAILURE);
+			}
+			if (vm.count (PO_GENERATE)) {
+				printf ("Generated folder %s, run the program with -a %sdata-analyse.csv -r %u -n %u\n", case_folder.c_str (), case_folder.c_str (), number_ROIs, number_frames);
+				continue;
+			}
+			// the benchmarks use the first folder
+			const SyntheticData data (width, height, number_ROIs, number_frames, vm [PO_BEES].as<unsigned int> (), vm [PO_SEED].as<unsigned int> ());
+			const string row = rows.substr (0, rows.find ('\n'));
+			RunParameters *run = make_run_parameters (number_ROIs, number_frames);
+			UserParameters *user = UserParameters::parse (*run, row);
+			vector<Image> frames;
+			for (unsigned int index_frame = 1; index_frame <= number_frames; index_frame++)
+				frames.push_back (data.frame (index_frame));
+			Case c (*run, *user, frames);
+			run_benchmarks (c, vm [PO_REPETITIONS].as<unsigned int> ());
+			delete user;
+			delete run;
+		}
+	}
+	return 0;
+}
+
+Case::Case (const RunParameters &run, const UserParameters &user, const vector<Image> &frames):
+   run (run),
+   user (user),
+   frames (frames),
+   ROIs_histograms (run.number_ROIs)
+{
+	const cv::Rect &box = this->user.ROIs_bounding_box;
+	Image background_HE;
+	cv::equalizeHist (this->user.background, background_HE);
+	this->background_HE = background_HE (box).clone ();
+	vector<uint32_t> label_histograms;
+	for (const Image &frame : this->frames) {
+		this->user.ROI_labels.compute_label_histograms (frame (box), NULL, this->user.background (box), label_histograms, NULL);
+		this->user.ROI_labels.ROIs_histograms (label_histograms, this->ROIs_histograms.append_frame ());
+	}
+	this->ROIs_cumulative_histograms = new CumulativeHistograms (this->ROIs_histograms);
+}
+
+Case::~Case ()
+{
+	delete this->ROIs_cumulative_histograms;
+}
+
+static po::variables_map process_options (int argc, char *argv[])
+{
+	po::options_description options ("Benchmark the kernels and input output routines of the frame pass on synthetic data.\n\nAvailable options");
+	options.add_options ()
+	      (
+	         "help,h",
+	         "show this help message"
+	         )
+	      (
+	         PO_SIZES,
+	         po::value<vector<string> > ()
+	         ->multitoken ()
+	         ->default_value (vector<string> {"320x240", "640x480", "1280x720"}, "320x240 640x480 1280x720")
+	         ->value_name ("WxH..."),
+	         "frame sizes to benchmark"
+	         )
+	      (
+	         PO_ROIS,
+	         po::value<vector<unsigned int> > ()
+	         ->multitoken ()
+	         ->default_value (vector<unsigned int> {1, 3, 8}, "1 3 8")
+	         ->value_name ("N..."),
+	         "numbers of regions of interest to benchmark"
+	         )
+	      (
+	         PO_FRAMES,
+	         po::value<unsigned int> ()
+	         ->default_value (30)
+	         ->value_name ("N"),
+	         "how many frames the synthetic videos have"
+	         )
+	      (
+	         PO_BEES,
+	         po::value<unsigned int> ()
+	         ->default_value (10)
+	         ->value_name ("N"),
+	         "how many bees move in the synthetic videos"
+	         )
+	      (
+	         PO_REPETITIONS,
+	         po::value<unsigned int> ()
+	         ->default_value (3)
+	         ->value_name ("N"),
+	         "how many times each benchmark runs, the fastest time is reported"
+	         )
+	      (
+	         PO_SEED,
+	         po::value<unsigned int> ()
+	         ->default_value (1)
+	         ->value_name ("N"),
+	         "seed of the synthetic data, the same seed always generates the same data"
+	         )
+	      (
+	         PO_FOLDER,
+	         po::value<string> ()
+	         ->default_value ("benchmark-data")
+	         ->value_name ("PATH"),
+	         "folder where the synthetic data and the histogram files are written"
+	         )
+	      (
+	         PO_FOLDERS,
+	         po::value<unsigned int> ()
+	         ->default_value (1)
+	         ->value_name ("N"),
+	         "how many folders each data CSV file has, the folders differ in the seed of their synthetic data and the benchmarks use the first one"
+	         )
+	      (
+	         PO_GENERATE,
+	         "only write the synthetic data, without running the benchmarks"
+	         )
+	      ;
+	po::variables_map vm;
+	po::store (po::parse_command_line (argc, argv, options), vm);
+	po::notify (vm);
+	if (vm.count ("help")) {
+		cout << options << "\n";
+		exit (EXIT_SUCCESS);
+	}
+	return vm;
+}
+
+/**
+ * Parameters of the program with default values, except the given ones, and
+ * without progress messages.
+ */
+static RunParameters *make_run_parameters (unsigned int number_ROIs, unsigned int number_frames)
+{
+	vector<string> arguments = {
+		"--number-ROIs", to_string (number_ROIs),
+		"--number-frames", to_string (number_frames),
+		"--same-colour-threshold", to_string (SAME_COLOUR_THRESHOLD)
+	};
+	po::variables_map vm;
+	po::store (po::command_line_parser (arguments).options (RunParameters::program_options ()).run (), vm);
+	po::notify (vm);
+	RunParameters defaults (vm);
+	return new RunParameters (defaults, defaults.same_colour_threshold, defaults.delta_frame, false);
+}
+
+static void run_benchmarks (const Case &c, unsigned int repetitions)
+{
+	const unsigned int number_frames = c.frames.size ();
+	const double frame_pixels = (double) c.frames [0].cols * c.frames [0].rows;
+	char size [32];
+	snprintf (size, sizeof (size), "%dx%d", c.frames [0].cols, c.frames [0].rows);
+	for (const Benchmark &benchmark : BENCHMARKS) {
+		uint64_t best = UINT64_MAX;
+		for (unsigned int repetition = 0; repetition < max (repetitions, 1u); repetition++) {
+			const uint64_t start = metrics_clock ();
+			benchmark.run (c);
+			best = min (best, metrics_clock () - start);
+		}
+		const double seconds = max (best, (uint64_t) 1) / 1e9;
+		char pixel_rate [32] = "-";
+		if (benchmark.pixels)
+			snprintf (pixel_rate, sizeof (pixel_rate), "%.1f", number_frames * frame_pixels / seconds / 1e6);
+		printf ("%-26s %10s %5u %10.3f %12s %10.1f\n",
+		        benchmark.name, size, c.run.number_ROIs,
+		        seconds * 1000 / number_frames,
+		        pixel_rate,
+		        number_frames / seconds);
+		fflush (stdout);
+	}
+}
+
+static void benchmark_compute_histogram (const Case &c)
+{
+	Histogram histogram;
+	for (const Image &frame : c.frames)
+		compute_histogram (frame, histogram);
+}
+
+/**
+ * Histogram of each region of interest computed with its own mask, as the
+ * frame pass did before the masks were compiled in a label image.
+ */
+static void benchmark_compute_histogram_masks (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	Histogram histogram;
+	for (const Image &frame : c.frames)
+		for (const Image &mask : c.user.masks)
+			compute_histogram (frame (box), mask (box), histogram);
+}
+
+/**
+ * Histogram equalisation of each frame and difference with the previous one,
+ * as bee speed was computed before the lookup table kernels.
+ */
+static void benchmark_equalize_hist_absdiff (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	Image previous, current, difference;
+	cv::equalizeHist (c.frames [0], previous);
+	for (size_t index_frame = 1; index_frame < c.frames.size (); index_frame++) {
+		cv::equalizeHist (c.frames [index_frame], current);
+		cv::absdiff (current (box), previous (box), difference);
+		swap (previous, current);
+	}
+}
+
+static void benchmark_equalise_histogram_lut (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	unsigned char lut [NUMBER_COLOUR_LEVELS];
+	Image equalised;
+	for (const Image &frame : c.frames) {
+		compute_histogram_equalisation_lut (frame, lut);
+		equalise_histogram (frame (box), lut, equalised);
+	}
+}
+
+static void benchmark_label_histograms_raw (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	vector<uint32_t> label_histograms;
+	for (const Image &frame : c.frames)
+		c.user.ROI_labels.compute_label_histograms (frame (box), NULL, c.user.background (box), label_histograms, NULL);
+}
+
+static void benchmark_label_histograms_HE (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	unsigned char lut [NUMBER_COLOUR_LEVELS];
+	vector<uint32_t> label_histograms;
+	Image equalised (box.height, box.width, CV_8UC1);
+	for (const Image &frame : c.frames) {
+		compute_histogram_equalisation_lut (frame, lut);
+		c.user.ROI_labels.compute_label_histograms (frame (box), lut, c.background_HE, label_histograms, &equalised);
+	}
+}
+
+static void benchmark_count_differences_HE (const Case &c)
+{
+	const cv::Rect &box = c.user.ROIs_bounding_box;
+	unsigned char lut [NUMBER_COLOUR_LEVELS];
+	vector<uint32_t> counts;
+	for (const Image &frame : c.frames) {
+		compute_histogram_equalisation_lut (frame, lut);
+		c.user.ROI_labels.count_differences (frame (box), lut, c.background_HE, c.run.same_colour_level, counts, NULL);
+	}
+}
+
+static void benchmark_fold2_frames (const Case &c)
+{
+	uint64_t checksum = 0;
+	c.user.fold2_frames (c.run, decode_frame, &c, &checksum);
+}
+
+static void benchmark_fold2_frames_ROIs (const Case &c)
+{
+	double sum = 0;
+	c.run.fold2_frames_ROIs (count_ROI_pixels, &c, &sum);
+}
+
+static void benchmark_cumulative_histograms (const Case &c)
+{
+	CumulativeHistograms index (c.ROIs_histograms);
+}
+
+/**
+ * The number of bees histograms stand for the bee speed histograms too, the
+ * feature engine does the same work on any histograms.
+ */
+static void benchmark_feature_engine (const Case &c)
+{
+	ROIFeatures features (c.run.number_ROIs, c.run.number_frames);
+	compute_number_bees_bee_speed (*c.ROIs_cumulative_histograms, *c.ROIs_cumulative_histograms, c.run.number_frames, c.run.same_colour_level, features);
+	FeatureTable<double> average_bee_speed (c.run.number_ROIs, c.run.number_frames);
+	compute_average_bee_speed (features, c.run.delta_frame, average_bee_speed);
+	FeatureTable<int> total_bee_acceleration (c.run.number_ROIs, c.run.number_frames);
+	compute_total_bee_acceleration (features, c.run.delta_velocity, total_bee_acceleration);
+}
+
+static void benchmark_write_vector_histograms (const Case &c)
+{
+	write_vector_histograms (c.user.histograms_frames_masked_ROIs_number_bees_raw_filename (), &c.ROIs_histograms);
+}
+
+static void benchmark_read_vector_histograms (const Case &c)
+{
+	delete read_vector_histograms (c.user.histograms_frames_masked_ROIs_number_bees_raw_filename (), c.run.number_frames, c.run.number_ROIs);
+}
+
+static void benchmark_write_vector_histograms_binary (const Case &c)
+{
+	write_vector_histograms_binary (binary_histograms_filename (c.user.histograms_frames_masked_ROIs_number_bees_raw_filename ()), &c.ROIs_histograms, false);
+}
+
+static void benchmark_read_vector_histograms_binary (const Case &c)
+{
+	delete read_vector_histograms_binary (binary_histograms_filename (c.user.histograms_frames_masked_ROIs_number_bees_raw_filename ()), c.run.number_frames, c.run.number_ROIs);
+}
+
+static void benchmark_write_vector_histograms_compressed (const Case &c)
+{
+	write_vector_histograms_binary (binary_histograms_filename (c.user.histograms_frames_masked_ROIs_number_bees_raw_filename ()), &c.ROIs_histograms, true);
+}
+
+static void decode_frame (const Image &frame, const Case *, uint64_t *checksum)
+{
+	*checksum += frame.at<unsigned char> (0, 0);
+}
+
+static void count_ROI_pixels (unsigned int index_frame, unsigned int index_mask, const Case *c, double *sum)
+{
+	*sum += c->ROIs_cumulative_histograms->count_from (index_frame * c->run.number_ROIs + index_mask, c->run.same_colour_level);
+}
@@ -0,0 +1,245 @@
+import argparse
+import filecmp
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+parser = argparse.ArgumentParser (
+    description = "run the program with every analysis on synthetic data, compare its CSV files with the golden files, and compare its throughput with a baseline",
+    argument_default = None
+)
+parser.add_argument (
+    '--program',
+    default = os.path.join (os.path.dirname (os.path.abspath (__file__)), '..', 'assisi-batch-video-processing'),
+    help = "program to check"
+)
+parser.add_argument (
+    '--benchmark',
+    default = os.path.join (os.path.dirname (os.path.abspath (__file__)), 'benchmark'),
+    help = "benchmark program that generates the synthetic data"
+)
+parser.add_argument (
+    '--work',
+    default = 'regression-data',
+    help = "folder where the synthetic data is generated and analysed"
+)
+parser.add_argument (
+    '--golden',
+    default = os.path.join (os.path.dirname (os.path.abspath (__file__)), 'golden'),
+    help = "folder with the golden CSV files and the throughput baseline"
+)
+parser.add_argument (
+    '--update-golden',
+    action = 'store_true',
+    help = "replace the golden CSV files with the files of this run instead of comparing them"
+)
+parser.add_argument (
+    '--update-baseline',
+    action = 'store_true',
+    help = "replace the throughput baseline with the throughput of this run instead of comparing it"
+)
+parser.add_argument (
+    '--ignore-exit-status',
+    action = 'store_true',
+    help = "do not fail when the program exits with a failure status, as the first version of the program does after the last row of the data CSV file. "
+    "The CSV files are still compared"
+)
+parser.add_argument (
+    '--tolerance',
+    type = float,
+    default = 0.10,
+    help = "highest allowed drop of throughput relative to the baseline"
+)
+parser.add_argument (
+    '--runs',
+    type = int,
+    default = 3,
+    help = "how many times the program runs, the fastest run is the throughput"
+)
+parser.add_argument (
+    '--size',
+    default = '640x480',
+    help = "frame size of the synthetic data"
+)
+parser.add_argument (
+    '--number-ROIs', '-r',
+    type = int,
+    default = 3,
+    help = "how many regions of interest the synthetic data has"
+)
+parser.add_argument (
+    '--number-frames', '-n',
+    type = int,
+    default = 60,
+    help = "how many frames each synthetic folder has"
+)
+parser.add_argument (
+    '--folders',
+    type = int,
+    default = 4,
+    help = "how many synthetic folders are analysed"
+)
+parser.add_argument (
+    '--same-colour-threshold', '-c',
+    type = int,
+    default = 10,
+    help = "threshold used to compare two pixel intensity values"
+)
+parser.add_argument (
+    '--delta-frame', '-d',
+    type = int,
+    default = 2,
+    help = "how many frames apart are used to compute bee speed"
+)
+parser.add_argument (
+    '--delta-velocity', '-v',
+    type = int,
+    default = 2,
+    help = "how many frames apart are used to compute bee acceleration"
+)
+args = parser.parse_args ()
+
+ANALYSES = [
+    '--check-ROIs',
+    '--histograms-frames-masked-ORed-ROIs-number-bees-raw',
+    '--histograms-frames-masked-ORed-ROIs-number-bees-HE',
+    '--features-number-bees-AND-bee-speed',
+    '--feature-average-bee-speed',
+    '--feature-total-bee-acceleration',
+    '--total-number-bees-in-ROIs-raw',
+    '--total-number-bees-in-ROIs-HE',
+]
+
+# options that only newer versions have, they are passed if the program lists them in its help
+OPTIONAL_ANALYSES = [
+    # newer versions write binary histogram files, and CSV histogram files only with this option
+    '--export-histograms-CSV',
+]
+
+# the golden files and the baseline are only valid for the same data and analysis parameters
+parameters = {
+    'size': args.size,
+    'number_ROIs': args.number_ROIs,
+    'number_frames': args.number_frames,
+    'folders': args.folders,
+    'same_colour_threshold': args.same_colour_threshold,
+    'delta_frame': args.delta_frame,
+    'delta_velocity': args.delta_velocity,
+}
+
+def fail (message):
+    print ("FAILED: " + message)
+    sys.exit (1)
+
+def run (command, ignore_exit_status = False):
+    result = subprocess.run (command, stdout = subprocess.PIPE, stderr = subprocess.STDOUT, universal_newlines = True)
+    if result.returncode != 0 and not ignore_exit_status:
+        print (result.stdout)
+        fail ("command {} exited with code {}".format (' '.join (command), result.returncode))
+
+def data_folders ():
+    return [
+        os.path.join (case_folder, 'folder-{}'.format (index + 1))
+        for index in range (args.folders)
+    ]
+
+def remove_results ():
+    """Remove every file the program writes, so that each run computes everything."""
+    for folder in data_folders ():
+        for filename in os.listdir (folder):
+            if not filename.endswith ('.png'):
+                os.remove (os.path.join (folder, filename))
+
+def result_files (folder):
+    return sorted (filename for filename in os.listdir (folder) if filename.endswith ('.csv'))
+
+case_folder = os.path.join (args.work, '{}_ROIs={}'.format (args.size, args.number_ROIs))
+print ("Generating {} folders with {} frames of {} pixels in {}...".format (args.folders, args.number_frames, args.size, case_folder))
+run ([
+    args.benchmark, '--generate',
+    '--folder', args.work,
+    '--sizes', args.size,
+    '--ROIs', str (args.number_ROIs),
+    '--frames', str (args.number_frames),
+    '--folders', str (args.folders),
+])
+
+def supported_options (program, options):
+    """Return the given options that the help of the program lists.  The help needs the required options."""
+    result = subprocess.run (
+        [program, '--help'] + required_options,
+        stdout = subprocess.PIPE, stderr = subprocess.STDOUT, universal_newlines = True)
+    listed = set (word.rstrip (',') for word in result.stdout.split ())
+    return [option for option in options if option in listed]
+
+required_options = [
+    '--number-ROIs', str (args.number_ROIs),
+    '--number-frames', str (args.number_frames),
+    '--same-colour-threshold', str (args.same_colour_threshold),
+]
+command = [
+    args.program,
+    '--csv-file', os.path.join (case_folder, 'data-analyse.csv'),
+] + required_options + [
+    '--delta-frame', str (args.delta_frame),
+    '--delta-velocity', str (args.delta_velocity),
+] + ANALYSES + supported_options (args.program, OPTIONAL_ANALYSES)
+best = None
+for index_run in range (max (args.runs, 1)):
+    remove_results ()
+    start = time.monotonic ()
+    run (command, args.ignore_exit_status)
+    seconds = time.monotonic () - start
+    print ("Run {}: {:.3f} seconds".format (index_run + 1, seconds))
+    best = seconds if best is None else min (best, seconds)
+frames_per_second = args.folders * args.number_frames / best
+print ("Throughput: {:.1f} frames/s".format (frames_per_second))
+
+failures = []
+if args.update_golden:
+    shutil.rmtree (args.golden, ignore_errors = True)
+for index, folder in enumerate (data_folders ()):
+    golden_folder = os.path.join (args.golden, 'folder-{}'.format (index + 1))
+    if args.update_golden:
+        os.makedirs (golden_folder)
+        for filename in result_files (folder):
+            shutil.copyfile (os.path.join (folder, filename), os.path.join (golden_folder, filename))
+        continue
+    if not os.path.isdir (golden_folder):
+        fail ("there are no golden files in {}, create them with --update-golden".format (golden_folder))
+    produced = result_files (folder)
+    expected = result_files (golden_folder)
+    for filename in sorted (set (expected) - set (produced)):
+        failures.append ("{} was not written".format (os.path.join (folder, filename)))
+    for filename in sorted (set (produced) - set (expected)):
+        failures.append ("{} has no golden file".format (os.path.join (folder, filename)))
+    for filename in sorted (set (produced) & set (expected)):
+        if not filecmp.cmp (os.path.join (folder, filename), os.path.join (golden_folder, filename), shallow = False):
+            failures.append ("{} differs from its golden file".format (os.path.join (folder, filename)))
+
+baseline_filename = os.path.join (args.golden, 'baseline.json')
+if args.update_golden or args.update_baseline:
+    os.makedirs (args.golden, exist_ok = True)
+    with open (baseline_filename, 'w') as fd:
+        json.dump ({'parameters': parameters, 'frames_per_second': frames_per_second}, fd, indent = 2)
+    print ("Baseline set to {:.1f} frames/s".format (frames_per_second))
+if os.path.exists (baseline_filename):
+    with open (baseline_filename) as fd:
+        baseline = json.load (fd)
+    if baseline ['parameters'] != parameters:
+        fail ("the golden files and the baseline were made with parameters {}".format (baseline ['parameters']))
+    lowest = baseline ['frames_per_second'] * (1 - args.tolerance)
+    print ("Baseline: {:.1f} frames/s, lowest allowed {:.1f} frames/s".format (baseline ['frames_per_second'], lowest))
+    if frames_per_second < lowest:
+        failures.append ("throughput {:.1f} frames/s is below {:.1f} frames/s".format (frames_per_second, lowest))
+else:
+    failures.append ("there is no baseline {}, create it with --update-baseline".format (baseline_filename))
+
+for failure in failures:
+    print ("FAILED: " + failure)
+if failures:
+    sys.exit (1)
+print ("OK: every CSV file matches its golden file and the throughput is within the tolerance")
@@ -0,0 +1,170 @@
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <iostream>
+
+#include "synthetic_data.hpp"
+
+using namespace std;
+
+/**
+ * Colour of the background at the left border, it increases to the right.
+ */
+static const int BACKGROUND_COLOUR = 100;
+
+/**
+ * Highest change of colour of a pixel, and of the light of a frame.
+ */
+static const int PIXEL_NOISE = 3;
+static const int LIGHT_NOISE = 8;
+
+static uint32_t next_random (uint32_t &state);
+static uint32_t random_state (uint32_t seed, unsigned int index);
+static int random_between (uint32_t &state, int low, int high);
+static int bounce (int start, int velocity, unsigned int time, int size);
+static Image make_background (int width, int height, uint32_t seed);
+static vector<Image> make_masks (int width, int height, unsigned int number_ROIs);
+static void make_folder (const string &folder);
+
+SyntheticData::SyntheticData (int width, int height, unsigned int number_ROIs, unsigned int number_frames, unsigned int number_bees, uint32_t seed):
+   width (width),
+   height (height),
+   number_frames (number_frames),
+   background (make_background (width, height, seed)),
+   masks (make_masks (width, height, number_ROIs)),
+   seed (seed)
+{
+	uint32_t state = random_state (seed, 0);
+	const int size = max (2, min (width, height) / 40);
+	for (unsigned int index_bee = 0; index_bee < number_bees; index_bee++) {
+		Bee bee;
+		bee.x = random_between (state, 0, width - 1);
+		bee.y = random_between (state, 0, height - 1);
+		bee.velocity_x = random_between (state, -size, size);
+		bee.velocity_y = random_between (state, -size, size);
+		bee.radius = random_between (state, size, 2 * size);
+		bee.colour = random_between (state, 10, 40);
+		this->bees.push_back (bee);
+	}
+}
+
+Image SyntheticData::frame (unsigned int index_frame) const
+{
+	uint32_t state = random_state (this->seed, index_frame);
+	const int light = random_between (state, -LIGHT_NOISE, LIGHT_NOISE);
+	Image result (this->height, this->width, CV_8UC1);
+	for (int y = 0; y < this->height; y++) {
+		const unsigned char *background = this->background.ptr<unsigned char> (y);
+		unsigned char *pixel = result.ptr<unsigned char> (y);
+		for (int x = 0; x < this->width; x++)
+			pixel [x] = max (0, min (255, background [x] + light + random_between (state, -PIXEL_NOISE, PIXEL_NOISE)));
+	}
+	for (const Bee &bee : this->bees) {
+		const int centre_x = bounce (bee.x, bee.velocity_x, index_frame, this->width);
+		const int centre_y = bounce (bee.y, bee.velocity_y, index_frame, this->height);
+		for (int y = max (0, centre_y - bee.radius); y <= min (this->height - 1, centre_y + bee.radius); y++) {
+			unsigned char *pixel = result.ptr<unsigned char> (y);
+			for (int x = max (0, centre_x - bee.radius); x <= min (this->width - 1, centre_x + bee.radius); x++)
+				if ((x - centre_x) * (x - centre_x) + (y - centre_y) * (y - centre_y) <= bee.radius * bee.radius)
+					pixel [x] = bee.colour + random_between (state, 0, PIXEL_NOISE);
+		}
+	}
+	return result;
+}
+
+string SyntheticData::write (const string &folder) const
+{
+	make_folder (folder);
+	bool ok = cv::imwrite (folder + "background.png", this->background);
+	for (size_t index_mask = 0; index_mask < this->masks.size (); index_mask++)
+		ok = ok && cv::imwrite (folder + "Mask-" + to_string (index_mask + 1) + ".png", this->masks [index_mask]);
+	for (unsigned int index_frame = 1; index_frame <= this->number_frames; index_frame++) {
+		char number [5];
+		sprintf (number, "%04d", index_frame);
+		ok = ok && cv::imwrite (folder + "frames-" + number + ".png", this->frame (index_frame));
+	}
+	if (!ok) {
+		cerr << "Could not write the synthetic data to folder " << folder << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	return
+	      "\"" + folder + "\"," +
+	      "0,0," + to_string (this->width / 4) + "," + to_string (this->height / 4) + ",1";
+}
+
+/**
+ * Xorshift generator, its state is never zero.
+ */
+static uint32_t next_random (uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static uint32_t random_state (uint32_t seed, unsigned int index)
+{
+	uint32_t result = seed * 2654435761u ^ (index + 1) * 2246822519u;
+	return result == 0 ? 1 : result;
+}
+
+static int random_between (uint32_t &state, int low, int high)
+{
+	return low + (int) (next_random (state) % (uint32_t) (high - low + 1));
+}
+
+/**
+ * Position at the given time of something that starts at the given position
+ * and bounces between zero and size minus one.
+ */
+static int bounce (int start, int velocity, unsigned int time, int size)
+{
+	if (size < 2)
+		return 0;
+	const long long period = 2 * (size - 1);
+	long long position = (start + (long long) velocity * time) % period;
+	if (position < 0)
+		position += period;
+	return position < size ? position : period - position;
+}
+
+static Image make_background (int width, int height, uint32_t seed)
+{
+	uint32_t state = random_state (seed, UINT32_MAX - 1);
+	Image result (height, width, CV_8UC1);
+	for (int y = 0; y < height; y++) {
+		unsigned char *pixel = result.ptr<unsigned char> (y);
+		for (int x = 0; x < width; x++)
+			pixel [x] = BACKGROUND_COLOUR + x * 64 / width + random_between (state, -2 * PIXEL_NOISE, 2 * PIXEL_NOISE);
+	}
+	return result;
+}
+
+static vector<Image> make_masks (int width, int height, unsigned int number_ROIs)
+{
+	vector<Image> result;
+	const int overlap = number_ROIs == 0 ? 0 : width / (16 * number_ROIs);
+	const int margin = height / 16;
+	for (unsigned int index_mask = 0; index_mask < number_ROIs; index_mask++) {
+		Image mask = Image::zeros (height, width, CV_8UC1);
+		const int first_column = max (0, (int) (index_mask * width / number_ROIs) - overlap);
+		const int last_column = min (width, (int) ((index_mask + 1) * width / number_ROIs) + overlap);
+		for (int y = margin; y < height - margin; y++) {
+			unsigned char *pixel = mask.ptr<unsigned char> (y);
+			for (int x = first_column; x < last_column; x++)
+				pixel [x] = 255;
+		}
+		result.push_back (mask);
+	}
+	return result;
+}
+
+/**
+ * Create the given folder and its parents, if they do not exist.
+ */
+static void make_folder (const string &folder)
+{
+	for (size_t index = folder.find ('/', 1); index != string::npos; index = folder.find ('/', index + 1))
+		mkdir (folder.substr (0, index).c_str (), 0777);
+	mkdir (folder.c_str (), 0777);
+}
@@ -0,0 +1,57 @@
+#ifndef __SYNTHETIC_DATA__
+#define __SYNTHETIC_DATA__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+
+/**
+ * @brief The SyntheticData class generates the data of a folder: a background
+ * image, the masks of the regions of interest and frames where dark blobs,
+ * the bees, move over the background.
+ *
+ * The data only depends on the constructor arguments.  Pixels get noise from
+ * a generator seeded with the seed and the frame number, each frame has a
+ * small global change of light, and each bee moves with a constant velocity
+ * and bounces on the borders of the frame, so any frame can be generated
+ * without generating the previous ones.
+ *
+ * The regions of interest are vertical stripes side by side, and neighbouring
+ * stripes overlap, so that some pixels belong to two regions of interest.
+ */
+class SyntheticData
+{
+public:
+	const int width;
+	const int height;
+	const unsigned int number_frames;
+	const Image background;
+	const std::vector<Image> masks;
+	SyntheticData (int width, int height, unsigned int number_ROIs, unsigned int number_frames, unsigned int number_bees, uint32_t seed);
+	/**
+	 * @brief frame Generate the frame with the given number, starting at one.
+	 */
+	Image frame (unsigned int index_frame) const;
+	/**
+	 * @brief write Write the background, the masks and the frames to the given
+	 * folder with the default file names of the program options, and return
+	 * the row of the data CSV file that describes the folder.
+	 */
+	std::string write (const std::string &folder) const;
+private:
+	struct Bee
+	{
+		int x;
+		int y;
+		int velocity_x;
+		int velocity_y;
+		int radius;
+		unsigned char colour;
+	};
+	const uint32_t seed;
+	std::vector<Bee> bees;
+};
+
+#endif
@@ -0,0 +1,206 @@
+import argparse
+import filecmp
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+parser = argparse.ArgumentParser (
+    description = "copy synthetic frames one at a time into folders watched by the program, and compare the CSV files it writes with the ones of a batch run",
+    argument_default = None
+)
+parser.add_argument (
+    '--program',
+    default = os.path.join (os.path.dirname (os.path.abspath (__file__)), '..', 'assisi-batch-video-processing'),
+    help = "program to check"
+)
+parser.add_argument (
+    '--benchmark',
+    default = os.path.join (os.path.dirname (os.path.abspath (__file__)), 'benchmark'),
+    help = "benchmark program that generates the synthetic data"
+)
+parser.add_argument (
+    '--work',
+    default = 'watch-data',
+    help = "folder where the synthetic data is generated and analysed"
+)
+parser.add_argument (
+    '--size',
+    default = '160x120',
+    help = "frame size of the synthetic data"
+)
+parser.add_argument (
+    '--number-ROIs', '-r',
+    type = int,
+    default = 3,
+    help = "how many regions of interest the synthetic data has"
+)
+parser.add_argument (
+    '--number-frames', '-n',
+    type = int,
+    default = 20,
+    help = "how many frames each synthetic folder has"
+)
+parser.add_argument (
+    '--folders',
+    type = int,
+    default = 2,
+    help = "how many synthetic folders are watched"
+)
+parser.add_argument (
+    '--frames-before-start',
+    type = int,
+    default = 3,
+    help = "how many frames are in each folder before the program starts, the last one is still being written"
+)
+parser.add_argument (
+    '--interval',
+    type = float,
+    default = 0.05,
+    help = "seconds between two frame copies"
+)
+parser.add_argument (
+    '--timeout',
+    type = float,
+    default = 60,
+    help = "seconds the program has to finish after the last frame is copied"
+)
+parser.add_argument (
+    '--same-colour-threshold', '-c',
+    type = int,
+    default = 10,
+    help = "threshold used to compare two pixel intensity values"
+)
+parser.add_argument (
+    '--delta-frame', '-d',
+    type = int,
+    default = 2,
+    help = "how many frames apart are used to compute bee speed"
+)
+parser.add_argument (
+    '--delta-velocity', '-v',
+    type = int,
+    default = 2,
+    help = "how many frames apart are used to compute bee acceleration"
+)
+args = parser.parse_args ()
+
+# the features that option --watch computes from pixel counts
+ANALYSES = [
+    '--features-number-bees-AND-bee-speed',
+    '--feature-average-bee-speed',
+    '--feature-total-bee-acceleration',
+    '--total-number-bees-in-ROIs-raw',
+    '--total-number-bees-in-ROIs-HE',
+]
+
+FRAME_PREFIX = 'frames-'
+
+def fail (message):
+    print ("FAILED: " + message)
+    sys.exit (1)
+
+def run (command):
+    result = subprocess.run (command, stdout = subprocess.PIPE, stderr = subprocess.STDOUT, universal_newlines = True)
+    if result.returncode != 0:
+        print (result.stdout)
+        fail ("command {} exited with code {}".format (' '.join (command), result.returncode))
+
+def frame_files (folder):
+    return sorted (filename for filename in os.listdir (folder) if filename.startswith (FRAME_PREFIX))
+
+def result_files (folder):
+    return sorted (filename for filename in os.listdir (folder) if filename.endswith ('.csv'))
+
+def analyse_command (csv_filename):
+    return [
+        args.program,
+        '--csv-file', csv_filename,
+        '--number-ROIs', str (args.number_ROIs),
+        '--number-frames', str (args.number_frames),
+        '--same-colour-threshold', str (args.same_colour_threshold),
+        '--delta-frame', str (args.delta_frame),
+        '--delta-velocity', str (args.delta_velocity),
+    ] + ANALYSES
+
+def copy_slowly (source, destination, chunks = 10):
+    """Copy a file in chunks with a pause between them, so that it is still being written when the program starts."""
+    with open (source, 'rb') as file:
+        data = file.read ()
+    size = (len (data) + chunks - 1) // chunks
+    with open (destination, 'wb') as file:
+        for index in range (0, len (data), size):
+            file.write (data [index : index + size])
+            file.flush ()
+            time.sleep (0.1)
+
+shutil.rmtree (args.work, ignore_errors = True)
+print ("Generating {} folders with {} frames of {} pixels in {}...".format (args.folders, args.number_frames, args.size, args.work))
+run ([
+    args.benchmark, '--generate',
+    '--folder', args.work,
+    '--sizes', args.size,
+    '--ROIs', str (args.number_ROIs),
+    '--frames', str (args.number_frames),
+    '--folders', str (args.folders),
+])
+case_folder = os.path.join (args.work, '{}_ROIs={}'.format (args.size, args.number_ROIs))
+batch_folders = [os.path.join (case_folder, 'folder-{}'.format (index + 1)) for index in range (args.folders)]
+watch_folders = [os.path.join (args.work, 'watch', 'folder-{}'.format (index + 1)) for index in range (args.folders)]
+
+print ("Batch run...")
+run (analyse_command (os.path.join (case_folder, 'data-analyse.csv')))
+
+# the watched folders have the background and the masks, and the frames arrive later
+for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+    os.makedirs (watch_folder)
+    for filename in os.listdir (batch_folder):
+        if filename.endswith ('.png') and not filename.startswith (FRAME_PREFIX):
+            shutil.copy (os.path.join (batch_folder, filename), watch_folder)
+watch_csv = os.path.join (args.work, 'watch', 'data-analyse.csv')
+with open (os.path.join (case_folder, 'data-analyse.csv')) as source, open (watch_csv, 'w') as destination:
+    for line in source:
+        for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+            line = line.replace ('"{}/"'.format (batch_folder), '"{}/"'.format (watch_folder))
+        destination.write (line)
+
+frames = frame_files (batch_folders [0])
+before_start = min (max (args.frames_before_start, 0), len (frames))
+for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+    for filename in frames [:max (before_start - 1, 0)]:
+        shutil.copy (os.path.join (batch_folder, filename), watch_folder)
+
+print ("Watch run, {} frames in each folder before the program starts...".format (before_start))
+log_filename = os.path.join (args.work, 'watch', 'log.txt')
+with open (log_filename, 'w') as log:
+    process = subprocess.Popen (analyse_command (watch_csv) + ['--watch'], stdout = log, stderr = subprocess.STDOUT)
+    if before_start > 0:
+        # the last frame before the start is written while the program looks at the frames already in the folders
+        for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+            copy_slowly (os.path.join (batch_folder, frames [before_start - 1]), os.path.join (watch_folder, frames [before_start - 1]))
+    for filename in frames [before_start:]:
+        for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+            shutil.copy (os.path.join (batch_folder, filename), watch_folder)
+        time.sleep (args.interval)
+    try:
+        code = process.wait (timeout = args.timeout)
+    except subprocess.TimeoutExpired:
+        process.kill ()
+        fail ("the program did not finish {} seconds after the last frame, see {}".format (args.timeout, log_filename))
+if code != 0:
+    fail ("the program exited with code {}, see {}".format (code, log_filename))
+
+differences = []
+for batch_folder, watch_folder in zip (batch_folders, watch_folders):
+    batch = result_files (batch_folder)
+    watch = result_files (watch_folder)
+    if batch != watch:
+        differences.append ("{} has CSV files {} instead of {}".format (watch_folder, watch, batch))
+        continue
+    for filename in batch:
+        if not filecmp.cmp (os.path.join (batch_folder, filename), os.path.join (watch_folder, filename), shallow = False):
+            differences.append (os.path.join (watch_folder, filename))
+if differences:
+    fail ("the watched folders have different CSV files:\n    " + "\n    ".join (differences))
+print ("OK")
@@ -0,0 +1,34 @@
+TEMPLATE = app
+TARGET = check
+CONFIG += console c++11
+CONFIG -= app_bundle
+CONFIG -= qt
+CONFIG += link_pkgconfig
+PKGCONFIG = opencv
+LIBS += -lboost_program_options -lpthread
+INCLUDEPATH += .. ../benchmark
+
+
+SOURCES += main.cpp \
+    histogram_files.cpp \
+    label_histograms.cpp \
+    frame_pass_allocations.cpp \
+    ../benchmark/synthetic_data.cpp \
+    ../experiment.cpp \
+    ../feature_table.cpp \
+    ../frame_watcher.cpp \
+    ../stage_graph.cpp \
+    ../parameters.cpp \
+    ../image.cpp \
+    ../histogram.cpp \
+    ../frame_reader.cpp \
+    ../frame_cache.cpp \
+    ../roi_labels.cpp \
+    ../image_pool.cpp \
+    ../packed_histograms.cpp \
+    ../csv.cpp \
+    ../manifest.cpp \
+    ../metrics.cpp
+
+HEADERS += \
+    checks.hpp
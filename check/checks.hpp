@@ -0,0 +1,29 @@
+#ifndef __CHECKS__
+#define __CHECKS__
+
+#include <string>
+
+/**
+ * @brief check_histogram_files Write histograms with undefined frames to CSV,
+ * binary and compressed binary files in the given folder, read them back, and
+ * return whether the histograms read are equal to the ones written.
+ */
+bool check_histogram_files (const std::string &folder);
+
+/**
+ * @brief check_label_histograms Compute the histograms and pixel counts of
+ * the regions of interest of synthetic frames with class ROILabels, with and
+ * without the histogram equalisation lookup table, and return whether they are
+ * equal to the ones computed with cv::equalizeHist, cv::absdiff and
+ * compute_histogram.
+ */
+bool check_label_histograms (const std::string &folder);
+
+/**
+ * @brief check_frame_pass_allocations Run the frame pass on synthetic folders
+ * written in the given folder, and return whether the image pool requested no
+ * memory from the system after the first frames of each pass.
+ */
+bool check_frame_pass_allocations (const std::string &folder);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "checks.hpp"
+#include "experiment.hpp"
+#include "synthetic_data.hpp"
+
+using namespace std;
+namespace po = boost::program_options;
+
+static const unsigned int NUMBER_ROIS = 3;
+static const unsigned int NUMBER_FRAMES = 24;
+static const unsigned int NUMBER_BEES = 10;
+
+/**
+ * Analyses of each case, with the number of decode threads.  The frame passes
+ * of the first two cases only compute pixel counts, the one of the last case
+ * also computes histograms and bee speed histograms.
+ */
+static const vector<vector<string> > CASES = {
+	{"--features-number-bees-AND-bee-speed", "--counts-only", "--decode-threads", "0"},
+	{"--features-number-bees-AND-bee-speed", "--counts-only", "--decode-threads", "2"},
+	{"--features-number-bees-AND-bee-speed", "--histograms-frames-masked-ORed-ROIs-number-bees-HE", "--decode-threads", "2"},
+};
+
+static bool check_case (const string &folder, const vector<string> &analyses);
+static bool read_steady_heap_allocations (const string &filename, size_t &result);
+
+bool check_frame_pass_allocations (const string &folder)
+{
+	bool result = true;
+	for (size_t index = 0; index < CASES.size (); index++)
+		result = check_case (folder + "allocations-" + to_string (index + 1) + "/", CASES [index]) && result;
+	return result;
+}
+
+/**
+ * Run the program with the given analyses on one synthetic folder in a single
+ * frame range, so that no other frame pass uses the image pool, and require
+ * that its frame pass does not request memory from the system after the first
+ * frames.  The count is read from the metrics of the folder.
+ */
+static bool check_case (const string &folder, const vector<string> &analyses)
+{
+	string name = folder;
+	for (const string &analysis : analyses)
+		name += " " + analysis;
+	const SyntheticData data (160, 120, NUMBER_ROIS, NUMBER_FRAMES, NUMBER_BEES, 1);
+	const string csv_filename = folder + "data-analyse.csv";
+	const string row = data.write (folder + "folder/");
+	FILE *csv = fopen (csv_filename.c_str (), "w");
+	if (csv == NULL || fprintf (csv, "\"folder\",x1,y1,x2,y2,use\n%s\n", row.c_str ()) < 0 || fclose (csv) != 0) {
+		cerr << name << ": could not write the data CSV file!\n";
+		return false;
+	}
+	vector<string> arguments = {
+		"check",
+		"--csv-file", csv_filename,
+		"--number-ROIs", to_string (NUMBER_ROIS),
+		"--number-frames", to_string (NUMBER_FRAMES),
+		"--same-colour-threshold", "10",
+		// with more than one job the frame progress is not shown, and the data
+		// has one folder, so its frame pass is the only one
+		"--jobs", "2",
+		"--frame-shards", "1",
+		"--metrics", folder + "metrics.json",
+	};
+	arguments.insert (arguments.end (), analyses.begin (), analyses.end ());
+	vector<const char *> argv;
+	for (const string &argument : arguments)
+		argv.push_back (argument.c_str ());
+	po::options_description options;
+	options.add (Experiment::program_options ());
+	options.add (RunParameters::program_options ());
+	po::variables_map vm;
+	po::store (po::parse_command_line (argv.size (), argv.data (), options), vm);
+	po::notify (vm);
+	// the progress messages of the program are not shown
+	ostringstream log;
+	streambuf *console = cout.rdbuf (log.rdbuf ());
+	{
+		Experiment experiment (vm);
+		experiment.process_data_plots_file ();
+	}
+	cout.rdbuf (console);
+	size_t steady_heap_allocations;
+	if (!read_steady_heap_allocations (folder + "folder/metrics.json", steady_heap_allocations)) {
+		cerr << name << ": the metrics of the folder do not have the heap allocations of the frame pass!\n";
+		return false;
+	}
+	if (steady_heap_allocations != 0) {
+		cerr << name << ": the image pool requested memory " << steady_heap_allocations << " times after the first frames of the frame pass!\n";
+		return false;
+	}
+	return true;
+}
+
+static bool read_steady_heap_allocations (const string &filename, size_t &result)
+{
+	static const string KEY = "\"frame_pass_steady_heap_allocations\": ";
+	ifstream file (filename);
+	string line;
+	while (getline (file, line)) {
+		size_t position = line.find (KEY);
+		if (position != string::npos)
+			return istringstream (line.substr (position + KEY.size ())) >> result ? true : false;
+	}
+	return false;
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "checks.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
+
+using namespace std;
+
+static const unsigned int NUMBER_FRAMES = 40;
+static const unsigned int HISTOGRAMS_PER_FRAME = 3;
+
+static HistogramMatrix *make_histograms (const vector<unsigned int> &undefined_frames);
+static bool check_round_trip (const string &filename, const HistogramMatrix &histograms, const char *format, HistogramMatrix *read);
+
+bool check_histogram_files (const string &folder)
+{
+	bool result = true;
+	// the first frames are undefined as in the bee speed histograms, the others test the middle and the end of the files
+	const vector<vector<unsigned int> > cases = {
+		{},
+		{0, 1, 2, 17, NUMBER_FRAMES - 1},
+	};
+	for (size_t index_case = 0; index_case < cases.size (); index_case++) {
+		HistogramMatrix *histograms = make_histograms (cases [index_case]);
+		const string filename = folder + "histograms-" + to_string (index_case + 1) + ".csv";
+		write_vector_histograms (filename, histograms);
+		result = check_round_trip (filename, *histograms, "CSV", read_vector_histograms (filename, NUMBER_FRAMES, HISTOGRAMS_PER_FRAME)) && result;
+		const string binary_filename = binary_histograms_filename (filename);
+		write_vector_histograms_binary (binary_filename, histograms, false);
+		result = check_round_trip (binary_filename, *histograms, "binary", read_vector_histograms_binary (binary_filename, NUMBER_FRAMES, HISTOGRAMS_PER_FRAME)) && result;
+		write_vector_histograms_binary (binary_filename, histograms, true);
+		result = check_round_trip (binary_filename, *histograms, "compressed binary", read_vector_histograms_binary (binary_filename, NUMBER_FRAMES, HISTOGRAMS_PER_FRAME)) && result;
+		delete histograms;
+	}
+	return result;
+}
+
+/**
+ * Histograms whose counts change slowly between frames, as in a video, with
+ * some jumps and the highest count a frame can have, and where the given
+ * frames are undefined.
+ */
+static HistogramMatrix *make_histograms (const vector<unsigned int> &undefined_frames)
+{
+	HistogramMatrix *result = new HistogramMatrix (HISTOGRAMS_PER_FRAME);
+	uint32_t state = 12345;
+	vector<uint32_t> previous (HISTOGRAMS_PER_FRAME * NUMBER_COLOUR_LEVELS, 0);
+	for (unsigned int index_frame = 0; index_frame < NUMBER_FRAMES; index_frame++) {
+		if (find (undefined_frames.begin (), undefined_frames.end (), index_frame) != undefined_frames.end ()) {
+			result->append_undefined_frame ();
+			continue;
+		}
+		uint32_t *counts = result->append_frame ();
+		for (size_t index = 0; index < previous.size (); index++) {
+			state = state * 1103515245 + 12345;
+			const uint32_t random = state >> 8;
+			if (random % 50 == 0)
+				previous [index] = random % 100000;
+			else if (previous [index] + random % 7 >= 3)
+				previous [index] = previous [index] + random % 7 - 3;
+			counts [index] = previous [index];
+		}
+		if (index_frame == 5)
+			counts [0] = 1920 * 1080;
+	}
+	return result;
+}
+
+/**
+ * Compare the histograms read from the given file with the ones written, and
+ * delete the histograms read.
+ */
+static bool check_round_trip (const string &filename, const HistogramMatrix &histograms, const char *format, HistogramMatrix *read)
+{
+	bool result = *read == histograms;
+	if (!result)
+		cerr << "The histograms read from " << format << " file " << filename << " differ from the ones written!\n";
+	for (unsigned int index_frame = 0; index_frame < NUMBER_FRAMES; index_frame++)
+		if (read->undefined_frame (index_frame) != histograms.undefined_frame (index_frame)) {
+			cerr << "Frame " << index_frame << " of " << format << " file " << filename << " is " << (read->undefined_frame (index_frame) ? "undefined" : "defined") << " after reading it!\n";
+			result = false;
+		}
+	delete read;
+	return result;
+}
@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+
+#include "checks.hpp"
+#include "histogram.hpp"
+#include "image.hpp"
+#include "roi_labels.hpp"
+#include "synthetic_data.hpp"
+
+using namespace std;
+
+static const unsigned int NUMBER_FRAMES = 4;
+static const unsigned int NUMBER_BEES = 8;
+/**
+ * Level of the pixel count checks, the level of a same colour threshold of
+ * ten percent.
+ */
+static const unsigned int SAME_COLOUR_LEVEL = 26;
+
+static bool check_case (const SyntheticData &data);
+static bool check_histograms (const ROILabels &labels, const vector<uint32_t> &label_histograms, const Image &difference, const vector<Image> &masks, const Image &ORed_mask, const string &name);
+static bool check_counts (const vector<uint32_t> &counts, const Image &difference, const vector<Image> &masks, const Image &ORed_mask, const string &name);
+static bool equal_images (const Image &image, const Image &expected, const string &name);
+static Image ORed_masks (const SyntheticData &data);
+static bool check_empty_image_lut ();
+
+bool check_label_histograms (const string &)
+{
+	bool result = true;
+	// the odd width leaves pixels after the last full vector of a row
+	const int sizes [][2] = {{160, 120}, {333, 97}};
+	const unsigned int numbers_ROIs [] = {0, 1, 3};
+	for (const auto &size : sizes)
+		for (unsigned int number_ROIs : numbers_ROIs) {
+			const SyntheticData data (size [0], size [1], number_ROIs, NUMBER_FRAMES, NUMBER_BEES, 1 + number_ROIs);
+			result = check_case (data) && result;
+		}
+	return check_empty_image_lut () && result;
+}
+
+/**
+ * The lookup table of an empty image, for which cv::equalizeHist does nothing,
+ * must be the identity.
+ */
+static bool check_empty_image_lut ()
+{
+	unsigned char lut [NUMBER_COLOUR_LEVELS];
+	compute_histogram_equalisation_lut (Image (), lut);
+	for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+		if (lut [colour] != colour) {
+			cerr << "empty image: lookup table entry " << colour << " is " << (int) lut [colour] << "!\n";
+			return false;
+		}
+	return true;
+}
+
+/**
+ * Compute the histograms and pixel counts of every frame of the given data as
+ * the frame pass does, and as the first version of the program did with
+ * cv::equalizeHist, cv::absdiff and compute_histogram over the entire frame,
+ * and compare them.  The masks of neighbouring regions of interest overlap.
+ */
+static bool check_case (const SyntheticData &data)
+{
+	const string name = to_string (data.width) + "x" + to_string (data.height) + " with " + to_string (data.masks.size ()) + " ROIs";
+	const cv::Rect box = compute_masks_bounding_box (data.masks, data.width, data.height);
+	const ROILabels labels (data.masks, box);
+	const Image ORed_mask = ORed_masks (data);
+	Image background_HE;
+	cv::equalizeHist (data.background, background_HE);
+	bool result = true;
+	vector<uint32_t> label_histograms;
+	vector<uint32_t> counts;
+	vector<unsigned char> lut (NUMBER_COLOUR_LEVELS);
+	Image previous_frame_HE;
+	for (unsigned int index_frame = 1; index_frame <= data.number_frames; index_frame++) {
+		const string frame_name = name + ", frame " + to_string (index_frame);
+		const Image frame = data.frame (index_frame);
+		Image frame_HE;
+		cv::equalizeHist (frame, frame_HE);
+		compute_histogram_equalisation_lut (frame, lut.data ());
+		Image difference;
+		cv::absdiff (data.background, frame, difference);
+		labels.compute_label_histograms (frame (box), NULL, data.background (box), label_histograms, NULL);
+		result = check_histograms (labels, label_histograms, difference, data.masks, ORed_mask, frame_name + ", raw number of bees") && result;
+		labels.count_differences (frame (box), NULL, data.background (box), SAME_COLOUR_LEVEL, counts, NULL);
+		result = check_counts (counts, difference, data.masks, ORed_mask, frame_name + ", raw number of bees") && result;
+		cv::absdiff (background_HE, frame_HE, difference);
+		Image equalised_frame (box.height, box.width, CV_8UC1);
+		labels.compute_label_histograms (frame (box), lut.data (), background_HE (box), label_histograms, &equalised_frame);
+		result = check_histograms (labels, label_histograms, difference, data.masks, ORed_mask, frame_name + ", number of bees") && result;
+		result = equal_images (equalised_frame, frame_HE (box), frame_name + ", equalised by the histograms") && result;
+		equalised_frame.setTo (0);
+		labels.count_differences (frame (box), lut.data (), background_HE (box), SAME_COLOUR_LEVEL, counts, &equalised_frame);
+		result = check_counts (counts, difference, data.masks, ORed_mask, frame_name + ", number of bees") && result;
+		result = equal_images (equalised_frame, frame_HE (box), frame_name + ", equalised by the counts") && result;
+		if (index_frame > 1) {
+			cv::absdiff (previous_frame_HE, frame_HE, difference);
+			labels.compute_label_histograms (frame_HE (box), NULL, previous_frame_HE (box), label_histograms, NULL);
+			result = check_histograms (labels, label_histograms, difference, data.masks, ORed_mask, frame_name + ", bee speed") && result;
+		}
+		previous_frame_HE = frame_HE;
+	}
+	return result;
+}
+
+/**
+ * Compare the histograms of each region of interest and of the ORed regions
+ * of interest with the histograms of the given difference image computed by
+ * compute_histogram with each mask.
+ */
+static bool check_histograms (const ROILabels &labels, const vector<uint32_t> &label_histograms, const Image &difference, const vector<Image> &masks, const Image &ORed_mask, const string &name)
+{
+	bool result = true;
+	vector<uint32_t> histograms (max ((size_t) 1, masks.size ()) * NUMBER_COLOUR_LEVELS);
+	labels.ROIs_histograms (label_histograms, histograms.data ());
+	Histogram expected;
+	for (size_t index_mask = 0; index_mask < masks.size (); index_mask++) {
+		compute_histogram (difference, masks [index_mask], expected);
+		for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+			if (histograms [index_mask * NUMBER_COLOUR_LEVELS + colour] != expected [colour]) {
+				cerr << name << ": bin " << colour << " of the histogram of ROI " << index_mask + 1 << " is " << histograms [index_mask * NUMBER_COLOUR_LEVELS + colour] << " instead of " << expected [colour] << "!\n";
+				result = false;
+				break;
+			}
+	}
+	labels.ORed_ROIs_histogram (label_histograms, histograms.data ());
+	compute_histogram (difference, ORed_mask, expected);
+	for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+		if (histograms [colour] != expected [colour]) {
+			cerr << name << ": bin " << colour << " of the histogram of the ORed ROIs is " << histograms [colour] << " instead of " << expected [colour] << "!\n";
+			result = false;
+			break;
+		}
+	return result;
+}
+
+/**
+ * Compare the pixel counts of each region of interest and of the ORed regions
+ * of interest with the pixels of the given difference image that are equal to
+ * or higher than the level of the checks.
+ */
+static bool check_counts (const vector<uint32_t> &counts, const Image &difference, const vector<Image> &masks, const Image &ORed_mask, const string &name)
+{
+	bool result = true;
+	for (size_t index_mask = 0; index_mask <= masks.size (); index_mask++) {
+		const Image &mask = index_mask < masks.size () ? masks [index_mask] : ORed_mask;
+		uint32_t expected = 0;
+		for (int row = 0; row < difference.rows; row++)
+			for (int column = 0; column < difference.cols; column++)
+				if (mask.at<unsigned char> (row, column) != 0 && difference.at<unsigned char> (row, column) >= SAME_COLOUR_LEVEL)
+					expected++;
+		if (counts [index_mask] != expected) {
+			cerr << name << ": the count of " << (index_mask < masks.size () ? "ROI " + to_string (index_mask + 1) : string ("the ORed ROIs")) << " is " << counts [index_mask] << " instead of " << expected << "!\n";
+			result = false;
+		}
+	}
+	return result;
+}
+
+static bool equal_images (const Image &image, const Image &expected, const string &name)
+{
+	for (int row = 0; row < expected.rows; row++)
+		for (int column = 0; column < expected.cols; column++)
+			if (image.at<unsigned char> (row, column) != expected.at<unsigned char> (row, column)) {
+				cerr << name << ": pixel (" << column << ", " << row << ") is " << (int) image.at<unsigned char> (row, column) << " instead of " << (int) expected.at<unsigned char> (row, column) << "!\n";
+				return false;
+			}
+	return true;
+}
+
+/**
+ * Union of the masks, or the entire frame if there are no masks.
+ */
+static Image ORed_masks (const SyntheticData &data)
+{
+	Image result (data.height, data.width, CV_8UC1);
+	result.setTo (data.masks.empty () ? 255 : 0);
+	for (const Image &mask : data.masks)
+		for (int row = 0; row < data.height; row++)
+			for (int column = 0; column < data.width; column++)
+				if (mask.at<unsigned char> (row, column) != 0)
+					result.at<unsigned char> (row, column) = 255;
+	return result;
+}
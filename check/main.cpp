@@ -0,0 +1,83 @@
+#include <sys/stat.h>
+#include <stdio.h>
+#include <iostream>
+#include <boost/program_options.hpp>
+
+#include "checks.hpp"
+#include "image_pool.hpp"
+
+using namespace std;
+namespace po = boost::program_options;
+
+#define PO_FOLDER "folder"
+
+struct Check
+{
+	const char *name;
+	bool (*run) (const string &folder);
+};
+
+/**
+ * Checks in the order they run.
+ */
+static const Check CHECKS [] = {
+	{"histogram files round trip", check_histogram_files},
+	{"label histograms", check_label_histograms},
+	{"frame pass allocations", check_frame_pass_allocations},
+};
+
+static po::variables_map process_options (int argc, char *argv[]);
+
+/**
+ * Check routines of the program whose results must not change when they are
+ * optimised, such as the histogram file formats, against a reference.  Each
+ * check prints why it failed, and the program exits with a failure status if
+ * any check fails.
+ */
+int main (int argc, char *argv[])
+{
+	install_image_pool ();
+	po::variables_map vm = process_options (argc, argv);
+	string folder = vm [PO_FOLDER].as<string> ();
+	if (folder.empty () || folder [folder.size () - 1] != '/')
+		folder += "/";
+	mkdir (folder.c_str (), 0777);
+	unsigned int failures = 0;
+	for (const Check &check : CHECKS) {
+		const bool ok = check.run (folder);
+		printf ("%-40s %s\n", check.name, ok ? "OK" : "FAILED");
+		fflush (stdout);
+		failures += ok ? 0 : 1;
+	}
+	if (failures > 0) {
+		cerr << failures << " check(s) failed!\n";
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+static po::variables_map process_options (int argc, char *argv[])
+{
+	po::options_description options ("Check routines of the program against a reference.\n\nAvailable options");
+	options.add_options ()
+	      (
+	         "help,h",
+	         "show this help message"
+	         )
+	      (
+	         PO_FOLDER,
+	         po::value<string> ()
+	         ->default_value ("check-data")
+	         ->value_name ("PATH"),
+	         "folder where the files of the checks are written"
+	         )
+	      ;
+	po::variables_map vm;
+	po::store (po::parse_command_line (argc, argv, options), vm);
+	po::notify (vm);
+	if (vm.count ("help")) {
+		cout << options << "\n";
+		exit (EXIT_SUCCESS);
+	}
+	return vm;
+}
@@ -0,0 +1,231 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <limits>
+
+#include <opencv2/core/core.hpp>
+
+#include "csv.hpp"
+
+using namespace std;
+
+/**
+ * Size of the buffer of a writer.
+ */
+static const size_t CSV_BUFFER_SIZE = 1 << 16;
+
+/**
+ * Minimum number of rows in a stripe, so that parsing a stripe costs more than
+ * dispatching it to a thread.
+ */
+static const size_t MIN_STRIPE_ROWS = 256;
+
+static FILE *create_file (const string &filename);
+
+CSVWriter::CSVWriter (const string &filename):
+   filename (filename),
+   file (create_file (filename)),
+   buffer (CSV_BUFFER_SIZE),
+   used (0)
+{
+	if (this->file == NULL) {
+		cerr << "Could not create file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+CSVWriter::~CSVWriter ()
+{
+	this->flush ();
+	fclose (this->file);
+}
+
+void CSVWriter::write (int value)
+{
+	char digits [16];
+	char *end = digits + sizeof (digits);
+	char *start = end;
+	// the magnitude is computed in unsigned arithmetic, so the lowest int is also handled
+	unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+	do {
+		*--start = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (value < 0)
+		*--start = '-';
+	if (this->buffer.size () - this->used < (size_t) (end - start))
+		this->flush ();
+	memcpy (this->buffer.data () + this->used, start, end - start);
+	this->used += end - start;
+}
+
+void CSVWriter::write (double value)
+{
+	// the largest double printed with "%f" has 309 integer digits
+	const size_t MAX_LENGTH = numeric_limits<double>::max_exponent10 + 16;
+	if (this->buffer.size () - this->used < MAX_LENGTH)
+		this->flush ();
+	this->used += snprintf (this->buffer.data () + this->used, MAX_LENGTH, "%f", value);
+}
+
+void CSVWriter::flush ()
+{
+	if (fwrite (this->buffer.data (), 1, this->used, this->file) != this->used || fflush (this->file) != 0) {
+		cerr << "Failed writing to file " << this->filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	this->used = 0;
+}
+
+/**
+ * Create the given file.  An existing file is removed first, as older versions
+ * of the program made their result files read only.
+ */
+static FILE *create_file (const string &filename)
+{
+	unlink (filename.c_str ());
+	return fopen (filename.c_str (), "w");
+}
+
+CSVReader::CSVReader (const string &filename):
+   filename (filename),
+   data (NULL),
+   size (0)
+{
+	int fd = open (filename.c_str (), O_RDONLY);
+	if (fd == -1) {
+		cerr << "Could not open file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	struct stat status;
+	if (fstat (fd, &status) != 0) {
+		cerr << "Could not read the size of file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	this->size = status.st_size;
+	if (this->size > 0) {
+		void *data = mmap (NULL, this->size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			cerr << "Could not map file " << filename << "!\n";
+			exit (EXIT_FAILURE);
+		}
+		madvise (data, this->size, MADV_SEQUENTIAL);
+		this->data = (const char *) data;
+	}
+	close (fd);
+}
+
+CSVReader::~CSVReader ()
+{
+	if (this->data != NULL)
+		munmap ((void *) this->data, this->size);
+}
+
+/**
+ * Parse the rows of a stripe.  Each stripe records the first error it finds,
+ * and the error of the lowest row is reported after every stripe is done.
+ */
+class CSVReader::ParseStripe:
+      public cv::ParallelLoopBody
+{
+	const vector<const char *> &rows;
+	const char *const end;
+	const size_t number_columns;
+	const int number_stripes;
+	int *const values;
+	vector<size_t> &error_rows;
+	vector<size_t> &error_columns;
+public:
+	ParseStripe (const vector<const char *> &rows, const char *end, size_t number_columns, int number_stripes, int *values, vector<size_t> &error_rows, vector<size_t> &error_columns):
+	   rows (rows),
+	   end (end),
+	   number_columns (number_columns),
+	   number_stripes (number_stripes),
+	   values (values),
+	   error_rows (error_rows),
+	   error_columns (error_columns)
+	{
+	}
+	virtual void operator() (const cv::Range &range) const
+	{
+		const size_t number_rows = this->rows.size ();
+		for (int index_stripe = range.start; index_stripe < range.end; index_stripe++) {
+			size_t first_row = index_stripe * number_rows / this->number_stripes;
+			size_t last_row = (index_stripe + 1) * number_rows / this->number_stripes;
+			for (size_t row = first_row; row < last_row; row++) {
+				const char *row_end = row + 1 < number_rows ? this->rows [row + 1] - 1 : this->end;
+				size_t column = parse_row (this->rows [row], row_end, this->values + row * this->number_columns);
+				if (column != this->number_columns) {
+					this->error_rows [index_stripe] = row;
+					this->error_columns [index_stripe] = column;
+					break;
+				}
+			}
+		}
+	}
+private:
+	/**
+	 * Parse a row, that ends at the given newline or end of file.  Returns the
+	 * number of columns, or the index of the column with an error.
+	 */
+	size_t parse_row (const char *pointer, const char *row_end, int *row_values) const
+	{
+		if (row_end > pointer && row_end [-1] == '\r')
+			row_end--;
+		for (size_t column = 0; column < this->number_columns; column++) {
+			if (column > 0) {
+				if (pointer == row_end || *pointer != ',')
+					return column;
+				pointer++;
+			}
+			bool negative = pointer != row_end && *pointer == '-';
+			if (pointer != row_end && (*pointer == '-' || *pointer == '+'))
+				pointer++;
+			if (pointer == row_end || *pointer < '0' || *pointer > '9')
+				return column;
+			long long value = 0;
+			for (; pointer != row_end && *pointer >= '0' && *pointer <= '9'; pointer++) {
+				value = value * 10 + (*pointer - '0');
+				if (value > (long long) numeric_limits<int>::max () + 1)
+					return column;
+			}
+			if (negative)
+				value = -value;
+			if (value > numeric_limits<int>::max ())
+				return column;
+			row_values [column] = (int) value;
+		}
+		return pointer == row_end ? this->number_columns : this->number_columns - 1;
+	}
+};
+
+void CSVReader::read (size_t number_rows, size_t number_columns, int *values) const
+{
+	vector<const char *> rows;
+	rows.reserve (number_rows);
+	const char *end = this->data + this->size;
+	const char *pointer = this->data;
+	while (rows.size () < number_rows && pointer < end) {
+		rows.push_back (pointer);
+		const char *newline = (const char *) memchr (pointer, '\n', end - pointer);
+		pointer = newline == NULL ? end : newline + 1;
+	}
+	if (rows.size () < number_rows) {
+		cerr << "File " << this->filename << " has " << rows.size () << " rows, but " << number_rows << " rows were expected!\n";
+		exit (EXIT_FAILURE);
+	}
+	// the last row that is parsed ends at its newline, not at the end of the file
+	const char *last_row_end = number_rows == 0 ? end : (const char *) memchr (rows.back (), '\n', end - rows.back ());
+	const int number_stripes = max (1, (int) min ((size_t) cv::getNumThreads (), number_rows / MIN_STRIPE_ROWS));
+	vector<size_t> error_rows (number_stripes, number_rows);
+	vector<size_t> error_columns (number_stripes, 0);
+	cv::parallel_for_ (cv::Range (0, number_stripes), ParseStripe (rows, last_row_end == NULL ? end : last_row_end, number_columns, number_stripes, values, error_rows, error_columns));
+	for (int index_stripe = 0; index_stripe < number_stripes; index_stripe++)
+		if (error_rows [index_stripe] < number_rows) {
+			cerr << "File " << this->filename << ", row " << error_rows [index_stripe] + 1 << ", column " << error_columns [index_stripe] + 1 << ": expected " << number_columns << " integers separated by commas!\n";
+			exit (EXIT_FAILURE);
+		}
+}
@@ -0,0 +1,77 @@
+#ifndef __CSV__
+#define __CSV__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The CSVWriter class writes a CSV file through a memory buffer.
+ *
+ * Integers are formatted without stdio and without the locale.  Doubles are
+ * formatted with snprintf in the buffer.  The bytes are the same as the ones
+ * of fprintf with format "%d" for integers and "%f" for doubles, which is what
+ * the R and Python scripts that read the results expect.
+ */
+class CSVWriter
+{
+public:
+	CSVWriter (const std::string &filename);
+	~CSVWriter ();
+	void write (int value);
+	void write (double value);
+	inline void separator ()
+	{
+		this->put (',');
+	}
+	inline void end_row ()
+	{
+		this->put ('\n');
+	}
+	/**
+	 * @brief flush Write the buffer to the file, so that the rows written so
+	 * far can be read by other programs.
+	 */
+	void flush ();
+private:
+	const std::string filename;
+	FILE *file;
+	std::vector<char> buffer;
+	size_t used;
+	inline void put (char c)
+	{
+		if (this->used == this->buffer.size ())
+			this->flush ();
+		this->buffer [this->used++] = c;
+	}
+};
+
+/**
+ * @brief The CSVReader class reads a CSV file of integers.
+ *
+ * The whole file is mapped in memory.  The start of every row is found first,
+ * and then the rows are parsed in parallel in stripes, without stdio and
+ * without the locale.  Any error is reported with the row and column where it
+ * was found, and the program exits.
+ */
+class CSVReader
+{
+public:
+	CSVReader (const std::string &filename);
+	~CSVReader ();
+	/**
+	 * @brief read Parse the first rows of the file, each one with the given
+	 * number of integers separated by commas.  Any rows after them are
+	 * ignored.
+	 *
+	 * @param values Array where the values are stored row by row.
+	 */
+	void read (size_t number_rows, size_t number_columns, int *values) const;
+private:
+	const std::string filename;
+	const char *data;
+	size_t size;
+	class ParseStripe;
+};
+
+#endif
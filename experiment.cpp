@@ -1,42 +1,85 @@
 #include <string>
 #include <iostream>
 #include <fstream>
-#include <queue>
+#include <sstream>
 #include <limits>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <set>
 #include <getopt.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "experiment.hpp"
+#include "csv.hpp"
+#include "frame_watcher.hpp"
+#include "stage_graph.hpp"
 
 using namespace std;
 namespace po = boost::program_options;
 
-typedef std::vector<double> DoubleSeries;
-typedef std::vector<DoubleSeries> VectorDoubleSeries;
+void check_ROI_pair (unsigned int roi1_number, const Image &roi1_image, unsigned int roi2_number, const Image &roi2_image, ostream *log);
 
-void check_ROI_pair (unsigned int roi1_number, const Image &roi1_image, unsigned int roi2_number, const Image &roi2_image);
+void compute_histograms_frame_pass_1 (const Image &current_frame_raw, const Experiment *experiment, FramePass *pass);
 
-void compute_histograms_bee_speed_1 (const Image &current_frame, const Experiment *experiment, queue<Image> *cache, VectorHistograms *result);
-void compute_histograms_bee_speed_2 (const Image &ROI_mask, bool enough_frames, Image *bee_speed, VectorHistograms *result);
+void compute_bee_speed_1 (const Image &current_frame_HE, const Experiment *experiment, FramePass *pass);
 
-void compute_histograms_number_bees_1 (const Image &current_frame_raw, const Experiment *experiment, Image *background, VectorHistograms *result);
-void compute_histograms_number_bees_raw_1 (const Image &current_frame_raw, const Experiment *experiment, VectorHistograms *result);
-void compute_histograms_number_bees_2 (const Image &ROI_mask, Image *number_bees, VectorHistograms *result);
+static void equalise_frame (const Image &image, const unsigned char *lut, const cv::Rect &box, Image &result);
 
-static void compute_features_number_bees_bee_speed_1 (unsigned int index_frame, const Experiment *experiment, const VectorHistograms *histograms_number_bees, const VectorHistograms *histograms_bee_speed, VectorSeries *result);
-static void compute_features_number_bees_bee_speed_2 (unsigned int index_ROI, unsigned int index_frame, const RunParameters *run, const VectorHistograms *histograms_number_bees, const VectorHistograms *histograms_bee_speed, VectorSeries *result);
+static void truncate_frame_pass (FramePass *pass, unsigned int number_frames);
+
+static uint64_t frames_size (const RunParameters &run, const UserParameters &user, unsigned int first_frame, unsigned int last_frame);
+
+static vector<size_t> frame_pass_image_sizes (const UserParameters &user);
 
 static Series *read_series (const string &filename, size_t series_length);
 static void write_series (const string &filename, const Series &s);
 
-static VectorSeries *read_series (const string &filename, size_t number_series, size_t series_length);
-static void write_series (const string &filename, const VectorSeries &vs);
+static ROIFeatures *read_features (const string &filename, unsigned int number_ROIs, size_t number_frames);
+static void write_series (const string &filename, const ROIFeatures &features);
+
+template<typename T>
+static void write_series (const string &filename, const FeatureTable<T> &table);
+
+/**
+ * The total bee acceleration of a folder with the features and delta velocity
+ * it was computed from, which give the values of missing accelerations in the
+ * total bee acceleration file.
+ */
+struct TotalBeeAcceleration
+{
+	const FeatureTable<int> &acceleration;
+	const ROIFeatures &features;
+	const unsigned int delta_velocity;
+};
+static void write_series (const string &filename, const TotalBeeAcceleration &total);
+
+static void write_row (CSVWriter &writer, const Series &s, size_t index);
+static void write_row (CSVWriter &writer, const ROIFeatures &features, size_t index);
+template<typename T>
+static void write_row (CSVWriter &writer, const FeatureTable<T> &table, size_t index);
+static void write_row (CSVWriter &writer, const TotalBeeAcceleration &total, size_t index);
+
+/**
+ * Value of missing features in the features file, such as the bee speed of the
+ * first frames.
+ */
+static const int FEATURES_FILE_MISSING = -1;
 
-static void write_series (const string &filename, const VectorDoubleSeries &vs);
+static int features_file_value (const ROIFeatures &features, unsigned int column, size_t index);
 
-static bool exists (const string &filename);
+/**
+ * Inputs of each kind of result file, as given to class Manifest.
+ */
+static const unsigned int INPUTS_NUMBER_BEES = Manifest::FRAMES | Manifest::MASKS | Manifest::BACKGROUND;
+static const unsigned int INPUTS_BEE_SPEED = Manifest::FRAMES | Manifest::MASKS | Manifest::DELTA_FRAME;
+static const unsigned int INPUTS_TOTAL_NUMBER_BEES = INPUTS_NUMBER_BEES | Manifest::SAME_COLOUR_THRESHOLD;
+static const unsigned int INPUTS_FEATURES = INPUTS_NUMBER_BEES | INPUTS_BEE_SPEED | Manifest::SAME_COLOUR_THRESHOLD;
+static const unsigned int INPUTS_TOTAL_BEE_ACCELERATION = INPUTS_FEATURES | Manifest::DELTA_VELOCITY;
 
 #define PO_CHECK_ROI "check-ROIs"
 #define PO_HISTOGRAMS_FRAMES_MASKED_ORED_ROIS_NUMBER_BEES_RAW "histograms-frames-masked-ORed-ROIs-number-bees-raw"
@@ -46,10 +89,18 @@ static bool exists (const string &filename);
 #define PO_FEATURE_TOTAL_BEE_ACCELERATION "feature-total-bee-acceleration"
 #define PO_TOTAL_NUMBER_BEES_IN_ROIS_RAW "total-number-bees-in-ROIs-raw"
 #define PO_TOTAL_NUMBER_BEES_IN_ROIS_HE "total-number-bees-in-ROIs-HE"
+#define PO_COUNTS_ONLY "counts-only"
+#define PO_EXPORT_HISTOGRAMS_CSV "export-histograms-CSV"
+#define PO_COMPRESS_HISTOGRAMS "compress-histograms"
+#define PO_APPEND "append"
+#define PO_WATCH "watch"
+#define PO_EXPLAIN "explain"
+#define PO_METRICS "metrics"
 
 Experiment::Experiment (const po::variables_map &vm):
    run (vm),
    user (NULL),
+   log (&cout),
    flag_check_ROIs (vm.count (PO_CHECK_ROI) > 0),
    flag_histograms_frames_masked_ORed_ROIs_number_bees_raw (vm.count (PO_HISTOGRAMS_FRAMES_MASKED_ORED_ROIS_NUMBER_BEES_RAW) > 0),
    flag_histograms_frames_masked_ORed_ROIs_number_bees (vm.count (PO_HISTOGRAMS_FRAMES_MASKED_ORED_ROIS_NUMBER_BEES_HE) > 0),
@@ -57,7 +108,60 @@ Experiment::Experiment (const po::variables_map &vm):
    flag_feature_average_bee_speed (vm.count (PO_FEATURE_AVERAGE_BEE_SPEED ) > 0),
    flag_feature_total_bee_acceleration (vm.count (PO_FEATURE_TOTAL_BEE_ACCELERATION) > 0),
    flag_total_number_bees_in_ROIs_raw (vm.count (PO_TOTAL_NUMBER_BEES_IN_ROIS_RAW) > 0),
-   flag_total_number_bees_in_ROIs_HE (vm.count (PO_TOTAL_NUMBER_BEES_IN_ROIS_HE) > 0)
+   flag_total_number_bees_in_ROIs_HE (vm.count (PO_TOTAL_NUMBER_BEES_IN_ROIS_HE) > 0),
+   flag_counts_only (vm.count (PO_COUNTS_ONLY) > 0),
+   flag_export_histograms_csv (vm.count (PO_EXPORT_HISTOGRAMS_CSV) > 0),
+   flag_compress_histograms (vm.count (PO_COMPRESS_HISTOGRAMS) > 0),
+   flag_append (vm.count (PO_APPEND) > 0),
+   flag_watch (vm.count (PO_WATCH) > 0),
+   flag_explain (vm.count (PO_EXPLAIN) > 0),
+   metrics_filename (vm.count (PO_METRICS) > 0 ? vm [PO_METRICS].as<string> () : string ())
+{
+	if (this->flag_counts_only && !this->run.same_colour_thresholds_sweep.empty ()) {
+		cerr << "A sweep of same colour thresholds needs the histograms, and cannot be used with option --" PO_COUNTS_ONLY "!\n";
+		exit (EXIT_FAILURE);
+	}
+	if (this->flag_counts_only && !this->run.delta_frames_sweep.empty ()) {
+		cerr << "A sweep of delta frames needs the histograms, and cannot be used with option --" PO_COUNTS_ONLY "!\n";
+		exit (EXIT_FAILURE);
+	}
+	if (this->flag_watch &&
+	    (this->flag_histograms_frames_masked_ORed_ROIs_number_bees_raw ||
+	     this->flag_histograms_frames_masked_ORed_ROIs_number_bees ||
+	     !this->run.same_colour_thresholds_sweep.empty () ||
+	     !this->run.delta_frames_sweep.empty ())) {
+		cerr << "Option --" PO_WATCH " only computes features from pixel counts, and cannot be used with histogram files or sweeps!\n";
+		exit (EXIT_FAILURE);
+	}
+	if (this->flag_watch && this->flag_explain) {
+		cerr << "Option --" PO_EXPLAIN " cannot be used with option --" PO_WATCH "!\n";
+		exit (EXIT_FAILURE);
+	}
+	if (this->flag_watch && !this->metrics_filename.empty ()) {
+		cerr << "Option --" PO_METRICS " cannot be used with option --" PO_WATCH "!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+Experiment::Experiment (const Experiment &experiment, unsigned int same_colour_threshold, unsigned int delta_frame, ostream *log, bool show_progress):
+   run (experiment.run, same_colour_threshold, delta_frame, show_progress),
+   user (experiment.user),
+   log (log),
+   flag_check_ROIs (experiment.flag_check_ROIs),
+   flag_histograms_frames_masked_ORed_ROIs_number_bees_raw (experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees_raw),
+   flag_histograms_frames_masked_ORed_ROIs_number_bees (experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees),
+   flag_features_number_bees_AND_bee_speed (experiment.flag_features_number_bees_AND_bee_speed),
+   flag_feature_average_bee_speed (experiment.flag_feature_average_bee_speed),
+   flag_feature_total_bee_acceleration (experiment.flag_feature_total_bee_acceleration),
+   flag_total_number_bees_in_ROIs_raw (experiment.flag_total_number_bees_in_ROIs_raw),
+   flag_total_number_bees_in_ROIs_HE (experiment.flag_total_number_bees_in_ROIs_HE),
+   flag_counts_only (experiment.flag_counts_only),
+   flag_export_histograms_csv (experiment.flag_export_histograms_csv),
+   flag_compress_histograms (experiment.flag_compress_histograms),
+   flag_append (experiment.flag_append),
+   flag_watch (experiment.flag_watch),
+   flag_explain (experiment.flag_explain),
+   metrics_filename (experiment.metrics_filename)
 {
 }
 
@@ -71,13 +175,13 @@ po::options_description Experiment::program_options ()
 	         )
 	      (
 	         PO_HISTOGRAMS_FRAMES_MASKED_ORED_ROIS_NUMBER_BEES_RAW,
-	         "create a CSV file with histograms of images that are the result of applying a mask M to a number of bees image."
+	         "create a file with histograms of images that are the result of applying a mask M to a number of bees image."
 	         "Uses raw backgroung image and frames."
 	         "The mask M is the result of ORing all the masks of the regions of interest."
 	         )
 	      (
 	         PO_HISTOGRAMS_FRAMES_MASKED_ORED_ROIS_NUMBER_BEES_HE,
-	         "create a CSV file with histograms of images that are result of applying a mask M to a number of bee image."
+	         "create a file with histograms of images that are result of applying a mask M to a number of bee image."
 	         "Uses histogram equalization to pre-process the background image and the frames"
 	         "The mask M is the result of ORing all the masks of the regions of interest."
 	         )
@@ -105,6 +209,45 @@ po::options_description Experiment::program_options ()
 	         "create a CSV file with the total number of bees in all regions of interest "
 	         "using histogram equalization to pre-process the background image and the frames"
 	         )
+	      (
+	         PO_COUNTS_ONLY,
+	         "compute the number of bees and bee speed features and the total number of bees by counting pixels, "
+	         "without computing the histograms of number of bees and bee speed images. "
+	         "Histograms are only computed if their file is requested"
+	         )
+	      (
+	         PO_EXPORT_HISTOGRAMS_CSV,
+	         "also write the computed histograms in CSV files. "
+	         "Histograms are always written in binary files, which are the ones read by later runs"
+	         )
+	      (
+	         PO_COMPRESS_HISTOGRAMS,
+	         "compress the binary histogram files, by bit packing the differences of each bin between consecutive frames. "
+	         "Compressed files are read in the same way as uncompressed ones"
+	         )
+	      (
+	         PO_APPEND,
+	         "when frames were added to a folder since its results were computed, only process the new frames and extend the result files. "
+	         "Only works with frame files, as a video file changes as a whole"
+	         )
+	      (
+	         PO_WATCH,
+	         "watch the frames subfolder of each folder and, as each frame file arrives, compute the number of bees and bee speed features "
+	         "and the requested features and totals from pixel counts, appending a row to each result file. "
+	         "Frames already in the folders are processed first, once their size stops changing. Ends when every folder has the given number of frames"
+	         )
+	      (
+	         PO_EXPLAIN,
+	         "do not compute anything, but print for each folder the analysis stages that the requested files need, "
+	         "which files are up to date or read, which stages are computed and their estimated cost"
+	         )
+	      (
+	         PO_METRICS,
+	         po::value<string> (),
+	         "write to the given JSON file the time spent in each analysis stage and in each step of the frame pass, "
+	         "the frames per second, the bytes read and the peak resident memory of the run. "
+	         "The metrics of each folder are also written to file metrics.json in the folder"
+	         )
 	;
 	return result;
 }
@@ -118,272 +261,353 @@ void Experiment::process_data_plots_file ()
 	ifstream csv_stream (this->run.csv_filename);
 	string header;
 	std::getline (csv_stream, header);
-	while (csv_stream) {
-		string csv_row;
-		std::getline (csv_stream, csv_row);
-		this->user = UserParameters::parse (this->run, csv_row);
-		if (!this->user->use)
+	mutex scheduler_mutex;
+	condition_variable job_finished;
+	unsigned int running_jobs = 0;
+	size_t memory_in_use = 0;
+	vector<thread> jobs;
+	vector<UserParameters *> watched_users;
+	Metrics run_metrics ("");
+	string csv_row;
+	while (std::getline (csv_stream, csv_row)) {
+		if (csv_row.empty ())
 			continue;
-		cout << "Processing folder " << this->user->folder << "...\n";
-		if (this->flag_check_ROIs)
-			this->check_ROIs ();
-		VectorHistograms *histograms_total_number_bees =
-		      this->flag_total_number_bees_in_ROIs_HE ||
-		      this->flag_histograms_frames_masked_ORed_ROIs_number_bees
-		      ? this->compute_histograms_frames_masked_ORed_ROIs_number_bees (
-		           "Using histogram equalization to preprocess background image and frames.",
-		           preprocess_histogram_equalisation,
-		           this->user->histograms_frames_masked_ORed_ROIs_number_bees_histogram_equalisation_filename ()
-		           ) : NULL;
-		VectorHistograms *histograms_total_number_bees_raw =
-		      this->flag_total_number_bees_in_ROIs_raw ||
-		      this->flag_histograms_frames_masked_ORed_ROIs_number_bees_raw
-		      ? this->compute_histograms_frames_masked_ORed_ROIs_number_bees (
-		           "Using raw background image and frames.",
-		           preprocess_raw,
-		           this->user->histograms_frames_masked_ORed_ROIs_number_bees_raw_filename ()
-		           ) : NULL;
-		VectorHistograms *bee_speed =
-		      this->flag_feature_average_bee_speed ||
-		      this->flag_features_number_bees_AND_bee_speed
-		      ? this->compute_histograms_frames_masked_ROIs_bee_speed () : NULL;
-		VectorHistograms *number_bees =
-		      this->flag_feature_average_bee_speed ||
-		      this->flag_features_number_bees_AND_bee_speed
-		      ? this->compute_histograms_frames_masked_ROIs_number_bees () : NULL;
-		VectorHistograms *number_bees_raw =
-		      false
-		      ? this->compute_histograms_frames_masked_ROIs_number_bees_raw () : NULL;
-		VectorSeries *features =
-		      this->flag_features_number_bees_AND_bee_speed ||
-		      this->flag_feature_average_bee_speed ||
-		      this->flag_feature_total_bee_acceleration ||
-		      this->flag_total_number_bees_in_ROIs_HE
-		      ? this->compute_features_number_bees_bee_speed (*number_bees, *bee_speed) : NULL;
-		if (this->flag_feature_average_bee_speed)
-			this->compute_feature_average_bee_speed (*features);
-		if (this->flag_total_number_bees_in_ROIs_HE)
-			this->compute_total_number_bees_in_ORed_ROIs (
-		         "Background image and frames were subject to histogram equalization.",
-		         histograms_total_number_bees,
-		         this->user->total_number_bees_in_all_ROIs_histogram_equalisation (this->run));
-		if (this->flag_total_number_bees_in_ROIs_raw)
-			this->compute_total_number_bees_in_ORed_ROIs (
-		         "Background image and frames were used as is.",
-		         histograms_total_number_bees_raw,
-		         this->user->total_number_bees_in_all_ROIs_raw_filename (this->run)
-		         );
-		if (this->flag_feature_total_bee_acceleration)
-			this->compute_feature_total_bee_acceleration (*features);
-		delete histograms_total_number_bees;
-		delete histograms_total_number_bees_raw;
-		delete bee_speed;
-		delete number_bees;
-		delete number_bees_raw;
-		delete features;
-		delete this->user;
+		UserParameters *user = UserParameters::parse (this->run, csv_row);
+		if (!user->use) {
+			delete user;
+			continue;
+		}
+		if (this->flag_watch) {
+			watched_users.push_back (user);
+			continue;
+		}
+		if (this->run.jobs <= 1) {
+			this->user = user;
+			this->process_folder ();
+			if (user->metrics != NULL)
+				run_metrics.add_folder (*user->metrics);
+			delete this->user;
+			continue;
+		}
+		// wait for a free worker and enough memory, but always allow one folder to run
+		size_t memory = this->estimate_memory (*user);
+		{
+			unique_lock<mutex> lock (scheduler_mutex);
+			job_finished.wait (lock, [&] {
+				return running_jobs == 0 ||
+				      (running_jobs < this->run.jobs &&
+				       (this->run.memory_budget == 0 || memory_in_use + memory <= this->run.memory_budget));
+			});
+			running_jobs++;
+			memory_in_use += memory;
+		}
+		jobs.push_back (thread ([this, user, memory, &scheduler_mutex, &job_finished, &running_jobs, &memory_in_use, &run_metrics] {
+			ostringstream log;
+			Experiment job (*this);
+			job.user = user;
+			job.log = &log;
+			job.process_folder ();
+			if (user->metrics != NULL)
+				run_metrics.add_folder (*user->metrics);
+			delete user;
+			lock_guard<mutex> lock (scheduler_mutex);
+			cout << log.str () << flush;
+			running_jobs--;
+			memory_in_use -= memory;
+			job_finished.notify_all ();
+		}));
+	}
+	for (thread &job : jobs)
+		job.join ();
+	if (!this->metrics_filename.empty ()) {
+		cout << "Writing metrics to file " << this->metrics_filename << "...\n";
+		run_metrics.write (this->metrics_filename);
 	}
+	if (this->flag_watch)
+		this->watch_folders (watched_users);
+	for (UserParameters *user : watched_users)
+		delete user;
+}
+
+size_t Experiment::estimate_memory (const UserParameters &user) const
+{
+	const size_t frame_size = user.background.total () * user.background.elemSize ();
+	unsigned int max_delta_frame = this->run.delta_frame;
+	for (unsigned int delta_frame : this->run.delta_frames_sweep)
+		max_delta_frame = max (max_delta_frame, delta_frame);
+	// background, masks, and per frame range decoded frames, bee speed cache and work images
+	const size_t images =
+	      frame_size * (
+	         1 + this->run.number_ROIs +
+	         (this->run.prefetch_depth + 1 + max_delta_frame + 1 + 4) * max (this->run.frame_shards, 1u));
+	// vectors of per ROI histograms, one per delta frame for bee speed, and two vectors of ORed ROIs histograms
+	const size_t histogram_size = sizeof (Histogram) + NUMBER_COLOUR_LEVELS * sizeof (double);
+	const size_t histograms = histogram_size * this->run.number_frames * ((2 + this->run.delta_frames_sweep.size ()) * this->run.number_ROIs + 2);
+	return images + histograms;
 }
 
 void Experiment::check_ROIs () const
 {
-	cout << "  Checking masks of regions of interest.\n";
-	this->user->fold0_ROI_pairs (check_ROI_pair);
+	*this->log << "  Checking masks of regions of interest.\n";
+	this->user->fold1_ROI_pairs (check_ROI_pair, this->log);
 }
 
-void compute_histograms_number_bees_ORed_ROI_masks_1 (
-      const Image &current_frame_raw,
-      const Image *preprocessed_background, PreprocessImage func, const Image *ORed_ROI_masks,
-      VectorHistograms *result)
+uint64_t Experiment::inputs_hash (unsigned int inputs) const
 {
-	static Image number_bees;
-	static const Image *preprocessed_current_frame;
-	preprocessed_current_frame = func (&current_frame_raw);
-	cv::absdiff (*preprocessed_background, *preprocessed_current_frame, number_bees);
-	static Histogram histogram;
-#ifdef DEBUG
-	cv::imshow ("pre-processed current frame", *preprocessed_current_frame);
-	cv::imshow ("number of bees", number_bees);
-	cv::imshow ("diff", diff);
-	cv::waitKey (0);
-#endif
-	compute_histogram (number_bees, *ORed_ROI_masks, histogram);
-	result->push_back (histogram);
+	return this->user->manifest->inputs_hash (this->run, inputs, this->run.number_frames);
 }
 
-VectorHistograms *Experiment::compute_histograms_frames_masked_ORed_ROIs_number_bees (
-      const string &preprocess_treatment, PreprocessImage preprocess_func, const string &filename) const
+bool Experiment::up_to_date (const string &filename, unsigned int inputs) const
 {
-	VectorHistograms *result;
-	cout << "  Computing the histograms of number of bees images filtered with ORed ROIs mask. " << preprocess_treatment << "\n";
-	if (exists (filename)) {
-		cout << "    Reading data from file " << filename << "...\n";
-		result = read_vector_histograms (filename, this->run.number_frames);
-	}
-	else {
-		cout << "    Processing frames...\n";
-		result = new VectorHistograms ();
-		result->reserve (this->run.number_frames);
-		const Image *preprocessed_background = preprocess_func (&this->user->background);
-		Image ORed_ROI_masks;
-		typedef void (*fold1_ROIs) (const Image &, Image *);
-		fold1_ROIs func_or_ROIs = [] (const Image &ROI_mask, Image *_ORed_ROI_masks) {
-			if (_ORed_ROI_masks->size ().width == 0)
-				*_ORed_ROI_masks = ROI_mask;
-			else
-				*_ORed_ROI_masks = *_ORed_ROI_masks | ROI_mask;
-		};
-		this->user->fold1_ROIs (func_or_ROIs, &ORed_ROI_masks);
-#ifdef DEBUG
-		cv::imshow ("ORed masks", ORed_ROI_masks);
-		cv::imshow ("pre-processed background", *preprocessed_background);
-#endif
-		this->user->fold4_frames (this->run, compute_histograms_number_bees_ORed_ROI_masks_1,
-		                          preprocessed_background, preprocess_func, (const Image *) &ORed_ROI_masks, result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_vector_histograms (filename, result);
-	}
+	if (this->user->manifest->up_to_date (filename, this->inputs_hash (inputs)))
+		return true;
+	if (access (filename.c_str (), F_OK) == 0)
+		*this->log << "    File " << filename << " is not up to date.\n";
+	return false;
+}
+
+void Experiment::record (const string &filename, unsigned int inputs) const
+{
+	this->user->manifest->record (filename, this->inputs_hash (inputs), this->run.number_frames);
+}
+
+template<typename S>
+void Experiment::write_result (const string &filename, const S &series, unsigned int inputs) const
+{
+	this->user->manifest->remove (filename);
+	write_series (filename, series);
+	this->record (filename, inputs);
+}
+
+unsigned int Experiment::resume_histograms (const string &filename, unsigned int histograms_per_frame, unsigned int inputs, HistogramMatrix *result) const
+{
+	if (!this->flag_append)
+		return 0;
+	string binary_filename = binary_histograms_filename (filename);
+	unsigned int covered_frames = this->user->manifest->covered_frames (binary_filename, this->run, inputs);
+	if (covered_frames == 0)
+		return 0;
+	*this->log << "    Extending file " << binary_filename << ", which covers " << covered_frames << " frames...\n";
+	HistogramMatrix *histograms = read_vector_histograms_binary (binary_filename, covered_frames, histograms_per_frame);
+	result->append (*histograms);
+	delete histograms;
+	return covered_frames;
+}
+
+unsigned int Experiment::resume_series (const string &filename, unsigned int inputs, Series *result) const
+{
+	if (!this->flag_append)
+		return 0;
+	unsigned int covered_frames = this->user->manifest->covered_frames (filename, this->run, inputs);
+	if (covered_frames == 0)
+		return 0;
+	*this->log << "    Extending file " << filename << ", which covers " << covered_frames << " frames...\n";
+	Series *series = read_series (filename, covered_frames);
+	result->insert (result->end (), series->begin (), series->end ());
+	delete series;
+	return covered_frames;
+}
+
+unsigned int Experiment::resume_series (const string &filename, unsigned int inputs, ROIFeatures *result) const
+{
+	if (!this->flag_append)
+		return 0;
+	unsigned int covered_frames = this->user->manifest->covered_frames (filename, this->run, inputs);
+	if (covered_frames == 0)
+		return 0;
+	*this->log << "    Extending file " << filename << ", which covers " << covered_frames << " frames...\n";
+	ROIFeatures *features = read_features (filename, result->number_ROIs (), covered_frames);
+	result->append (*features);
+	delete features;
+	return covered_frames;
+}
+
+FramePass::FramePass ():
+   ORed_ROIs_number_bees_HE (NULL),
+   ORed_ROIs_number_bees_raw (NULL),
+   ROIs_number_bees (NULL),
+   ROIs_number_bees_raw (NULL),
+   ORed_ROIs_number_bees_HE_counts (NULL),
+   ORed_ROIs_number_bees_raw_counts (NULL),
+   ROIs_features_counts (NULL),
+   halo (0),
+   index_frame (1),
+   covered_frames (numeric_limits<unsigned int>::max ()),
+   step_nanoseconds (),
+   step_clock (0),
+   heap_allocations (0),
+   warm_up_frame (0),
+   warm_up_heap_allocations (0)
+{
+}
+
+HistogramMatrix *Experiment::compute_histograms_frames_masked_ORed_ROIs_number_bees (
+      const string &preprocess_treatment, const string &filename, FramePass *pass, HistogramMatrix **slot) const
+{
+	*this->log << "  Computing the histograms of number of bees images filtered with ORed ROIs mask. " << preprocess_treatment << "\n";
+	*this->log << "    Frames will be processed...\n";
+	HistogramMatrix *result = new HistogramMatrix (1);
+	result->reserve (this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_histograms (filename, 1, INPUTS_NUMBER_BEES, result));
+	*slot = result;
+	pass->filenames.push_back (HistogramsFile (filename, this->inputs_hash (INPUTS_NUMBER_BEES), result));
 	return result;
 }
 
-VectorHistograms *Experiment::compute_histograms_frames_masked_ROIs_number_bees_raw () const
+HistogramMatrix *Experiment::compute_histograms_frames_masked_ROIs_number_bees_raw (FramePass *pass) const
 {
-	VectorHistograms *result;
-	cout << "  Computing the histograms of number of bees images filtered with ROI masks - images are not treated\n";
+	*this->log << "  Computing the histograms of number of bees images filtered with ROI masks - images are not treated\n";
 	string filename = this->user->histograms_frames_masked_ROIs_number_bees_raw_filename ();
-	if (access (filename.c_str (), F_OK) == 0) {
-		cout << "    Reading data from file " << filename << "...\n";
-		result = read_vector_histograms (filename, this->run.number_frames * this->run.number_ROIs);
-	}
-	else {
-		cout << "    Processing frames...\n";
-		result = new VectorHistograms ();
-		result->reserve (this->run.number_frames * this->run.number_ROIs);
-		this->user->fold2_frames (this->run, compute_histograms_number_bees_raw_1, this, result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_vector_histograms (filename, result);
-	}
+	*this->log << "    Frames will be processed...\n";
+	HistogramMatrix *result = new HistogramMatrix (this->run.number_ROIs);
+	result->reserve (this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_histograms (filename, this->run.number_ROIs, INPUTS_NUMBER_BEES, result));
+	pass->ROIs_number_bees_raw = result;
+	pass->filenames.push_back (HistogramsFile (filename, this->inputs_hash (INPUTS_NUMBER_BEES), result));
 	return result;
 }
 
-VectorHistograms *Experiment::compute_histograms_frames_masked_ROIs_bee_speed () const
+HistogramMatrix *Experiment::compute_histograms_frames_masked_ROIs_bee_speed (FramePass *pass) const
 {
-	VectorHistograms *result;
-	cout << "  Computing the histograms of bee movement images filtered with ROI masks...\n";
+	*this->log << "  Computing the histograms of bee movement images filtered with ROI masks...\n";
 	string filename = this->user->histograms_frames_masked_ROIs_bee_speed_histogram_equalisation_filename (this->run);
-	if (access (filename.c_str (), F_OK) == 0) {
-		cout << "    Reading data from file " << filename << "...\n";
-		result = read_vector_histograms (filename, this->run.number_frames * this->run.number_ROIs);
-	}
-	else {
-		cout << "    Processing frames...\n";
-		result = new VectorHistograms ();
-		result->reserve (this->run.number_frames * this->run.number_ROIs);
-		queue<Image> cache;
-		this->user->fold3_frames (this->run, compute_histograms_bee_speed_1, this, &cache, result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_vector_histograms (filename, result);
-	}
+	*this->log << "    Frames will be processed...\n";
+	HistogramMatrix *result = new HistogramMatrix (this->run.number_ROIs);
+	result->reserve (this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_histograms (filename, this->run.number_ROIs, INPUTS_BEE_SPEED, result));
+	pass->ROIs_bee_speed.push_back (result);
+	pass->ROIs_bee_speed_delta_frames.push_back (this->run.delta_frame);
+	pass->filenames.push_back (HistogramsFile (filename, this->inputs_hash (INPUTS_BEE_SPEED), result));
 	return result;
 }
 
-VectorHistograms *Experiment::compute_histograms_frames_masked_ROIs_number_bees () const
+HistogramMatrix *Experiment::compute_histograms_frames_masked_ROIs_number_bees (FramePass *pass) const
 {
-	VectorHistograms *result;
-	cout << "  Computing the histograms of number of bees images filtered with ROI masks...\n";
+	*this->log << "  Computing the histograms of number of bees images filtered with ROI masks...\n";
 	string filename = this->user->histograms_frames_masked_ROIs_number_bees_histogram_equalisation_filename ();
-	if (access (filename.c_str (), F_OK) == 0) {
-		cout << "    Reading data from file " << filename << "...\n";
-		result = read_vector_histograms (filename, this->run.number_frames * this->run.number_ROIs);
-	}
-	else {
-		cout << "    Processing frames...\n";
-		result = new VectorHistograms ();
-		result->reserve (this->run.number_frames * this->run.number_ROIs);
-		Image background_HE;
-		cv::equalizeHist (this->user->background, background_HE);
-		this->user->fold3_frames (this->run, compute_histograms_number_bees_1, this, &background_HE, result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_vector_histograms (filename, result);
-	}
+	*this->log << "    Frames will be processed...\n";
+	HistogramMatrix *result = new HistogramMatrix (this->run.number_ROIs);
+	result->reserve (this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_histograms (filename, this->run.number_ROIs, INPUTS_NUMBER_BEES, result));
+	pass->ROIs_number_bees = result;
+	pass->filenames.push_back (HistogramsFile (filename, this->inputs_hash (INPUTS_NUMBER_BEES), result));
 	return result;
 }
 
-VectorSeries *Experiment::compute_features_number_bees_bee_speed (const VectorHistograms &histograms_number_bees, const VectorHistograms &histograms_bee_speed) const
+ROIFeatures *Experiment::count_features_number_bees_bee_speed (FramePass *pass) const
 {
-	VectorSeries *result;
-	cout << "  Computing number of bees and bee speed per ROI...\n";
+	*this->log << "  Computing number of bees and bee speed per ROI from pixel counts...\n";
 	string filename = this->user->features_pixel_count_difference_histogram_equalization_filename (this->run);
-	if (access (filename.c_str (), F_OK) == 0) {
-		cout << "    Reading data from file " << filename << "...\n";
-		result = read_series (filename, 2 * this->run.number_ROIs, this->run.number_frames);
-	}
-	else {
-		result = new VectorSeries (2 * this->run.number_ROIs);
-		this->user->fold4_frames_I (this->run, compute_features_number_bees_bee_speed_1, this, &histograms_number_bees, &histograms_bee_speed, result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_series (filename, *result);
-	}
+	*this->log << "    Frames will be processed...\n";
+	ROIFeatures *result = new ROIFeatures (this->run.number_ROIs, this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_series (filename, INPUTS_FEATURES, result));
+	pass->ROIs_features_counts = result;
 	return result;
 }
 
-void compute_average_bee_speed_12 (unsigned int index_frame, unsigned int index_ROI, const RunParameters *parameters, const VectorSeries *features_number_bees_bee_speed, VectorDoubleSeries *result)
+Series *Experiment::count_total_number_bees_in_ORed_ROIs (const string &preprocess_treatment, const string &filename, FramePass *pass, Series **slot) const
 {
-	if (index_frame > parameters->delta_frame) {
-		unsigned int index_number_bees = 2 * index_ROI;
-		unsigned int index_bee_speed = 2 * index_ROI + 1;
-		double number_bees_value = (*features_number_bees_bee_speed) [index_number_bees][index_frame] +
-		      (*features_number_bees_bee_speed) [index_number_bees][index_frame - 1 - parameters->delta_frame];
-		double bee_speed_value = (*features_number_bees_bee_speed) [index_bee_speed][index_frame];
-		double value = number_bees_value == 0 ? 0 : bee_speed_value / number_bees_value;
-		result->at (index_ROI).push_back (value);
-	}
-	else {
-		result->at (index_ROI).push_back (std::numeric_limits<double>::quiet_NaN ());
-	}
+	*this->log << "  Computing total number of bees in all ROIs. " << preprocess_treatment << "\n";
+	*this->log << "    Frames will be processed...\n";
+	Series *result = new Series ();
+	result->reserve (this->run.number_frames);
+	pass->covered_frames = min (pass->covered_frames, this->resume_series (filename, INPUTS_TOTAL_NUMBER_BEES, result));
+	*slot = result;
+	return result;
 }
 
-void Experiment::compute_feature_average_bee_speed (const VectorSeries &features_number_bees_bee_speed) const
+void Experiment::process_frames (FramePass *pass) const
 {
-	cout << "  Computing average bee speed.\n";
-	string filename = this->user->features_average_bee_speed_histogram_equalization_filename (this->run);
-	if (exists (filename)) {
-		cout << "    File already exists, nothing to do.\n";
+	*this->log << "  Processing frames...\n";
+	const PooledImageSizes pooled_sizes (frame_pass_image_sizes (*this->user));
+	if (this->run.use_frame_cache && this->user->frame_cache == NULL)
+		this->user->frame_cache = FrameCache::open (this->run, *this->user, *this->log);
+	pass->background = this->user->background (this->user->ROIs_bounding_box);
+	if (pass->ORed_ROIs_number_bees_HE != NULL || pass->ROIs_number_bees != NULL ||
+	    pass->ORed_ROIs_number_bees_HE_counts != NULL || pass->ROIs_features_counts != NULL)
+		equalise_frame (this->user->background, NULL, this->user->ROIs_bounding_box, pass->background_HE);
+#ifdef DEBUG
+	cv::imshow ("pre-processed background", pass->background_HE);
+#endif
+	unsigned int cache_depth = 0;
+	for (unsigned int delta_frame : pass->ROIs_bee_speed_delta_frames)
+		cache_depth = max (cache_depth, delta_frame + 1);
+	if (pass->ROIs_features_counts != NULL)
+		cache_depth = max (cache_depth, this->run.delta_frame + 1);
+	pass->cache.reset (cache_depth, this->user->ROIs_bounding_box.size ());
+	const unsigned int covered_frames = pass->covered_frames;
+	if (covered_frames > 0) {
+		*this->log << "    Frames 1 to " << covered_frames << " are already processed, processing frames " << covered_frames + 1 << " to " << this->run.number_frames << "...\n";
+		truncate_frame_pass (pass, covered_frames);
 	}
-	else {
-		VectorDoubleSeries result (this->run.number_ROIs);
-		this->run.fold3_frames_ROIs (compute_average_bee_speed_12, &this->run, &features_number_bees_bee_speed, &result);
-		write_series (filename, result);
+	const unsigned int number_shards = min (max (this->run.frame_shards, 1u), this->run.number_frames - covered_frames);
+	size_t steady_heap_allocations;
+	if (number_shards <= 1) {
+		const CountImageAllocations count (&pass->heap_allocations);
+		// the bee speed of the first new frame depends on the previous delta_frame + 1 frames
+		pass->halo = min (covered_frames, pass->cache.depth ());
+		pass->index_frame = covered_frames + 1 - pass->halo;
+		pass->warm_up_frame = pass->index_frame + pass->cache.depth () + 1;
+		if (this->user->metrics != NULL)
+			pass->step_clock = metrics_clock ();
+		this->user->fold2_frames (this->run, pass->index_frame, this->run.number_frames, compute_histograms_frame_pass_1, (const Experiment *) this, pass);
+		steady_heap_allocations = pass->steady_heap_allocations ();
+	}
+	else
+		steady_heap_allocations = this->process_frame_shards (pass, covered_frames + 1, number_shards);
+	*this->log << "    Heap allocations of the image pool after the first " << pass->cache.depth () + 1 << " frames: " << steady_heap_allocations << "\n";
+	const uint64_t write_start = this->user->metrics == NULL ? 0 : metrics_clock ();
+	for (const HistogramsFile &file : pass->filenames) {
+		string filename = binary_histograms_filename (file.filename);
+		*this->log << "    Writing data to file " << filename << "...\n";
+		this->user->manifest->remove (filename);
+		write_vector_histograms_binary (filename, file.histograms, this->flag_compress_histograms);
+		this->user->manifest->record (filename, file.inputs_hash, this->run.number_frames);
+		if (this->flag_export_histograms_csv) {
+			*this->log << "    Writing data to file " << file.filename << "...\n";
+			this->user->manifest->remove (file.filename);
+			write_vector_histograms (file.filename, file.histograms);
+			this->user->manifest->record (file.filename, file.inputs_hash, this->run.number_frames);
+		}
+	}
+	if (this->user->metrics != NULL) {
+		pass->step_nanoseconds [Metrics::WRITE] += metrics_clock () - write_start;
+		const unsigned int first_frame = covered_frames + 1 - min (covered_frames, pass->cache.depth ());
+		this->user->metrics->add_frame_pass (
+		         pass->step_nanoseconds, this->run.number_frames - covered_frames,
+		         frames_size (this->run, *this->user, first_frame, this->run.number_frames),
+		         steady_heap_allocations);
 	}
 }
 
-void compute_total_bee_acceleration_12 (unsigned int index_frame, unsigned int index_ROI, const RunParameters *parameters, const VectorSeries *features_number_bees_bee_speed, VectorSeries *result)
+ROIFeatures *Experiment::compute_features_number_bees_bee_speed (const CumulativeHistograms &histograms_number_bees, const CumulativeHistograms &histograms_bee_speed) const
 {
-	if (index_frame > parameters->delta_velocity) {
-		unsigned int index_bee_speed = 2 * index_ROI + 1;
-		int bee_speed_value_now = (*features_number_bees_bee_speed) [index_bee_speed][index_frame];
-		int bee_speed_value_then = (*features_number_bees_bee_speed) [index_bee_speed][index_frame - 1 - parameters->delta_velocity];
-		int value = bee_speed_value_now - bee_speed_value_then;
-		result->at (index_ROI).push_back (value);
-	}
-	else {
-		result->at (index_ROI).push_back (std::numeric_limits<int>::quiet_NaN ());
-	}
+	*this->log << "  Computing number of bees and bee speed per ROI...\n";
+	string filename = this->user->features_pixel_count_difference_histogram_equalization_filename (this->run);
+	ROIFeatures *result = new ROIFeatures (this->run.number_ROIs, this->run.number_frames);
+	compute_number_bees_bee_speed (histograms_number_bees, histograms_bee_speed, this->run.number_frames, this->run.same_colour_level, *result);
+	*this->log << "    Writing data to file " << filename << "...\n";
+	this->write_result (filename, *result, INPUTS_FEATURES);
+	return result;
 }
 
-void Experiment::compute_feature_total_bee_acceleration (const VectorSeries &features_number_bees_bee_speed) const
+void Experiment::compute_feature_average_bee_speed (const ROIFeatures &features_number_bees_bee_speed) const
 {
-	cout << "  Computing total bee acceleration.\n";
+	*this->log << "  Computing average bee speed.\n";
+	string filename = this->user->features_average_bee_speed_histogram_equalization_filename (this->run);
+	FeatureTable<double> result (this->run.number_ROIs, this->run.number_frames);
+	compute_average_bee_speed (features_number_bees_bee_speed, this->run.delta_frame, result);
+	this->write_result (filename, result, INPUTS_FEATURES);
+}
+
+void Experiment::compute_feature_total_bee_acceleration (const ROIFeatures &features_number_bees_bee_speed) const
+{
+	*this->log << "  Computing total bee acceleration.\n";
 	string filename = this->user->features_total_bee_acceleration_histogram_equalization_filename (this->run);
-	if (exists (filename)) {
-		cout << "    File already exists, nothing to do.\n";
-	}
-	else {
-		VectorSeries result (this->run.number_ROIs);
-		this->run.fold3_frames_ROIs (compute_total_bee_acceleration_12, &this->run, &features_number_bees_bee_speed, &result);
-		cout << "    Writing data to file " << filename << '\n';
-		write_series (filename, result);
-	}
+	FeatureTable<int> result (this->run.number_ROIs, this->run.number_frames);
+	compute_total_bee_acceleration (features_number_bees_bee_speed, this->run.delta_velocity, result);
+	*this->log << "    Writing data to file " << filename << '\n';
+	this->write_result (filename, TotalBeeAcceleration {result, features_number_bees_bee_speed, this->run.delta_velocity}, INPUTS_TOTAL_BEE_ACCELERATION);
 }
 
 /**
@@ -403,203 +627,1085 @@ void Experiment::compute_feature_total_bee_acceleration (const VectorSeries &fea
  * @param histograms_number_bees
  * @param result
  */
-void compute_total_number_bees_in_ORed_ROIs_12 (unsigned int index_frame, const RunParameters *run, const VectorHistograms *histograms_number_bees, Series *result)
+void compute_total_number_bees_in_ORed_ROIs_12 (unsigned int index_frame, const RunParameters *run, const CumulativeHistograms *histograms_number_bees, Series *result)
 {
-	for (unsigned int i = run->same_colour_level; i < NUMBER_COLOUR_LEVELS; i++) {
-		result->at (index_frame) += histograms_number_bees->at (index_frame).at (i);
+	result->at (index_frame) = histograms_number_bees->count_from (index_frame, run->same_colour_level);
+}
+
+void Experiment::compute_total_number_bees_in_ORed_ROIs (const string &preprocess_treatment, const CumulativeHistograms *histograms_number_bees, const string &filename) const
+{
+	*this->log << "  Computing total number of bees in all ROIs. " << preprocess_treatment << "\n";
+	*this->log << "    Using histograms of number bees images...\n";
+	Series result (this->run.number_frames, 0);
+	this->run.fold3_frames (compute_total_number_bees_in_ORed_ROIs_12, &this->run, histograms_number_bees, &result);
+	*this->log << "    Writing data to file " << filename << "...\n";
+	this->write_result (filename, result, INPUTS_TOTAL_NUMBER_BEES);
+}
+
+/**
+ * @brief The Experiment::FolderStages class declares the analysis stages of a
+ * folder in a stage graph, and holds the results the stages pass to each
+ * other.
+ *
+ * The frame pass stage computes the histograms, features and totals of the
+ * stages that register in it.  Each matrix of histograms is computed in the
+ * frame pass or read from its file, and then indexed by cumulative histograms.
+ * The number of bees and bee speed features of each pair of same colour
+ * threshold and delta frame are computed from the per ROI histograms of number
+ * of bees and of bee speed with that delta frame, and the average bee speed and
+ * the total bee acceleration are computed from those features.  The total
+ * number of bees of each same colour threshold is computed from the histograms
+ * of the ORed ROIs.  In counts only mode, the features and the totals are
+ * counted in the frame pass instead, unless a total can be computed from
+ * histograms whose file is requested.
+ */
+class Experiment::FolderStages
+{
+public:
+	StageGraph graph;
+	FolderStages (const Experiment &experiment);
+	~FolderStages ();
+private:
+	/**
+	 * @brief The Histograms struct is a matrix of histograms computed in the
+	 * frame pass or read from its file, and its index.  The index is only built
+	 * if a computed stage reads the histograms.
+	 */
+	struct Histograms
+	{
+		HistogramMatrix *histograms;
+		CumulativeHistograms *index;
+	};
+	const Experiment &experiment;
+	FramePass pass;
+	StageGraph::Stage *frame_pass;
+	Histograms ORed_ROIs_number_bees_HE;
+	Histograms ORed_ROIs_number_bees_raw;
+	Histograms ROIs_number_bees;
+	/**
+	 * @brief ROIs_bee_speed Bee speed histograms of each delta frame, starting
+	 * with the delta frame of the run parameters.
+	 */
+	std::vector<Histograms> ROIs_bee_speed;
+	/**
+	 * @brief features Number of bees and bee speed features of each delta frame
+	 * and same colour threshold, with the same colour thresholds of a delta
+	 * frame next to each other.
+	 */
+	std::vector<ROIFeatures *> features;
+	Series *total_number_bees_HE_counts;
+	Series *total_number_bees_raw_counts;
+	/**
+	 * @brief add_histograms Add the stage of a matrix of histograms, with the
+	 * given CSV file name and number of histograms per frame, computed in the
+	 * frame pass from the given inputs with the parameters of the given
+	 * experiment.  The stage is cached if its binary or CSV file is up to date.
+	 */
+	StageGraph::Stage *add_histograms (const Experiment &sweep, const std::string &description, const std::string &filename, unsigned int histograms_per_frame, unsigned int inputs, bool requested, Histograms *result);
+	/**
+	 * @brief add_total_number_bees Add the stage of the total number of bees in
+	 * all ROIs with the same colour threshold of the given experiment.
+	 *
+	 * @param counts_slot The attribute of the frame pass where the total is
+	 * counted, or NULL if it is computed from the given histograms.
+	 */
+	StageGraph::Stage *add_total_number_bees (
+	      const Experiment &sweep, const std::string &description, const std::string &preprocess_treatment, const std::string &filename, bool requested,
+	      StageGraph::Stage *histograms_stage, const Histograms *histograms, Series **counts_slot, Series **counts);
+	/**
+	 * @brief sweep_cost Return the estimated cost of a stage that reads the
+	 * given number of values per frame from the given source.
+	 */
+	std::string sweep_cost (unsigned int values_per_frame, const char *source) const;
+};
+
+Experiment::FolderStages::FolderStages (const Experiment &experiment):
+   experiment (experiment),
+   ORed_ROIs_number_bees_HE (),
+   ORed_ROIs_number_bees_raw (),
+   ROIs_number_bees (),
+   total_number_bees_HE_counts (NULL),
+   total_number_bees_raw_counts (NULL)
+{
+	const RunParameters &run = experiment.run;
+	const UserParameters *user = experiment.user;
+	vector<unsigned int> delta_frames (1, run.delta_frame);
+	delta_frames.insert (delta_frames.end (), run.delta_frames_sweep.begin (), run.delta_frames_sweep.end ());
+	vector<unsigned int> same_colour_thresholds (1, run.same_colour_threshold);
+	same_colour_thresholds.insert (same_colour_thresholds.end (), run.same_colour_thresholds_sweep.begin (), run.same_colour_thresholds_sweep.end ());
+	this->frame_pass = this->graph.add ("frame pass", "", false, false, {});
+	this->frame_pass->compute = [this] (ostream &log, bool concurrent) {
+		Experiment stage (this->experiment, this->experiment.run.same_colour_threshold, this->experiment.run.delta_frame, &log, !concurrent);
+		stage.process_frames (&this->pass);
+	};
+	this->frame_pass->cost = [this] {
+		ostringstream result;
+		result
+		      << (this->experiment.flag_append ? "at most " : "") << this->experiment.run.number_frames << " frames of "
+		      << this->experiment.user->ROIs_bounding_box.width << "x" << this->experiment.user->ROIs_bounding_box.height << " pixels";
+		return result.str ();
+	};
+	// histograms of the ORed ROIs
+	StageGraph::Stage *ORed_ROIs_number_bees_HE = this->add_histograms (
+	         experiment, "histograms of number of bees images filtered with ORed ROIs mask, histogram equalisation",
+	         user->histograms_frames_masked_ORed_ROIs_number_bees_histogram_equalisation_filename (), 1, INPUTS_NUMBER_BEES,
+	         experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees, &this->ORed_ROIs_number_bees_HE);
+	ORed_ROIs_number_bees_HE->prepare = [this] {
+		this->ORed_ROIs_number_bees_HE.histograms = this->experiment.compute_histograms_frames_masked_ORed_ROIs_number_bees (
+		         "Using histogram equalization to preprocess background image and frames.",
+		         this->experiment.user->histograms_frames_masked_ORed_ROIs_number_bees_histogram_equalisation_filename (),
+		         &this->pass, &this->pass.ORed_ROIs_number_bees_HE);
+	};
+	StageGraph::Stage *ORed_ROIs_number_bees_raw = this->add_histograms (
+	         experiment, "histograms of number of bees images filtered with ORed ROIs mask, raw images",
+	         user->histograms_frames_masked_ORed_ROIs_number_bees_raw_filename (), 1, INPUTS_NUMBER_BEES,
+	         experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees_raw, &this->ORed_ROIs_number_bees_raw);
+	ORed_ROIs_number_bees_raw->prepare = [this] {
+		this->ORed_ROIs_number_bees_raw.histograms = this->experiment.compute_histograms_frames_masked_ORed_ROIs_number_bees (
+		         "Using raw background image and frames.",
+		         this->experiment.user->histograms_frames_masked_ORed_ROIs_number_bees_raw_filename (),
+		         &this->pass, &this->pass.ORed_ROIs_number_bees_raw);
+	};
+	// histograms per ROI, which are not used in counts only mode
+	StageGraph::Stage *ROIs_number_bees = NULL;
+	vector<StageGraph::Stage *> ROIs_bee_speed;
+	if (!experiment.flag_counts_only) {
+		ROIs_number_bees = this->add_histograms (
+		         experiment, "histograms of number of bees images filtered with ROI masks",
+		         user->histograms_frames_masked_ROIs_number_bees_histogram_equalisation_filename (), run.number_ROIs, INPUTS_NUMBER_BEES,
+		         false, &this->ROIs_number_bees);
+		ROIs_number_bees->prepare = [this] {
+			this->ROIs_number_bees.histograms = this->experiment.compute_histograms_frames_masked_ROIs_number_bees (&this->pass);
+		};
+		this->ROIs_bee_speed.resize (delta_frames.size ());
+		for (size_t index_delta = 0; index_delta < delta_frames.size (); index_delta++) {
+			const unsigned int delta_frame = delta_frames [index_delta];
+			Experiment sweep (experiment, run.same_colour_threshold, delta_frame, experiment.log, true);
+			ostringstream description;
+			description << "histograms of bee movement images filtered with ROI masks, delta frame " << delta_frame;
+			StageGraph::Stage *stage = this->add_histograms (
+			         sweep, description.str (),
+			         user->histograms_frames_masked_ROIs_bee_speed_histogram_equalisation_filename (sweep.run), run.number_ROIs, INPUTS_BEE_SPEED,
+			         false, &this->ROIs_bee_speed [index_delta]);
+			stage->prepare = [this, index_delta, delta_frame] {
+				Experiment sweep (this->experiment, this->experiment.run.same_colour_threshold, delta_frame, this->experiment.log, true);
+				this->ROIs_bee_speed [index_delta].histograms = sweep.compute_histograms_frames_masked_ROIs_bee_speed (&this->pass);
+			};
+			ROIs_bee_speed.push_back (stage);
+		}
+	}
+	// features of each pair of delta frame and same colour threshold
+	this->features.resize (delta_frames.size () * same_colour_thresholds.size (), NULL);
+	for (size_t index_delta = 0; index_delta < delta_frames.size (); index_delta++) {
+		for (size_t index_threshold = 0; index_threshold < same_colour_thresholds.size (); index_threshold++) {
+			const size_t index = index_delta * same_colour_thresholds.size () + index_threshold;
+			const unsigned int delta_frame = delta_frames [index_delta];
+			const unsigned int same_colour_threshold = same_colour_thresholds [index_threshold];
+			Experiment sweep (experiment, same_colour_threshold, delta_frame, experiment.log, true);
+			ostringstream parameters;
+			parameters << ", same colour threshold " << same_colour_threshold << "%, delta frame " << delta_frame;
+			string filename = user->features_pixel_count_difference_histogram_equalization_filename (sweep.run);
+			StageGraph::Stage *features = this->graph.add (
+			         "number of bees and bee speed per ROI" + parameters.str (), filename,
+			         experiment.flag_features_number_bees_AND_bee_speed, sweep.up_to_date (filename, INPUTS_FEATURES),
+			         experiment.flag_counts_only
+			         ? vector<StageGraph::Stage *> {this->frame_pass}
+			         : vector<StageGraph::Stage *> {ROIs_number_bees, ROIs_bee_speed [index_delta]});
+			features->load = [this, index, filename] (ostream &log, bool) {
+				log << "  Reading number of bees and bee speed per ROI from file " << filename << "...\n";
+				this->features [index] = read_features (filename, this->experiment.run.number_ROIs, this->experiment.run.number_frames);
+			};
+			if (experiment.flag_counts_only) {
+				features->prepare = [this, index] {
+					this->features [index] = this->experiment.count_features_number_bees_bee_speed (&this->pass);
+				};
+				features->compute = [this, index, filename] (ostream &log, bool) {
+					Experiment stage (this->experiment, this->experiment.run.same_colour_threshold, this->experiment.run.delta_frame, &log, false);
+					log << "  Writing number of bees and bee speed per ROI to file " << filename << "...\n";
+					stage.write_result (filename, *this->features [index], INPUTS_FEATURES);
+				};
+				features->cost = [] {
+					return string ("counted in the frame pass");
+				};
+			}
+			else {
+				features->compute = [this, index, index_delta, same_colour_threshold, delta_frame] (ostream &log, bool concurrent) {
+					Experiment stage (this->experiment, same_colour_threshold, delta_frame, &log, !concurrent);
+					this->features [index] = stage.compute_features_number_bees_bee_speed (*this->ROIs_number_bees.index, *this->ROIs_bee_speed [index_delta].index);
+				};
+				features->cost = [this] {
+					return this->sweep_cost (2 * this->experiment.run.number_ROIs, "cumulative histograms");
+				};
+			}
+			StageGraph::Stage *average_bee_speed = this->graph.add (
+			         "average bee speed" + parameters.str (), user->features_average_bee_speed_histogram_equalization_filename (sweep.run),
+			         experiment.flag_feature_average_bee_speed,
+			         sweep.up_to_date (user->features_average_bee_speed_histogram_equalization_filename (sweep.run), INPUTS_FEATURES),
+			         {features});
+			average_bee_speed->compute = [this, index, same_colour_threshold, delta_frame] (ostream &log, bool concurrent) {
+				Experiment stage (this->experiment, same_colour_threshold, delta_frame, &log, !concurrent);
+				stage.compute_feature_average_bee_speed (*this->features [index]);
+			};
+			average_bee_speed->cost = [this] {
+				return this->sweep_cost (this->experiment.run.number_ROIs, "features");
+			};
+			StageGraph::Stage *total_bee_acceleration = this->graph.add (
+			         "total bee acceleration" + parameters.str (), user->features_total_bee_acceleration_histogram_equalization_filename (sweep.run),
+			         experiment.flag_feature_total_bee_acceleration,
+			         sweep.up_to_date (user->features_total_bee_acceleration_histogram_equalization_filename (sweep.run), INPUTS_TOTAL_BEE_ACCELERATION),
+			         {features});
+			total_bee_acceleration->compute = [this, index, same_colour_threshold, delta_frame] (ostream &log, bool concurrent) {
+				Experiment stage (this->experiment, same_colour_threshold, delta_frame, &log, !concurrent);
+				stage.compute_feature_total_bee_acceleration (*this->features [index]);
+			};
+			total_bee_acceleration->cost = average_bee_speed->cost;
+		}
+	}
+	// the total number of bees does not depend on delta frame
+	for (unsigned int same_colour_threshold : same_colour_thresholds) {
+		Experiment sweep (experiment, same_colour_threshold, run.delta_frame, experiment.log, true);
+		this->add_total_number_bees (
+		         sweep, "total number of bees in all ROIs, histogram equalisation",
+		         "Background image and frames were subject to histogram equalization.",
+		         user->total_number_bees_in_all_ROIs_histogram_equalisation (sweep.run), experiment.flag_total_number_bees_in_ROIs_HE,
+		         ORed_ROIs_number_bees_HE, &this->ORed_ROIs_number_bees_HE,
+		         experiment.flag_counts_only && !experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees ? &this->pass.ORed_ROIs_number_bees_HE_counts : NULL,
+		         &this->total_number_bees_HE_counts);
+		this->add_total_number_bees (
+		         sweep, "total number of bees in all ROIs, raw images",
+		         "Background image and frames were used as is.",
+		         user->total_number_bees_in_all_ROIs_raw_filename (sweep.run), experiment.flag_total_number_bees_in_ROIs_raw,
+		         ORed_ROIs_number_bees_raw, &this->ORed_ROIs_number_bees_raw,
+		         experiment.flag_counts_only && !experiment.flag_histograms_frames_masked_ORed_ROIs_number_bees_raw ? &this->pass.ORed_ROIs_number_bees_raw_counts : NULL,
+		         &this->total_number_bees_raw_counts);
+	}
+	this->graph.resolve ();
+}
+
+Experiment::FolderStages::~FolderStages ()
+{
+	for (Histograms *histograms : {&this->ORed_ROIs_number_bees_HE, &this->ORed_ROIs_number_bees_raw, &this->ROIs_number_bees}) {
+		delete histograms->index;
+		delete histograms->histograms;
+	}
+	for (Histograms &histograms : this->ROIs_bee_speed) {
+		delete histograms.index;
+		delete histograms.histograms;
 	}
+	for (ROIFeatures *features : this->features)
+		delete features;
+	delete this->total_number_bees_HE_counts;
+	delete this->total_number_bees_raw_counts;
+}
+
+StageGraph::Stage *Experiment::FolderStages::add_histograms (const Experiment &sweep, const string &description, const string &filename, unsigned int histograms_per_frame, unsigned int inputs, bool requested, Histograms *result)
+{
+	const string binary_filename = binary_histograms_filename (filename);
+	const bool binary_up_to_date = sweep.up_to_date (binary_filename, inputs);
+	const bool up_to_date = binary_up_to_date || sweep.up_to_date (filename, inputs);
+	StageGraph::Stage *stage = this->graph.add (description, binary_up_to_date || !up_to_date ? binary_filename : filename, requested, up_to_date, {this->frame_pass});
+	stage->load = [this, stage, binary_up_to_date, histograms_per_frame, result] (ostream &log, bool) {
+		log << "  Reading " << stage->description << " from file " << stage->filename << "...\n";
+		result->histograms =
+		      binary_up_to_date
+		      ? read_vector_histograms_binary (stage->filename, this->experiment.run.number_frames, histograms_per_frame)
+		      : read_vector_histograms (stage->filename, this->experiment.run.number_frames, histograms_per_frame);
+		result->index = new CumulativeHistograms (*result->histograms);
+	};
+	stage->compute = [stage, result] (ostream &, bool) {
+		if (stage->consumed)
+			result->index = new CumulativeHistograms (*result->histograms);
+	};
+	stage->cost = [] {
+		return string ("computed in the frame pass");
+	};
+	return stage;
 }
 
-void Experiment::compute_total_number_bees_in_ORed_ROIs (const string &preprocess_treatment, const VectorHistograms *histograms_number_bees, const string &filename) const
+StageGraph::Stage *Experiment::FolderStages::add_total_number_bees (
+      const Experiment &sweep, const string &description, const string &preprocess_treatment, const string &filename, bool requested,
+      StageGraph::Stage *histograms_stage, const Histograms *histograms, Series **counts_slot, Series **counts)
 {
-	cout << "  Computing total number of bees in all ROIs. " << preprocess_treatment << "\n";
-	if (exists (filename)) {
-		cout << "    File already exists, nothing to do.\n";
+	const unsigned int same_colour_threshold = sweep.run.same_colour_threshold;
+	ostringstream parameters;
+	parameters << ", same colour threshold " << same_colour_threshold << "%";
+	StageGraph::Stage *stage = this->graph.add (
+	         description + parameters.str (), filename, requested, sweep.up_to_date (filename, INPUTS_TOTAL_NUMBER_BEES),
+	         {counts_slot == NULL ? histograms_stage : this->frame_pass});
+	if (counts_slot == NULL) {
+		stage->compute = [this, preprocess_treatment, filename, histograms, same_colour_threshold] (ostream &log, bool concurrent) {
+			Experiment stage (this->experiment, same_colour_threshold, this->experiment.run.delta_frame, &log, !concurrent);
+			stage.compute_total_number_bees_in_ORed_ROIs (preprocess_treatment, histograms->index, filename);
+		};
+		stage->cost = [this] {
+			return this->sweep_cost (1, "cumulative histograms");
+		};
 	}
 	else {
-		cout << "    Using histograms of number bees images...\n";
-		Series result (this->run.number_frames, 0);
-		this->run.fold3_frames (compute_total_number_bees_in_ORed_ROIs_12, &this->run, histograms_number_bees, &result);
-		cout << "    Writing data to file " << filename << "...\n";
-		write_series (filename, result);
+		stage->prepare = [this, preprocess_treatment, filename, counts_slot, counts] {
+			*counts = this->experiment.count_total_number_bees_in_ORed_ROIs (preprocess_treatment, filename, &this->pass, counts_slot);
+		};
+		stage->compute = [this, filename, counts] (ostream &log, bool) {
+			Experiment stage (this->experiment, this->experiment.run.same_colour_threshold, this->experiment.run.delta_frame, &log, false);
+			log << "  Writing total number of bees in all ROIs to file " << filename << "...\n";
+			stage.write_result (filename, **counts, INPUTS_TOTAL_NUMBER_BEES);
+		};
+		stage->cost = [] {
+			return string ("counted in the frame pass");
+		};
+	}
+	return stage;
+}
+
+string Experiment::FolderStages::sweep_cost (unsigned int values_per_frame, const char *source) const
+{
+	ostringstream result;
+	result << this->experiment.run.number_frames * values_per_frame << " values from the " << source;
+	return result.str ();
+}
+
+void Experiment::process_folder ()
+{
+	*this->log << "Processing folder " << this->user->folder << "...\n";
+	if (this->flag_check_ROIs)
+		this->check_ROIs ();
+	if (this->user->manifest == NULL)
+		this->user->manifest = new Manifest (this->run, *this->user);
+	if (!this->metrics_filename.empty () && this->user->metrics == NULL)
+		this->user->metrics = new Metrics (this->user->folder);
+	FolderStages stages (*this);
+	if (this->flag_explain)
+		stages.graph.explain (*this->log);
+	else
+		stages.graph.run (*this->log, this->user->metrics);
+	if (this->user->metrics != NULL) {
+		*this->log << "  Writing metrics to file " << this->user->metrics_filename () << "...\n";
+		this->user->metrics->write (this->user->metrics_filename ());
 	}
 }
 
-void check_ROI_pair (unsigned int roi1_number, const Image &roi1_image, unsigned int roi2_number, const Image &roi2_image)
+/**
+ * @brief The Experiment::WatchedFolder class holds the state of a folder in
+ * watch mode.
+ *
+ * The frame pass computes the pixel counts of each frame, and its frame ring
+ * keeps the previous delta_frame + 1 equalised frames in memory.  The series
+ * hold the features of every frame processed so far, from which the average
+ * bee speed and the total bee acceleration of a new frame are computed.  The
+ * result files are open while the folder is watched.
+ */
+class Experiment::WatchedFolder
+{
+public:
+	/**
+	 * @brief directory The directory where the frame files arrive.
+	 */
+	std::string directory;
+	WatchedFolder (const Experiment &experiment, UserParameters *user);
+	~WatchedFolder ();
+	bool finished () const
+	{
+		return this->next_frame > this->experiment.run.number_frames;
+	}
+	/**
+	 * @brief arrived Record that the given file of the frame directory is
+	 * complete.
+	 */
+	void arrived (const std::string &name)
+	{
+		this->arrived_files.insert (name);
+	}
+	/**
+	 * @brief process_frames Process, in order, the frames whose file arrived,
+	 * and append their rows to the result files.  When the last frame is
+	 * processed, the result files are closed and recorded in the manifest.
+	 *
+	 * @param live Whether the frames have just arrived, in which case the time
+	 * from the file arrival to the result rows is shown.
+	 *
+	 * @return The number of frames processed.
+	 */
+	unsigned int process_frames (bool live);
+private:
+	Experiment experiment;
+	FramePass pass;
+	const PooledImageSizes pooled_sizes;
+	ROIFeatures features;
+	Series total_number_bees;
+	Series total_number_bees_raw;
+	FeatureTable<double> average_bee_speed;
+	FeatureTable<int> total_bee_acceleration;
+	CSVWriter *features_file;
+	CSVWriter *total_number_bees_file;
+	CSVWriter *total_number_bees_raw_file;
+	CSVWriter *average_bee_speed_file;
+	CSVWriter *total_bee_acceleration_file;
+	unsigned int next_frame;
+	std::set<std::string> arrived_files;
+	CSVWriter *open (const std::string &filename) const;
+	void close ();
+};
+
+/**
+ * Return the directory part of the given file name, and set name to the rest.
+ */
+static string split_filename (const string &filename, string &name)
+{
+	size_t slash = filename.rfind ('/');
+	if (slash == string::npos) {
+		name = filename;
+		return ".";
+	}
+	name = filename.substr (slash + 1);
+	return filename.substr (0, slash + 1);
+}
+
+Experiment::WatchedFolder::WatchedFolder (const Experiment &experiment, UserParameters *user):
+   experiment (experiment),
+   pooled_sizes (frame_pass_image_sizes (*user)),
+   features (experiment.run.number_ROIs, experiment.run.number_frames),
+   average_bee_speed (experiment.run.number_ROIs, experiment.run.number_frames),
+   total_bee_acceleration (experiment.run.number_ROIs, experiment.run.number_frames),
+   features_file (NULL),
+   total_number_bees_file (NULL),
+   total_number_bees_raw_file (NULL),
+   average_bee_speed_file (NULL),
+   total_bee_acceleration_file (NULL),
+   next_frame (1)
+{
+	this->experiment.user = user;
+	const RunParameters &run = this->experiment.run;
+	string name;
+	this->directory = split_filename (user->frame_filename (run, 1), name);
+	equalise_frame (user->background, NULL, user->ROIs_bounding_box, this->pass.background_HE);
+	this->pass.cache.reset (run.delta_frame + 1, user->ROIs_bounding_box.size ());
+	this->pass.ROIs_features_counts = &this->features;
+	this->features_file = this->open (user->features_pixel_count_difference_histogram_equalization_filename (run));
+	if (this->experiment.flag_total_number_bees_in_ROIs_HE) {
+		this->pass.ORed_ROIs_number_bees_HE_counts = &this->total_number_bees;
+		this->total_number_bees_file = this->open (user->total_number_bees_in_all_ROIs_histogram_equalisation (run));
+	}
+	if (this->experiment.flag_total_number_bees_in_ROIs_raw) {
+		this->pass.background = user->background (user->ROIs_bounding_box);
+		this->pass.ORed_ROIs_number_bees_raw_counts = &this->total_number_bees_raw;
+		this->total_number_bees_raw_file = this->open (user->total_number_bees_in_all_ROIs_raw_filename (run));
+	}
+	if (this->experiment.flag_feature_average_bee_speed)
+		this->average_bee_speed_file = this->open (user->features_average_bee_speed_histogram_equalization_filename (run));
+	if (this->experiment.flag_feature_total_bee_acceleration)
+		this->total_bee_acceleration_file = this->open (user->features_total_bee_acceleration_histogram_equalization_filename (run));
+}
+
+Experiment::WatchedFolder::~WatchedFolder ()
+{
+	delete this->features_file;
+	delete this->total_number_bees_file;
+	delete this->total_number_bees_raw_file;
+	delete this->average_bee_speed_file;
+	delete this->total_bee_acceleration_file;
+}
+
+/**
+ * Open a result file.  It is removed from the manifest until every frame is
+ * written to it.
+ */
+CSVWriter *Experiment::WatchedFolder::open (const string &filename) const
+{
+	this->experiment.user->manifest->remove (filename);
+	return new CSVWriter (filename);
+}
+
+unsigned int Experiment::WatchedFolder::process_frames (bool live)
+{
+	const RunParameters &run = this->experiment.run;
+	const UserParameters *user = this->experiment.user;
+	unsigned int result = 0;
+	while (!this->finished ()) {
+		string filename = user->frame_filename (run, this->next_frame);
+		string name;
+		split_filename (filename, name);
+		set<string>::iterator arrived_file = this->arrived_files.find (name);
+		if (arrived_file == this->arrived_files.end ())
+			break;
+		this->arrived_files.erase (arrived_file);
+		const size_t index_frame = this->next_frame - 1;
+		compute_histograms_frame_pass_1 (read_image (filename), &this->experiment, &this->pass);
+		write_row (*this->features_file, this->features, index_frame);
+		this->features_file->flush ();
+		if (this->total_number_bees_file != NULL) {
+			write_row (*this->total_number_bees_file, this->total_number_bees, index_frame);
+			this->total_number_bees_file->flush ();
+		}
+		if (this->total_number_bees_raw_file != NULL) {
+			write_row (*this->total_number_bees_raw_file, this->total_number_bees_raw, index_frame);
+			this->total_number_bees_raw_file->flush ();
+		}
+		if (this->average_bee_speed_file != NULL) {
+			compute_average_bee_speed (this->features, run.delta_frame, this->average_bee_speed);
+			write_row (*this->average_bee_speed_file, this->average_bee_speed, index_frame);
+			this->average_bee_speed_file->flush ();
+		}
+		if (this->total_bee_acceleration_file != NULL) {
+			compute_total_bee_acceleration (this->features, run.delta_velocity, this->total_bee_acceleration);
+			write_row (*this->total_bee_acceleration_file, TotalBeeAcceleration {this->total_bee_acceleration, this->features, run.delta_velocity}, index_frame);
+			this->total_bee_acceleration_file->flush ();
+		}
+		if (live) {
+			struct stat status;
+			struct timespec now;
+			clock_gettime (CLOCK_REALTIME, &now);
+			if (stat (filename.c_str (), &status) == 0)
+				*this->experiment.log
+				      << "    Frame " << this->next_frame << " of folder " << user->folder << ": features written "
+				      << (now.tv_sec - status.st_mtim.tv_sec) * 1000.0 + (now.tv_nsec - status.st_mtim.tv_nsec) / 1000000.0
+				      << " ms after the frame file\n";
+		}
+		this->next_frame++;
+		result++;
+	}
+	if (this->finished () && this->features_file != NULL)
+		this->close ();
+	return result;
+}
+
+/**
+ * Close the result files, and record them in the manifest, as they now cover
+ * every frame.
+ */
+void Experiment::WatchedFolder::close ()
+{
+	const RunParameters &run = this->experiment.run;
+	const UserParameters *user = this->experiment.user;
+	delete this->features_file;
+	this->features_file = NULL;
+	this->experiment.record (user->features_pixel_count_difference_histogram_equalization_filename (run), INPUTS_FEATURES);
+	if (this->total_number_bees_file != NULL) {
+		delete this->total_number_bees_file;
+		this->total_number_bees_file = NULL;
+		this->experiment.record (user->total_number_bees_in_all_ROIs_histogram_equalisation (run), INPUTS_TOTAL_NUMBER_BEES);
+	}
+	if (this->total_number_bees_raw_file != NULL) {
+		delete this->total_number_bees_raw_file;
+		this->total_number_bees_raw_file = NULL;
+		this->experiment.record (user->total_number_bees_in_all_ROIs_raw_filename (run), INPUTS_TOTAL_NUMBER_BEES);
+	}
+	if (this->average_bee_speed_file != NULL) {
+		delete this->average_bee_speed_file;
+		this->average_bee_speed_file = NULL;
+		this->experiment.record (user->features_average_bee_speed_histogram_equalization_filename (run), INPUTS_FEATURES);
+	}
+	if (this->total_bee_acceleration_file != NULL) {
+		delete this->total_bee_acceleration_file;
+		this->total_bee_acceleration_file = NULL;
+		this->experiment.record (user->features_total_bee_acceleration_histogram_equalization_filename (run), INPUTS_TOTAL_BEE_ACCELERATION);
+	}
+}
+
+/**
+ * @brief settled_file Check if a file that was in a watched folder when the
+ * program started is complete.
+ *
+ * There is no close event for a file written before the folder was watched,
+ * so a file is taken as complete when it is not empty and its size and
+ * modification time did not change for SETTLE_MILLISECONDS.  A file still
+ * being written is not complete, and is reported by the watcher when closed.
+ */
+static bool settled_file (const string &filename)
+{
+	static const long SETTLE_MILLISECONDS = 500;
+	struct stat before;
+	if (stat (filename.c_str (), &before) != 0)
+		return false;
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	const long age = (now.tv_sec - before.st_mtim.tv_sec) * 1000 + (now.tv_nsec - before.st_mtim.tv_nsec) / 1000000;
+	if (age < SETTLE_MILLISECONDS)
+		this_thread::sleep_for (chrono::milliseconds (SETTLE_MILLISECONDS - age));
+	struct stat after;
+	return
+	      stat (filename.c_str (), &after) == 0 &&
+	      after.st_size > 0 &&
+	      after.st_size == before.st_size &&
+	      after.st_mtim.tv_sec == before.st_mtim.tv_sec &&
+	      after.st_mtim.tv_nsec == before.st_mtim.tv_nsec;
+}
+
+void Experiment::watch_folders (const vector<UserParameters *> &users) const
+{
+	FrameWatcher watcher;
+	vector<WatchedFolder *> folders;
+	for (UserParameters *user : users) {
+		if (!user->video.empty ()) {
+			cerr << "Folder " << user->folder << " has a video file, but option --" PO_WATCH " needs frame files!\n";
+			exit (EXIT_FAILURE);
+		}
+		if (user->manifest == NULL)
+			user->manifest = new Manifest (this->run, *user);
+		WatchedFolder *folder = new WatchedFolder (*this, user);
+		watcher.add (folder->directory, folders.size ());
+		folders.push_back (folder);
+	}
+	// frames already in a folder are taken as complete once they settled, the others are reported by the watcher when closed
+	size_t number_finished = 0;
+	for (size_t index = 0; index < folders.size (); index++) {
+		for (unsigned int index_frame = 1; index_frame <= this->run.number_frames; index_frame++) {
+			string filename = users [index]->frame_filename (this->run, index_frame);
+			string name;
+			split_filename (filename, name);
+			if (settled_file (filename))
+				folders [index]->arrived (name);
+		}
+		*this->log << "Watching folder " << users [index]->folder << "...\n";
+		*this->log << "    Processed " << folders [index]->process_frames (false) << " frames that were already in the folder\n";
+		if (folders [index]->finished ())
+			number_finished++;
+	}
+	while (number_finished < folders.size ()) {
+		size_t index;
+		string name = watcher.wait (index);
+		WatchedFolder *folder = folders [index];
+		if (folder->finished ())
+			continue;
+		folder->arrived (name);
+		folder->process_frames (true);
+		if (folder->finished ()) {
+			*this->log << "Folder " << users [index]->folder << " has every frame.\n";
+			number_finished++;
+		}
+	}
+	for (WatchedFolder *folder : folders)
+		delete folder;
+}
+
+void check_ROI_pair (unsigned int roi1_number, const Image &roi1_image, unsigned int roi2_number, const Image &roi2_image, ostream *log)
 {
 	Image common = roi1_image & roi2_image;
-	static Histogram histogram;
+	static thread_local Histogram histogram;
 	compute_histogram (common, histogram);
 	if (histogram.at (NUMBER_COLOUR_LEVELS - 1) > 0)
-		cout
+		*log
 		      << "    ROIs " << roi1_number
 		      << " and " << roi2_number
 		      << " have " << histogram.at (NUMBER_COLOUR_LEVELS - 1) << " pixels in common\n";
 }
 
-void compute_histograms_bee_speed_1 (const Image &current_frame_raw, const Experiment *experiment, queue<Image> *cache, VectorHistograms *result)
+/**
+ * @brief equalise_frame Perform the histogram equalisation of the given image
+ * and crop it to the given rectangle.
+ *
+ * The lookup table is computed from the whole image, so the result is the
+ * same as cropping the output of cv::equalizeHist.  If the image already has a
+ * lookup table, it is used.
+ */
+static void equalise_frame (const Image &image, const unsigned char *lut, const cv::Rect &box, Image &result)
 {
-	static Image bee_speed;
-	Image current_frame_HE;
-	cv::equalizeHist (current_frame_raw, current_frame_HE);
-	bool enough_frames = cache->size () > experiment->run.delta_frame;
-	if (enough_frames) {
-		cv::Mat previous_frame = cache->front ();
-		cache->pop ();
-		cv::absdiff (previous_frame, current_frame_HE, bee_speed);
+	if (box.width == image.cols && box.height == image.rows) {
+		equalise_histogram (image, lut, result);
+		return ;
+	}
+	unsigned char image_lut [NUMBER_COLOUR_LEVELS];
+	if (lut == NULL) {
+		compute_histogram_equalisation_lut (image, image_lut);
+		lut = image_lut;
 	}
-	experiment->user->fold3_ROIs (experiment->run, compute_histograms_bee_speed_2, enough_frames, (Image*) &bee_speed, result);
-	cache->push (current_frame_HE);
+	equalise_histogram (image (box), lut, result);
+}
+
+static void truncate_histograms (HistogramMatrix *histograms, size_t number_frames)
+{
+	if (histograms != NULL)
+		histograms->resize (number_frames);
 }
 
-void compute_histograms_bee_speed_2 (const Image &ROI_mask, bool enough_frames, Image *bee_speed, VectorHistograms *result)
+static void truncate_series (Series *series, size_t size)
 {
-	static Histogram histogram;
-	if (enough_frames) {
-		compute_histogram (*bee_speed, ROI_mask, histogram);
+	if (series != NULL)
+		series->resize (size);
+}
+
+/**
+ * Keep in the vectors registered in the given frame pass the results of the
+ * given number of frames, which are the frames covered by every vector.
+ */
+static void truncate_frame_pass (FramePass *pass, unsigned int number_frames)
+{
+	truncate_histograms (pass->ORed_ROIs_number_bees_HE, number_frames);
+	truncate_histograms (pass->ORed_ROIs_number_bees_raw, number_frames);
+	for (HistogramMatrix *histograms : pass->ROIs_bee_speed)
+		truncate_histograms (histograms, number_frames);
+	truncate_histograms (pass->ROIs_number_bees, number_frames);
+	truncate_histograms (pass->ROIs_number_bees_raw, number_frames);
+	truncate_series (pass->ORed_ROIs_number_bees_HE_counts, number_frames);
+	truncate_series (pass->ORed_ROIs_number_bees_raw_counts, number_frames);
+	if (pass->ROIs_features_counts != NULL)
+		pass->ROIs_features_counts->resize (number_frames);
+}
+
+/**
+ * Return how many bytes are read to decode the given frames: the size of the
+ * frame files, or the share of those frames in the frame cache file or video
+ * file.
+ */
+static uint64_t frames_size (const RunParameters &run, const UserParameters &user, unsigned int first_frame, unsigned int last_frame)
+{
+	struct stat status;
+	if (user.frame_cache != NULL || !user.video.empty ()) {
+		string filename = user.frame_cache != NULL ? user.frame_cache_filename () : user.video_filename (run);
+		if (stat (filename.c_str (), &status) != 0)
+			return 0;
+		return (uint64_t) status.st_size / run.number_frames * (last_frame - first_frame + 1);
 	}
-	else {
-		histogram.assign (NUMBER_COLOUR_LEVELS, -1);
+	uint64_t result = 0;
+	for (unsigned int index_frame = first_frame; index_frame <= last_frame; index_frame++)
+		if (stat (user.frame_filename (run, index_frame).c_str (), &status) == 0)
+			result += status.st_size;
+	return result;
+}
+
+/**
+ * Return the sizes in bytes of the images that the frame pass of the given
+ * folder allocates for every frame: the decoded frames, the colour frames
+ * of a video before they are converted to grey, and the equalised frames
+ * cropped to the bounding box of the regions of interest.
+ */
+static vector<size_t> frame_pass_image_sizes (const UserParameters &user)
+{
+	const size_t frame_size = user.background.total ();
+	vector<size_t> result = {frame_size, (size_t) user.ROIs_bounding_box.area ()};
+	if (!user.video.empty ())
+		result.push_back (3 * frame_size);
+	return result;
+}
+
+static HistogramMatrix *shard_histograms (const HistogramMatrix *histograms)
+{
+	return histograms == NULL ? NULL : new HistogramMatrix (histograms->histograms_per_frame);
+}
+
+static void merge_shard_histograms (HistogramMatrix *histograms, HistogramMatrix *shard)
+{
+	if (histograms != NULL) {
+		histograms->append (*shard);
+		delete shard;
 	}
-	result->push_back (histogram);
 }
 
-void compute_histograms_number_bees_1 (const Image &current_frame_raw, const Experiment *experiment, Image *background_HE, VectorHistograms *result)
+static Series *shard_series (const Series *series)
 {
-	static Image number_bees;
-	static Image current_frame_HE;
-	cv::equalizeHist (current_frame_raw, current_frame_HE);
-	cv::absdiff (*background_HE, current_frame_HE, number_bees);
-	experiment->user->fold2_ROIs (experiment->run, compute_histograms_number_bees_2, &number_bees, result);
+	return series == NULL ? NULL : new Series ();
 }
 
-void compute_histograms_number_bees_raw_1 (const Image &current_frame_raw, const Experiment *experiment, VectorHistograms *result)
+static ROIFeatures *shard_series (const ROIFeatures *features)
 {
-	static Image number_bees;
-	cv::absdiff (experiment->user->background, current_frame_raw, number_bees);
-	experiment->user->fold2_ROIs (experiment->run, compute_histograms_number_bees_2, &number_bees, result);
+	return features == NULL ? NULL : new ROIFeatures (features->number_ROIs (), 0);
 }
 
-void compute_histograms_number_bees_2 (const Image &ROI_mask, Image *number_bees, VectorHistograms *result)
+static void merge_shard_series (Series *series, Series *shard)
 {
-	static Histogram histogram;
-	compute_histogram (*number_bees, ROI_mask, histogram);
-	result->push_back (histogram);
+	if (series != NULL) {
+		series->insert (series->end (), shard->begin (), shard->end ());
+		delete shard;
+	}
 }
 
-void compute_features_number_bees_bee_speed_1 (unsigned int index_frame, const Experiment *experiment, const VectorHistograms *histograms_number_bees, const VectorHistograms *histograms_bee_speed, VectorSeries *result)
+static void merge_shard_series (ROIFeatures *features, ROIFeatures *shard)
 {
-	experiment->user->fold5_ROIs_I (experiment->run, compute_features_number_bees_bee_speed_2, index_frame, &experiment->run, histograms_number_bees, histograms_bee_speed, result);
+	if (features != NULL) {
+		features->append (*shard);
+		delete shard;
+	}
 }
 
-void compute_features_number_bees_bee_speed_2 (unsigned int index_ROI, unsigned int index_frame, const RunParameters *run, const VectorHistograms *histograms_number_bees, const VectorHistograms *histograms_bee_speed, VectorSeries *result)
+size_t Experiment::process_frame_shards (FramePass *pass, unsigned int first_frame, unsigned int number_shards) const
 {
-	unsigned int index_number_bees = 2 * index_ROI;
-	unsigned int index_bee_speed = 2 * index_ROI + 1;
-	unsigned int index_histogram = index_frame * run->number_ROIs + index_ROI;
-	int number_bees_value = 0;
-	for (unsigned int i = run->same_colour_level; i < NUMBER_COLOUR_LEVELS; i++) {
-		number_bees_value += histograms_number_bees->at (index_histogram).at (i);
+	size_t result = 0;
+	const unsigned int number_frames = this->run.number_frames - first_frame + 1;
+	vector<FramePass> shards (number_shards);
+	vector<thread> threads;
+	for (unsigned int index_shard = 0; index_shard < number_shards; index_shard++) {
+		FramePass *shard = &shards [index_shard];
+		shard->ORed_ROIs_number_bees_HE = shard_histograms (pass->ORed_ROIs_number_bees_HE);
+		shard->ORed_ROIs_number_bees_raw = shard_histograms (pass->ORed_ROIs_number_bees_raw);
+		for (HistogramMatrix *histograms : pass->ROIs_bee_speed)
+			shard->ROIs_bee_speed.push_back (shard_histograms (histograms));
+		shard->ROIs_bee_speed_delta_frames = pass->ROIs_bee_speed_delta_frames;
+		shard->cache.reset (pass->cache.depth (), this->user->ROIs_bounding_box.size ());
+		shard->ROIs_number_bees = shard_histograms (pass->ROIs_number_bees);
+		shard->ROIs_number_bees_raw = shard_histograms (pass->ROIs_number_bees_raw);
+		shard->ORed_ROIs_number_bees_HE_counts = shard_series (pass->ORed_ROIs_number_bees_HE_counts);
+		shard->ORed_ROIs_number_bees_raw_counts = shard_series (pass->ORed_ROIs_number_bees_raw_counts);
+		shard->ROIs_features_counts = shard_series (pass->ROIs_features_counts);
+		shard->background = pass->background;
+		shard->background_HE = pass->background_HE;
+		unsigned int shard_first_frame = first_frame + index_shard * number_frames / number_shards;
+		unsigned int shard_last_frame = first_frame + (index_shard + 1) * number_frames / number_shards - 1;
+		// bee speed of the first frame in the range depends on the previous delta_frame + 1 frames
+		shard->halo = min (shard_first_frame - 1, pass->cache.depth ());
+		shard->index_frame = shard_first_frame - shard->halo;
+		shard->warm_up_frame = shard->index_frame + pass->cache.depth () + 1;
+		threads.push_back (thread ([this, shard, shard_last_frame] {
+			const CountImageAllocations count (&shard->heap_allocations);
+			if (this->user->metrics != NULL)
+				shard->step_clock = metrics_clock ();
+			this->user->fold2_frames (this->run, shard->index_frame, shard_last_frame, compute_histograms_frame_pass_1, (const Experiment *) this, shard);
+		}));
 	}
-	int bee_speed_value;
-	if (histograms_bee_speed->at (index_histogram).at (0) == -1)
-		bee_speed_value = -1;
-	else {
-		bee_speed_value = 0;
-		for (unsigned int i = run->same_colour_level; i < NUMBER_COLOUR_LEVELS; i++) {
-			bee_speed_value += histograms_bee_speed->at (index_histogram).at (i);
+	for (unsigned int index_shard = 0; index_shard < number_shards; index_shard++) {
+		threads [index_shard].join ();
+		FramePass *shard = &shards [index_shard];
+		merge_shard_histograms (pass->ORed_ROIs_number_bees_HE, shard->ORed_ROIs_number_bees_HE);
+		merge_shard_histograms (pass->ORed_ROIs_number_bees_raw, shard->ORed_ROIs_number_bees_raw);
+		for (size_t index_delta = 0; index_delta < pass->ROIs_bee_speed.size (); index_delta++)
+			merge_shard_histograms (pass->ROIs_bee_speed [index_delta], shard->ROIs_bee_speed [index_delta]);
+		merge_shard_histograms (pass->ROIs_number_bees, shard->ROIs_number_bees);
+		merge_shard_histograms (pass->ROIs_number_bees_raw, shard->ROIs_number_bees_raw);
+		merge_shard_series (pass->ORed_ROIs_number_bees_HE_counts, shard->ORed_ROIs_number_bees_HE_counts);
+		merge_shard_series (pass->ORed_ROIs_number_bees_raw_counts, shard->ORed_ROIs_number_bees_raw_counts);
+		merge_shard_series (pass->ROIs_features_counts, shard->ROIs_features_counts);
+		// the steps of the shards overlap, so their times add up to more than the wall time
+		for (unsigned int step = 0; step < Metrics::NUMBER_STEPS; step++)
+			pass->step_nanoseconds [step] += shard->step_nanoseconds [step];
+		result += shard->steady_heap_allocations ();
+	}
+	return result;
+}
+
+/**
+ * @brief compute_histograms_frame_pass_1 Compute the histograms of a single
+ * video frame for every analysis registered in the frame pass.
+ *
+ * The frame is subject to histogram equalisation at most once.  The lookup
+ * table, the difference to the background and the histograms of the ORed ROIs
+ * and of each ROI are computed in a single pass over the pixels, and the
+ * equalised frame is only stored when bee speed needs it.  Frames in the halo
+ * of a frame range only fill the bee speed cache.
+ */
+void compute_histograms_frame_pass_1 (const Image &current_frame_raw, const Experiment *experiment, FramePass *pass)
+{
+	const ROILabels &labels = experiment->user->ROI_labels;
+	const unsigned int number_ROIs = experiment->run.number_ROIs;
+	const unsigned char *lut =
+	      experiment->user->frame_cache == NULL ? NULL :
+	      experiment->user->frame_cache->histogram_equalisation_lut (pass->index_frame);
+	if (pass->index_frame == pass->warm_up_frame)
+		pass->warm_up_heap_allocations = pass->heap_allocations;
+	pass->index_frame++;
+	pass->lap (Metrics::DECODE);
+	const cv::Rect &box = experiment->user->ROIs_bounding_box;
+	if (pass->halo > 0) {
+		equalise_frame (current_frame_raw, lut, box, pass->cache.current ());
+		pass->cache.push ();
+		pass->halo--;
+		pass->lap (Metrics::EQUALISATION);
+		return ;
+	}
+	if (pass->ORed_ROIs_number_bees_raw != NULL || pass->ROIs_number_bees_raw != NULL) {
+		labels.compute_label_histograms (current_frame_raw (box), NULL, pass->background, pass->label_histograms, NULL);
+		if (pass->ORed_ROIs_number_bees_raw != NULL)
+			labels.ORed_ROIs_histogram (pass->label_histograms, pass->ORed_ROIs_number_bees_raw->append_frame ());
+		if (pass->ROIs_number_bees_raw != NULL)
+			labels.ROIs_histograms (pass->label_histograms, pass->ROIs_number_bees_raw->append_frame ());
+		pass->lap (Metrics::HISTOGRAMS);
+	}
+	if (pass->ORed_ROIs_number_bees_raw_counts != NULL) {
+		labels.count_differences (current_frame_raw (box), NULL, pass->background, experiment->run.same_colour_level, pass->counts, NULL);
+		pass->ORed_ROIs_number_bees_raw_counts->push_back (pass->counts [number_ROIs]);
+		pass->lap (Metrics::COUNTS);
+	}
+	const bool use_histograms_HE = pass->ORed_ROIs_number_bees_HE != NULL || pass->ROIs_number_bees != NULL;
+	const bool use_counts_HE = pass->ORed_ROIs_number_bees_HE_counts != NULL || pass->ROIs_features_counts != NULL;
+	const bool use_bee_speed = pass->cache.depth () > 0;
+	if (!use_histograms_HE && !use_counts_HE && !use_bee_speed)
+		return ;
+	unsigned char frame_lut [NUMBER_COLOUR_LEVELS];
+	if (lut == NULL) {
+		compute_histogram_equalisation_lut (current_frame_raw, frame_lut);
+		lut = frame_lut;
+		pass->lap (Metrics::EQUALISATION);
+	}
+	// the images of the frame ring are allocated when it is reset
+	Image *current_frame_HE = use_bee_speed ? &pass->cache.current () : NULL;
+	Image *equalised_frame = current_frame_HE;
+	if (use_histograms_HE) {
+		labels.compute_label_histograms (current_frame_raw (box), lut, pass->background_HE, pass->label_histograms, equalised_frame);
+		equalised_frame = NULL;
+		if (pass->ORed_ROIs_number_bees_HE != NULL)
+			labels.ORed_ROIs_histogram (pass->label_histograms, pass->ORed_ROIs_number_bees_HE->append_frame ());
+		if (pass->ROIs_number_bees != NULL)
+			labels.ROIs_histograms (pass->label_histograms, pass->ROIs_number_bees->append_frame ());
+		pass->lap (Metrics::HISTOGRAMS);
+	}
+	if (use_counts_HE) {
+		labels.count_differences (current_frame_raw (box), lut, pass->background_HE, experiment->run.same_colour_level, pass->counts, equalised_frame);
+		equalised_frame = NULL;
+		if (pass->ORed_ROIs_number_bees_HE_counts != NULL)
+			pass->ORed_ROIs_number_bees_HE_counts->push_back (pass->counts [number_ROIs]);
+		if (pass->ROIs_features_counts != NULL) {
+			const size_t index_row = pass->ROIs_features_counts->append_row ();
+			for (unsigned int index_ROI = 0; index_ROI < number_ROIs; index_ROI++)
+				pass->ROIs_features_counts->set (ROIFeatures::number_bees_column (index_ROI), index_row, pass->counts [index_ROI]);
 		}
+		pass->lap (Metrics::COUNTS);
+	}
+	if (equalised_frame != NULL) {
+		equalise_histogram (current_frame_raw (box), lut, *current_frame_HE);
+		pass->lap (Metrics::EQUALISATION);
+	}
+	if (use_bee_speed) {
+		compute_bee_speed_1 (*current_frame_HE, experiment, pass);
+		pass->lap (Metrics::BEE_SPEED);
 	}
-	result->at (index_number_bees).push_back (number_bees_value);
-	result->at (index_bee_speed).push_back (bee_speed_value);
+}
+
+/**
+ * @brief compute_bee_speed_1 Compute the bee speed histograms of each ROI for
+ * every registered delta frame D, and the bee speed counts for the delta frame
+ * of the run, from the given frame and the frame D + 1 frames before it.  If
+ * there is no such frame yet, the frame of the histograms is undefined and the
+ * bee speed counts are missing.  The given frame is the current image of the frame ring, and
+ * becomes its most recent previous frame.
+ */
+void compute_bee_speed_1 (const Image &current_frame_HE, const Experiment *experiment, FramePass *pass)
+{
+	const ROILabels &labels = experiment->user->ROI_labels;
+	const unsigned int number_ROIs = experiment->run.number_ROIs;
+	const size_t number_cached = pass->cache.size ();
+	for (size_t index_delta = 0; index_delta < pass->ROIs_bee_speed.size (); index_delta++) {
+		const unsigned int delta_frame = pass->ROIs_bee_speed_delta_frames [index_delta];
+		HistogramMatrix *result = pass->ROIs_bee_speed [index_delta];
+		if (number_cached > delta_frame) {
+			labels.compute_label_histograms (current_frame_HE, NULL, pass->cache.previous (delta_frame), pass->label_histograms, NULL);
+			labels.ROIs_histograms (pass->label_histograms, result->append_frame ());
+		}
+		else
+			result->append_undefined_frame ();
+	}
+	if (pass->ROIs_features_counts != NULL) {
+		const unsigned int delta_frame = experiment->run.delta_frame;
+		if (number_cached > delta_frame) {
+			labels.count_differences (current_frame_HE, NULL, pass->cache.previous (delta_frame), experiment->run.same_colour_level, pass->counts, NULL);
+			const size_t index_row = pass->ROIs_features_counts->number_rows () - 1;
+			for (unsigned int index_ROI = 0; index_ROI < number_ROIs; index_ROI++)
+				pass->ROIs_features_counts->set (ROIFeatures::bee_speed_column (index_ROI), index_row, pass->counts [index_ROI]);
+		}
+	}
+	pass->cache.push ();
 }
 
 Series *read_series (const string &filename, size_t series_length)
 {
 	Series *result = new Series (series_length);
-	FILE *f = fopen (filename.c_str (), "r");
-	for (unsigned int index = 0; index < series_length; index++) {
-		fscanf (f, "%d", &((*result) [index]));
-	}
-	fclose (f);
+	CSVReader (filename).read (series_length, 1, result->data ());
 	return result;
 }
 
 void write_series (const string &filename, const Series &s)
 {
-	FILE *f = fopen (filename.c_str (), "w");
-	for (int value : s) {
-		fprintf (f, "%d\n", value);
-	}
-	fclose (f);
-	chmod (filename.c_str (), S_IRUSR);
+	CSVWriter writer (filename);
+	for (size_t index = 0; index < s.size (); index++)
+		write_row (writer, s, index);
 }
 
-VectorSeries *read_series (const string &filename, size_t number_series, size_t series_length)
+ROIFeatures *read_features (const string &filename, unsigned int number_ROIs, size_t number_frames)
 {
-	VectorSeries *result = new VectorSeries (number_series);
-	FILE *f = fopen (filename.c_str (), "r");
-	for (unsigned int index = 0; index < series_length; index++) {
-		for (size_t series = 0; series < number_series; series++) {
-			int value;
-			if (series == 0) {
-				if (fscanf (f, "%d", &value) != 1) {
-					cerr << "Failed reading value #" << index * number_series + series + 1 << " from file " << filename << "!\n";
-					exit (EXIT_FAILURE);
-				}
-			}
-			else {
-				if (fscanf (f, ",%d", &value) != 1) {
-					cerr << "Failed reading value #" << index * number_series + series + 1 << " from file " << filename << "!\n";
-					exit (EXIT_FAILURE);
-				}
-			}
-			result->at (series).push_back (value);
-		}
-	}
-	fclose (f);
+	const unsigned int number_columns = 2 * number_ROIs;
+	vector<int> values (number_frames * number_columns);
+	CSVReader (filename).read (number_frames, number_columns, values.data ());
+	ROIFeatures *result = new ROIFeatures (number_ROIs, number_frames);
+	result->resize (number_frames);
+	for (unsigned int index_column = 0; index_column < number_columns; index_column++)
+		for (size_t index = 0; index < number_frames; index++)
+			if (values [index * number_columns + index_column] != FEATURES_FILE_MISSING)
+				result->set (index_column, index, values [index * number_columns + index_column]);
 	return result;
 }
 
-static void write_series (const string &filename, const VectorSeries &vs)
+static void write_series (const string &filename, const ROIFeatures &features)
 {
-	FILE *f = fopen (filename.c_str (), "w");
-	size_t number_series = vs.size ();
-	size_t series_length = vs [0].size ();
-	for (unsigned int index = 0; index < series_length; index++) {
-		for (size_t series = 0; series < number_series; series++) {
-			if (series > 0)
-				fprintf (f, ",");
-			fprintf (f, "%d", vs [series][index]);
-		}
-		fprintf (f, "\n");
-	}
-	fclose (f);
-	chmod (filename.c_str (), S_IRUSR);
+	CSVWriter writer (filename);
+	for (size_t index = 0; index < features.number_rows (); index++)
+		write_row (writer, features, index);
 }
 
-static void write_series (const string &filename, const VectorDoubleSeries &vs)
+template<typename T>
+static void write_series (const string &filename, const FeatureTable<T> &table)
 {
-	FILE *f = fopen (filename.c_str (), "w");
-	size_t number_series = vs.size ();
-	size_t series_length = vs [0].size ();
-	for (unsigned int index = 0; index < series_length; index++) {
-		for (size_t series = 0; series < number_series; series++) {
-			if (series > 0)
-				fprintf (f, ",");
-			if (!isnan (vs [series][index]))
-				fprintf (f, "%f", vs [series][index]);
-		}
-		fprintf (f, "\n");
+	CSVWriter writer (filename);
+	for (size_t index = 0; index < table.number_rows (); index++)
+		write_row (writer, table, index);
+}
+
+static void write_series (const string &filename, const TotalBeeAcceleration &total)
+{
+	CSVWriter writer (filename);
+	for (size_t index = 0; index < total.acceleration.number_rows (); index++)
+		write_row (writer, total, index);
+}
+
+static void write_row (CSVWriter &writer, const Series &s, size_t index)
+{
+	writer.write (s [index]);
+	writer.end_row ();
+}
+
+/**
+ * Write the row with the given index of the number of bees and bee speed
+ * features, with one column per feature.  Missing values are written as
+ * FEATURES_FILE_MISSING.
+ */
+static void write_row (CSVWriter &writer, const ROIFeatures &features, size_t index)
+{
+	for (unsigned int column = 0; column < features.number_columns (); column++) {
+		if (column > 0)
+			writer.separator ();
+		writer.write (features_file_value (features, column, index));
 	}
-	fclose (f);
-	chmod (filename.c_str (), S_IRUSR);
+	writer.end_row ();
 }
 
-static bool exists (const string &filename)
+/**
+ * Return the value of the given feature in the features file.
+ */
+static int features_file_value (const ROIFeatures &features, unsigned int column, size_t index)
 {
-	return
-	      (access (filename.c_str (), F_OK) == 0) &&
-	      (access (filename.c_str (), W_OK) == -1);
+	return features.valid (column, index) ? features.column (column) [index] : FEATURES_FILE_MISSING;
 }
 
+/**
+ * Write the row with the given index of a feature table, with one column per
+ * feature.  Missing values are written as empty columns.
+ */
+template<typename T>
+static void write_row (CSVWriter &writer, const FeatureTable<T> &table, size_t index)
+{
+	for (unsigned int column = 0; column < table.number_columns (); column++) {
+		if (column > 0)
+			writer.separator ();
+		if (table.valid (column, index))
+			writer.write (table.column (column) [index]);
+	}
+	writer.end_row ();
+}
+
+/**
+ * Write the row with the given index of the total bee acceleration, with one
+ * column per region of interest.  Missing accelerations are written as the
+ * first version of the program computed them, so that the file does not
+ * change: zero in the first delta_velocity + 1 frames, and otherwise the
+ * difference between the bee speeds in the features file.
+ */
+static void write_row (CSVWriter &writer, const TotalBeeAcceleration &total, size_t index)
+{
+	for (unsigned int index_ROI = 0; index_ROI < total.acceleration.number_columns (); index_ROI++) {
+		const unsigned int bee_speed = ROIFeatures::bee_speed_column (index_ROI);
+		if (index_ROI > 0)
+			writer.separator ();
+		if (total.acceleration.valid (index_ROI, index))
+			writer.write (total.acceleration.column (index_ROI) [index]);
+		else if (index <= total.delta_velocity)
+			writer.write (0);
+		else
+			writer.write (features_file_value (total.features, bee_speed, index) - features_file_value (total.features, bee_speed, index - 1 - total.delta_velocity));
+	}
+	writer.end_row ();
+}
@@ -1,22 +1,186 @@
 #ifndef EXPERIMENT_HPP
 #define EXPERIMENT_HPP
 
+#include <atomic>
 #include <vector>
 #include <boost/program_options.hpp>
 
 #include "parameters.hpp"
 #include "histogram.hpp"
+#include "feature_table.hpp"
+#include "image_pool.hpp"
 
 typedef std::vector<int> Series;
-typedef std::vector<Series> VectorSeries;
-typedef const Image * (*PreprocessImage) (const Image *);
+
+/**
+ * @brief The HistogramsFile struct is a matrix of histograms computed in a
+ * frame pass, with the CSV name of the file where it is written and the hash of
+ * the inputs it is computed from.
+ */
+struct HistogramsFile
+{
+	std::string filename;
+	uint64_t inputs_hash;
+	const HistogramMatrix *histograms;
+	HistogramsFile (const std::string &filename, uint64_t inputs_hash, const HistogramMatrix *histograms):
+	   filename (filename),
+	   inputs_hash (inputs_hash),
+	   histograms (histograms)
+	{
+	}
+};
+
+/**
+ * @brief The FramePass struct holds the state of a single pass over the video
+ * frames of a folder.
+ *
+ * Each histogram matrix that has to be computed is registered in this
+ * structure.  Each frame is read and subject to histogram equalisation only
+ * once, and the result is given to every registered analysis.  A NULL matrix
+ * means the corresponding analysis is not performed in this pass.
+ */
+struct FramePass
+{
+	HistogramMatrix *ORed_ROIs_number_bees_HE;
+	HistogramMatrix *ORed_ROIs_number_bees_raw;
+	/**
+	 * @brief ROIs_bee_speed Bee speed histograms of each delta frame in
+	 * attribute ROIs_bee_speed_delta_frames.
+	 */
+	std::vector<HistogramMatrix *> ROIs_bee_speed;
+	std::vector<unsigned int> ROIs_bee_speed_delta_frames;
+	HistogramMatrix *ROIs_number_bees;
+	HistogramMatrix *ROIs_number_bees_raw;
+	/**
+	 * @brief ORed_ROIs_number_bees_HE_counts Number of bees in the ORed ROIs
+	 * computed from pixel counts, without histograms.
+	 */
+	Series *ORed_ROIs_number_bees_HE_counts;
+	Series *ORed_ROIs_number_bees_raw_counts;
+	/**
+	 * @brief ROIs_features_counts Number of bees and bee speed per ROI computed
+	 * from pixel counts, without histograms.
+	 */
+	ROIFeatures *ROIs_features_counts;
+	/**
+	 * @brief filenames Files where the computed histograms are written after
+	 * the pass, in the same order they were registered.  The histograms are
+	 * written in the binary file with the same name as the CSV file.
+	 */
+	std::vector<HistogramsFile> filenames;
+	/**
+	 * @brief background The background image cropped to the bounding box of the
+	 * regions of interest.
+	 */
+	Image background;
+	Image background_HE;
+	/**
+	 * @brief label_histograms Buffer where the histograms of the labels of the
+	 * regions of interest are computed.
+	 */
+	std::vector<uint32_t> label_histograms;
+	/**
+	 * @brief counts Buffer where the pixel counts of the regions of interest are
+	 * computed.
+	 */
+	std::vector<uint32_t> counts;
+	/**
+	 * @brief cache Ring with the previous frames subject to histogram
+	 * equalisation used in computing bee speed.  Its depth is the largest delta
+	 * frame plus one, or zero if bee speed is not computed.
+	 */
+	FrameRing cache;
+	/**
+	 * @brief halo Number of frames at the start of a frame range that are only
+	 * used to fill the bee speed cache.
+	 */
+	unsigned int halo;
+	/**
+	 * @brief index_frame Number of the next frame to be processed.
+	 */
+	unsigned int index_frame;
+	/**
+	 * @brief covered_frames Number of frames from the first one whose results
+	 * are already in every registered vector, read from the files that are
+	 * extended in append mode.  Only the frames after them are processed.
+	 */
+	unsigned int covered_frames;
+	/**
+	 * @brief step_nanoseconds Time spent in each step of class Metrics.
+	 */
+	uint64_t step_nanoseconds [Metrics::NUMBER_STEPS];
+	/**
+	 * @brief step_clock Time when the current step started, or zero if the
+	 * steps are not measured.
+	 */
+	uint64_t step_clock;
+	/**
+	 * @brief heap_allocations Number of times the image pool requested memory
+	 * for the images of the threads of this pass.
+	 */
+	std::atomic<size_t> heap_allocations;
+	/**
+	 * @brief warm_up_frame Number of the first frame after the depth + 1 frames
+	 * that fill the frame ring and the image pool at the start of the pass.
+	 */
+	unsigned int warm_up_frame;
+	/**
+	 * @brief warm_up_heap_allocations Value of heap_allocations when frame
+	 * warm_up_frame was reached.
+	 */
+	size_t warm_up_heap_allocations;
+	FramePass ();
+	/**
+	 * @brief lap Add the time since the current step started to the given
+	 * step, and start the next step.
+	 */
+	inline void lap (Metrics::Step step)
+	{
+		if (this->step_clock != 0) {
+			uint64_t now = metrics_clock ();
+			this->step_nanoseconds [step] += now - this->step_clock;
+			this->step_clock = now;
+		}
+	}
+	/**
+	 * @brief steady_heap_allocations Return how many times the image pool
+	 * requested memory for the frames after warm_up_frame, which is zero in
+	 * the steady state of the pass.
+	 */
+	size_t steady_heap_allocations () const
+	{
+		return this->index_frame > this->warm_up_frame ? this->heap_allocations - this->warm_up_heap_allocations : 0;
+	}
+	bool empty () const
+	{
+		return
+		      this->filenames.empty () &&
+		      this->ROIs_bee_speed.empty () &&
+		      this->ORed_ROIs_number_bees_HE_counts == NULL &&
+		      this->ORed_ROIs_number_bees_raw_counts == NULL &&
+		      this->ROIs_features_counts == NULL;
+	}
+};
 
 class Experiment
 {
 public:
 	const RunParameters run;
 	UserParameters *user;
+	/**
+	 * @brief log Stream where progress messages are written.  When several
+	 * folders are processed at the same time, each folder has its own buffer
+	 * that is written to the console when the folder is done.
+	 */
+	std::ostream *log;
 	Experiment (const boost::program_options::variables_map &vm);
+	/**
+	 * @brief Experiment Copy the given experiment with another same colour
+	 * threshold and delta frame, writing progress messages to the given
+	 * stream.  This is used to run the analysis stages of a folder, including
+	 * the ones of threshold and delta frame sweeps.
+	 */
+	Experiment (const Experiment &experiment, unsigned int same_colour_threshold, unsigned int delta_frame, std::ostream *log, bool show_progress);
 	void process_data_plots_file ();
 	static boost::program_options::options_description program_options ();
 private:
@@ -28,7 +192,103 @@ private:
 	const bool flag_feature_total_bee_acceleration;
 	const bool flag_total_number_bees_in_ROIs_raw;
 	const bool flag_total_number_bees_in_ROIs_HE;
+	/**
+	 * @brief flag_counts_only Compute the features and the total number of bees
+	 * from pixel counts, and only compute the histograms that are requested.
+	 */
+	const bool flag_counts_only;
+	/**
+	 * @brief flag_export_histograms_csv Write the computed histograms in CSV
+	 * files besides the binary files.
+	 */
+	const bool flag_export_histograms_csv;
+	/**
+	 * @brief flag_compress_histograms Compress the counts of the binary
+	 * histogram files.
+	 */
+	const bool flag_compress_histograms;
+	/**
+	 * @brief flag_append Extend the result files that cover fewer frames than
+	 * the number of frames, instead of computing them from the first frame.
+	 */
+	const bool flag_append;
+	/**
+	 * @brief flag_watch Watch the frame folders and compute the features of
+	 * each frame as soon as its file arrives.
+	 */
+	const bool flag_watch;
+	/**
+	 * @brief flag_explain Print the plan of the analysis stages of each folder
+	 * instead of running them.
+	 */
+	const bool flag_explain;
+	/**
+	 * @brief metrics_filename JSON file where the metrics of the run are
+	 * written, or empty if metrics are not collected.
+	 */
+	const std::string metrics_filename;
+	class WatchedFolder;
+	class FolderStages;
+	/**
+	 * @brief process_folder Perform the checks given in the program options on
+	 * the folder in attribute user, and run the analysis stages that the
+	 * requested files need, or print their plan.
+	 */
+	void process_folder ();
+	/**
+	 * @brief watch_folders Wait for the frame files of the given folders to
+	 * arrive, and compute the number of bees and bee speed features, and the
+	 * other features and totals in the program options that are computed from
+	 * pixel counts, of each frame when its file arrives.  A row is appended to
+	 * each result file after each frame.  Returns when every folder has the
+	 * number of frames of the run.
+	 */
+	void watch_folders (const std::vector<UserParameters *> &users) const;
+	/**
+	 * @brief estimate_memory Return an estimate of the memory, in bytes, used to
+	 * process the given folder.  The estimate is based on the frame size, the
+	 * number of regions of interest and the number of frames.
+	 */
+	size_t estimate_memory (const UserParameters &user) const;
 	void check_ROIs () const;
+	/**
+	 * @brief inputs_hash Return the hash of the given inputs of class Manifest,
+	 * with the parameters of attribute run.
+	 */
+	uint64_t inputs_hash (unsigned int inputs) const;
+	/**
+	 * @brief up_to_date Return whether the manifest of the folder says the
+	 * given result file was computed from the given inputs.
+	 */
+	bool up_to_date (const std::string &filename, unsigned int inputs) const;
+	/**
+	 * @brief record Record in the manifest of the folder that the given result
+	 * file was computed from the given inputs.
+	 */
+	void record (const std::string &filename, unsigned int inputs) const;
+	/**
+	 * @brief write_result Write the given series to the given result file, and
+	 * record it in the manifest of the folder.  The file is removed from the
+	 * manifest while it is written.
+	 */
+	template<typename S>
+	void write_result (const std::string &filename, const S &series, unsigned int inputs) const;
+	/**
+	 * @brief resume_histograms In append mode, read the histograms of the
+	 * frames that the binary file of the given CSV file name already covers,
+	 * and append them to the given matrix.
+	 *
+	 * @return The number of frames read.
+	 */
+	unsigned int resume_histograms (const std::string &filename, unsigned int histograms_per_frame, unsigned int inputs, HistogramMatrix *result) const;
+	/**
+	 * @brief resume_series In append mode, read the values of the frames that
+	 * the given file already covers into the given series.
+	 *
+	 * @return The number of frames read.
+	 */
+	unsigned int resume_series (const std::string &filename, unsigned int inputs, Series *result) const;
+	unsigned int resume_series (const std::string &filename, unsigned int inputs, ROIFeatures *result) const;
 	/**
 	 * @brief compute_histograms_frames_masked_ORed_ROIs_number_bees
 	 *
@@ -40,20 +300,58 @@ private:
 	 * the result of ANDing images D and M. Finally, compute the histogram H of
 	 * image I.
 	 *
+	 * The histograms are registered in the frame pass and computed when method
+	 * process_frames is called.
+	 *
 	 * @param preprocess_treatment Name of the preprocess applied to the
 	 * background image and frames.
 	 *
-	 * @param func Function to be applied to the background image and frames.
-	 *
 	 * @param filename Filename where the histograms are saved.
 	 *
-	 * @return A vector with the above described histogram H.
+	 * @param pass The frame pass where the histograms are computed.
+	 *
+	 * @param slot The attribute of the frame pass that holds the histograms.
+	 *
+	 * @return A matrix with the above described histogram H of each frame.
+	 */
+	HistogramMatrix *compute_histograms_frames_masked_ORed_ROIs_number_bees (const std::string &preprocess_treatment, const std::string &filename, FramePass *pass, HistogramMatrix **slot) const;
+	HistogramMatrix *compute_histograms_frames_masked_ROIs_bee_speed (FramePass *pass) const;
+	HistogramMatrix *compute_histograms_frames_masked_ROIs_number_bees (FramePass *pass) const;
+	HistogramMatrix *compute_histograms_frames_masked_ROIs_number_bees_raw (FramePass *pass) const;
+	/**
+	 * @brief process_frames Read every video frame once and compute all the
+	 * histograms registered in the given frame pass.  Afterwards the histograms
+	 * are written to their files.  Frames already covered by every registered
+	 * vector are skipped.
+	 *
+	 * @param pass The frame pass with the histograms to compute.
+	 */
+	void process_frames (FramePass *pass) const;
+	/**
+	 * @brief process_frame_shards Split the video frames from the given one in
+	 * contiguous ranges and compute the histograms of each range in its own
+	 * thread.
+	 *
+	 * Each range starts with a halo of delta_frame + 1 frames that precede it,
+	 * so that its bee speed histograms are the same as the ones computed in a
+	 * single pass.  The histograms of the ranges are merged in frame order.
+	 *
+	 * @return The sum of the heap allocations of the image pool after the
+	 * first frames of each range.
+	 */
+	size_t process_frame_shards (FramePass *pass, unsigned int first_frame, unsigned int number_shards) const;
+	ROIFeatures *compute_features_number_bees_bee_speed (const CumulativeHistograms &histograms_number_bees, const CumulativeHistograms &histograms_bee_speed) const;
+	/**
+	 * @brief count_features_number_bees_bee_speed Register the number of bees
+	 * and bee speed per ROI in the frame pass, where they are computed by
+	 * counting the pixels whose difference is at least the same colour level.
+	 */
+	ROIFeatures *count_features_number_bees_bee_speed (FramePass *pass) const;
+	/**
+	 * @brief count_total_number_bees_in_ORed_ROIs Register in the frame pass the
+	 * total number of bees in all ROIs, computed from pixel counts.
 	 */
-	VectorHistograms *compute_histograms_frames_masked_ORed_ROIs_number_bees (const std::string &preprocess_treatment, PreprocessImage func, const std::string &filename) const;
-	VectorHistograms *compute_histograms_frames_masked_ROIs_bee_speed () const;
-	VectorHistograms *compute_histograms_frames_masked_ROIs_number_bees () const;
-	VectorHistograms *compute_histograms_frames_masked_ROIs_number_bees_raw () const;
-	VectorSeries *compute_features_number_bees_bee_speed (const VectorHistograms &histograms_number_bees, const VectorHistograms &histograms_bee_speed) const;
+	Series *count_total_number_bees_in_ORed_ROIs (const std::string &preprocess_treatment, const std::string &filename, FramePass *pass, Series **slot) const;
 	/**
 	 * @brief compute_average_bee_speed Compute the average bee speed for each
 	 * region of interest. This is based on the number of bees and bee speed as
@@ -61,7 +359,7 @@ private:
 	 *
 	 * @param features_number_bees_bee_speed
 	 */
-	void compute_feature_average_bee_speed (const VectorSeries &features_number_bees_bee_speed) const;
+	void compute_feature_average_bee_speed (const ROIFeatures &features_number_bees_bee_speed) const;
 	/**
 	 * @brief compute_total_number_bees_in_ORed_ROIs Computes the number of bees in
 	 * all region of interest per video frame. This method uses the histograms of
@@ -82,7 +380,7 @@ private:
 	 *
 	 * @param filename The filename where the data is stored
 	 */
-	void compute_total_number_bees_in_ORed_ROIs (const std::string &preprocess_treatment, const VectorHistograms *histograms_number_bees, const std::string &filename) const;
+	void compute_total_number_bees_in_ORed_ROIs (const std::string &preprocess_treatment, const CumulativeHistograms *histograms_number_bees, const std::string &filename) const;
 	/**
 	 * @brief compute_total_bee_aceleration Calculate the acceleration for each
 	 * region of interest. This is based on total bee movement and the difference
@@ -90,7 +388,7 @@ private:
 	 *
 	 * @param features_number_bees_bee_speed
 	 */
-	void compute_feature_total_bee_acceleration (const VectorSeries &features_number_bees_bee_speed) const;
+	void compute_feature_total_bee_acceleration (const ROIFeatures &features_number_bees_bee_speed) const;
 };
 
 #endif // EXPERIMENT_HPP
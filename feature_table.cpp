@@ -0,0 +1,156 @@
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "feature_table.hpp"
+
+using namespace std;
+
+static void and_validity (const unsigned char *a, const unsigned char *b, size_t size, unsigned char *result);
+static void average_bee_speed_reference (const int *number_bees_now, const int *number_bees_then, const int *bee_speed, size_t size, double *result);
+static void average_bee_speed_kernel (const int *number_bees_now, const int *number_bees_then, const int *bee_speed, size_t size, double *result);
+static void difference_reference (const int *now, const int *then, size_t size, int *result);
+static void difference_kernel (const int *now, const int *then, size_t size, int *result);
+
+/**
+ * The counts of a region of interest are one value every number_ROIs
+ * suffix sums, so reading them is a gather that stays scalar.  The undefined
+ * flags of the bee speed histograms are turned into a mask once per frame,
+ * and the loop over the frames has no branch.
+ */
+void compute_number_bees_bee_speed (const CumulativeHistograms &histograms_number_bees, const CumulativeHistograms &histograms_bee_speed, unsigned int number_frames, unsigned int level, ROIFeatures &result)
+{
+	const unsigned int number_ROIs = result.number_ROIs ();
+	result.resize (number_frames);
+	vector<unsigned char> defined (number_frames);
+	for (size_t index_frame = 0; index_frame < number_frames; index_frame++)
+		defined [index_frame] = number_ROIs == 0 || !histograms_bee_speed.undefined (index_frame * number_ROIs);
+	for (unsigned int index_ROI = 0; index_ROI < number_ROIs; index_ROI++) {
+		int *number_bees = result.column (ROIFeatures::number_bees_column (index_ROI));
+		int *bee_speed = result.column (ROIFeatures::bee_speed_column (index_ROI));
+		for (size_t index_frame = 0, index_histogram = index_ROI; index_frame < number_frames; index_frame++, index_histogram += number_ROIs) {
+			number_bees [index_frame] = histograms_number_bees.count_from (index_histogram, level);
+			bee_speed [index_frame] = histograms_bee_speed.count_from (index_histogram, level) & -(uint32_t) defined [index_frame];
+		}
+		fill (result.validity (ROIFeatures::number_bees_column (index_ROI)), result.validity (ROIFeatures::number_bees_column (index_ROI)) + number_frames, 1);
+		copy (defined.begin (), defined.end (), result.validity (ROIFeatures::bee_speed_column (index_ROI)));
+	}
+}
+
+void compute_average_bee_speed (const ROIFeatures &features, unsigned int delta_frame, FeatureTable<double> &result)
+{
+	const size_t first_frame = max (result.number_rows (), (size_t) delta_frame + 1);
+	const size_t number_frames = features.number_rows ();
+	result.resize (number_frames);
+	if (first_frame >= number_frames)
+		return ;
+	const size_t size = number_frames - first_frame;
+	const size_t then = first_frame - 1 - delta_frame;
+	for (unsigned int index_ROI = 0; index_ROI < features.number_ROIs (); index_ROI++) {
+		const unsigned int number_bees = ROIFeatures::number_bees_column (index_ROI);
+		const unsigned int bee_speed = ROIFeatures::bee_speed_column (index_ROI);
+		average_bee_speed_kernel (features.column (number_bees) + first_frame, features.column (number_bees) + then, features.column (bee_speed) + first_frame, size, result.column (index_ROI) + first_frame);
+		unsigned char *valid = result.validity (index_ROI) + first_frame;
+		and_validity (features.validity (number_bees) + first_frame, features.validity (number_bees) + then, size, valid);
+		and_validity (valid, features.validity (bee_speed) + first_frame, size, valid);
+	}
+}
+
+void compute_total_bee_acceleration (const ROIFeatures &features, unsigned int delta_velocity, FeatureTable<int> &result)
+{
+	const size_t first_frame = max (result.number_rows (), (size_t) delta_velocity + 1);
+	const size_t number_frames = features.number_rows ();
+	result.resize (number_frames);
+	if (first_frame >= number_frames)
+		return ;
+	const size_t size = number_frames - first_frame;
+	const size_t then = first_frame - 1 - delta_velocity;
+	for (unsigned int index_ROI = 0; index_ROI < features.number_ROIs (); index_ROI++) {
+		const unsigned int bee_speed = ROIFeatures::bee_speed_column (index_ROI);
+		difference_kernel (features.column (bee_speed) + first_frame, features.column (bee_speed) + then, size, result.column (index_ROI) + first_frame);
+		and_validity (features.validity (bee_speed) + first_frame, features.validity (bee_speed) + then, size, result.validity (index_ROI) + first_frame);
+	}
+}
+
+/**
+ * AND the validity bytes of two columns, sixteen at a time.  The result may be
+ * one of the inputs.
+ */
+static void and_validity (const unsigned char *a, const unsigned char *b, size_t size, unsigned char *result)
+{
+	size_t index = 0;
+#ifdef __SSE2__
+	for (; index + 16 <= size; index += 16)
+		_mm_storeu_si128 ((__m128i *) (result + index), _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (a + index)), _mm_loadu_si128 ((const __m128i *) (b + index))));
+#endif
+	for (; index < size; index++)
+		result [index] = a [index] & b [index];
+}
+
+/**
+ * Reference implementation of the average bee speed kernel.  The average is
+ * zero when there are no bees in both frames.
+ */
+static void average_bee_speed_reference (const int *number_bees_now, const int *number_bees_then, const int *bee_speed, size_t size, double *result)
+{
+	for (size_t index = 0; index < size; index++) {
+		const double sum = number_bees_now [index] + number_bees_then [index];
+		result [index] = sum == 0 ? 0 : bee_speed [index] / sum;
+	}
+}
+
+#ifdef __SSE2__
+/**
+ * Vectorised average bee speed kernel.  Two frames are divided at a time, and
+ * the quotients of frames without bees are cleared with a comparison mask, so
+ * the results are equal bit for bit to the reference implementation, which
+ * handles the remaining frame.
+ */
+static void average_bee_speed_kernel (const int *number_bees_now, const int *number_bees_then, const int *bee_speed, size_t size, double *result)
+{
+	size_t index = 0;
+	for (; index + 2 <= size; index += 2) {
+		const __m128i sum = _mm_add_epi32 (
+		         _mm_loadl_epi64 ((const __m128i *) (number_bees_now + index)),
+		         _mm_loadl_epi64 ((const __m128i *) (number_bees_then + index)));
+		const __m128d divisor = _mm_cvtepi32_pd (sum);
+		const __m128d quotient = _mm_div_pd (_mm_cvtepi32_pd (_mm_loadl_epi64 ((const __m128i *) (bee_speed + index))), divisor);
+		_mm_storeu_pd (result + index, _mm_andnot_pd (_mm_cmpeq_pd (divisor, _mm_setzero_pd ()), quotient));
+	}
+	average_bee_speed_reference (number_bees_now + index, number_bees_then + index, bee_speed + index, size - index, result + index);
+}
+#else
+static void average_bee_speed_kernel (const int *number_bees_now, const int *number_bees_then, const int *bee_speed, size_t size, double *result)
+{
+	average_bee_speed_reference (number_bees_now, number_bees_then, bee_speed, size, result);
+}
+#endif
+
+/**
+ * Reference implementation of the difference kernel.
+ */
+static void difference_reference (const int *now, const int *then, size_t size, int *result)
+{
+	for (size_t index = 0; index < size; index++)
+		result [index] = now [index] - then [index];
+}
+
+#ifdef __SSE2__
+/**
+ * Vectorised difference kernel, four frames at a time.  The remaining frames
+ * are handled by the reference implementation.
+ */
+static void difference_kernel (const int *now, const int *then, size_t size, int *result)
+{
+	size_t index = 0;
+	for (; index + 4 <= size; index += 4)
+		_mm_storeu_si128 ((__m128i *) (result + index), _mm_sub_epi32 (_mm_loadu_si128 ((const __m128i *) (now + index)), _mm_loadu_si128 ((const __m128i *) (then + index))));
+	difference_reference (now + index, then + index, size - index, result + index);
+}
+#else
+static void difference_kernel (const int *now, const int *then, size_t size, int *result)
+{
+	difference_reference (now, then, size, result);
+}
+#endif
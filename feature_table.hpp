@@ -0,0 +1,181 @@
+#ifndef __FEATURE_TABLE__
+#define __FEATURE_TABLE__
+
+#include <algorithm>
+#include <vector>
+
+#include "histogram.hpp"
+
+/**
+ * @brief The FeatureTable class holds time series of a folder as columns with
+ * one row per frame, such as a feature of each region of interest.
+ *
+ * The values of each column are contiguous, and the columns are allocated
+ * together for the expected number of frames, so computing a feature over
+ * every frame is a loop over arrays.  Each value has a validity byte, which
+ * is zero for missing values, such as the bee speed of the first frames of a
+ * video.  Rows appended after the expected number of frames move the columns
+ * to a buffer twice as large.
+ */
+template<typename T>
+class FeatureTable
+{
+public:
+	FeatureTable (unsigned int number_columns, size_t capacity):
+	   columns (number_columns),
+	   rows (0),
+	   capacity (capacity),
+	   values ((size_t) number_columns * capacity),
+	   masks ((size_t) number_columns * capacity, 0)
+	{
+	}
+	inline unsigned int number_columns () const
+	{
+		return this->columns;
+	}
+	inline size_t number_rows () const
+	{
+		return this->rows;
+	}
+	inline T *column (unsigned int index_column)
+	{
+		return this->values.data () + index_column * this->capacity;
+	}
+	inline const T *column (unsigned int index_column) const
+	{
+		return this->values.data () + index_column * this->capacity;
+	}
+	/**
+	 * @brief validity Return the validity bytes of the given column, which are
+	 * one for the rows that have a value and zero otherwise.
+	 */
+	inline unsigned char *validity (unsigned int index_column)
+	{
+		return this->masks.data () + index_column * this->capacity;
+	}
+	inline const unsigned char *validity (unsigned int index_column) const
+	{
+		return this->masks.data () + index_column * this->capacity;
+	}
+	inline bool valid (unsigned int index_column, size_t index_row) const
+	{
+		return this->validity (index_column) [index_row] != 0;
+	}
+	inline void set (unsigned int index_column, size_t index_row, T value)
+	{
+		this->column (index_column) [index_row] = value;
+		this->validity (index_column) [index_row] = 1;
+	}
+	/**
+	 * @brief append_row Append a row whose values are missing, and return its
+	 * index.
+	 */
+	inline size_t append_row ()
+	{
+		this->resize (this->rows + 1);
+		return this->rows - 1;
+	}
+	/**
+	 * @brief resize Keep the given number of rows, appending rows whose values
+	 * are missing if there are fewer.
+	 */
+	void resize (size_t number_rows)
+	{
+		if (number_rows > this->capacity)
+			this->reserve (std::max (number_rows, 2 * this->capacity));
+		if (number_rows > this->rows)
+			for (unsigned int index_column = 0; index_column < this->columns; index_column++) {
+				std::fill (this->column (index_column) + this->rows, this->column (index_column) + number_rows, T ());
+				std::fill (this->validity (index_column) + this->rows, this->validity (index_column) + number_rows, 0);
+			}
+		this->rows = number_rows;
+	}
+	/**
+	 * @brief append Append the rows of the given table, which must have the
+	 * same number of columns.
+	 */
+	void append (const FeatureTable &other)
+	{
+		const size_t first_row = this->rows;
+		this->resize (this->rows + other.rows);
+		for (unsigned int index_column = 0; index_column < this->columns; index_column++) {
+			std::copy (other.column (index_column), other.column (index_column) + other.rows, this->column (index_column) + first_row);
+			std::copy (other.validity (index_column), other.validity (index_column) + other.rows, this->validity (index_column) + first_row);
+		}
+	}
+private:
+	const unsigned int columns;
+	size_t rows;
+	size_t capacity;
+	std::vector<T> values;
+	std::vector<unsigned char> masks;
+	void reserve (size_t capacity)
+	{
+		std::vector<T> values ((size_t) this->columns * capacity);
+		std::vector<unsigned char> masks ((size_t) this->columns * capacity, 0);
+		for (unsigned int index_column = 0; index_column < this->columns; index_column++) {
+			std::copy (this->column (index_column), this->column (index_column) + this->rows, values.data () + index_column * capacity);
+			std::copy (this->validity (index_column), this->validity (index_column) + this->rows, masks.data () + index_column * capacity);
+		}
+		this->values.swap (values);
+		this->masks.swap (masks);
+		this->capacity = capacity;
+	}
+};
+
+/**
+ * @brief The ROIFeatures class is the table of the number of bees and of the
+ * bee speed of each region of interest.  Column 2 i holds the number of bees
+ * and column 2 i + 1 the bee speed of region of interest i, which is the
+ * column order of the features file.
+ */
+class ROIFeatures:
+      public FeatureTable<int>
+{
+public:
+	ROIFeatures (unsigned int number_ROIs, size_t capacity):
+	   FeatureTable<int> (2 * number_ROIs, capacity)
+	{
+	}
+	inline unsigned int number_ROIs () const
+	{
+		return this->number_columns () / 2;
+	}
+	static inline unsigned int number_bees_column (unsigned int index_ROI)
+	{
+		return 2 * index_ROI;
+	}
+	static inline unsigned int bee_speed_column (unsigned int index_ROI)
+	{
+		return 2 * index_ROI + 1;
+	}
+};
+
+/**
+ * @brief compute_number_bees_bee_speed Fill the given table with the number of
+ * bees and the bee speed of each region of interest in each frame, which are
+ * the number of pixels with a colour equal to or higher than the given level
+ * in the histograms of each region of interest.  The bee speed of undefined
+ * bee speed histograms is missing.
+ */
+void compute_number_bees_bee_speed (const CumulativeHistograms &histograms_number_bees, const CumulativeHistograms &histograms_bee_speed, unsigned int number_frames, unsigned int level, ROIFeatures &result);
+
+/**
+ * @brief compute_average_bee_speed Compute the average bee speed of each region
+ * of interest in the frames of the given features that the given table does
+ * not have yet.  The average bee speed of a frame is its bee speed divided by
+ * the sum of its number of bees and of the number of bees delta_frame + 1
+ * frames before, and is missing if any of those values is.
+ */
+void compute_average_bee_speed (const ROIFeatures &features, unsigned int delta_frame, FeatureTable<double> &result);
+
+/**
+ * @brief compute_total_bee_acceleration Compute the total bee acceleration of
+ * each region of interest in the frames of the given features that the given
+ * table does not have yet.  The total bee acceleration of a frame is its bee
+ * speed minus the bee speed delta_velocity + 1 frames before, and is missing
+ * if either bee speed is.
+ */
+void compute_total_bee_acceleration (const ROIFeatures &features, unsigned int delta_velocity, FeatureTable<int> &result);
+
+#endif
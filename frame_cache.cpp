@@ -0,0 +1,162 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "frame_cache.hpp"
+#include "manifest.hpp"
+#include "parameters.hpp"
+
+using namespace std;
+
+static const char FRAME_CACHE_MAGIC [8] = {'A', 'B', 'V', 'P', 'F', 'R', 'M', 0};
+static const uint32_t FRAME_CACHE_VERSION = 1;
+static const uint64_t FRAME_CACHE_FRAMES_OFFSET = 4096;
+static const uint64_t FRAME_CACHE_ALIGNMENT = 64;
+
+FrameCache *FrameCache::open (const RunParameters &run_parameters, const UserParameters &user_parameters, ostream &log)
+{
+	string filename = user_parameters.frame_cache_filename ();
+	uint64_t signature = FrameCache::source_signature (run_parameters, user_parameters);
+	FrameCache *result = FrameCache::map (filename, signature, run_parameters.number_frames);
+	if (result == NULL) {
+		log << "    Building frame cache " << filename << "...\n";
+		FrameCache::build (run_parameters, user_parameters, filename, signature);
+		result = FrameCache::map (filename, signature, run_parameters.number_frames);
+		if (result == NULL) {
+			cerr << "Failed building frame cache " << filename << "!\n";
+			exit (EXIT_FAILURE);
+		}
+	}
+	else
+		log << "    Using frame cache " << filename << "\n";
+	return result;
+}
+
+FrameCache::FrameCache (const unsigned char *data, size_t size):
+   header ((const Header *) data),
+   data (data),
+   size (size)
+{
+}
+
+FrameCache::~FrameCache ()
+{
+	munmap ((void *) this->data, this->size);
+}
+
+Image FrameCache::frame (unsigned int index_frame) const
+{
+	const unsigned char *pixels = this->data + this->header->frames_offset + (index_frame - 1) * this->header->frame_stride;
+	return Image (this->header->height, this->header->width, CV_8UC1, (void *) pixels);
+}
+
+const unsigned char *FrameCache::histogram_equalisation_lut (unsigned int index_frame) const
+{
+	return this->data + this->header->luts_offset + (index_frame - 1) * NUMBER_COLOUR_LEVELS;
+}
+
+/**
+ * Map the given cache file in memory.  Returns NULL if the file does not exist,
+ * is incomplete, or was built from other source frames.
+ */
+FrameCache *FrameCache::map (const string &filename, uint64_t signature, unsigned int number_frames)
+{
+	int fd = ::open (filename.c_str (), O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	struct stat status;
+	Header header;
+	if (fstat (fd, &status) != 0 ||
+	    (size_t) status.st_size < sizeof (Header) ||
+	    pread (fd, &header, sizeof (Header), 0) != sizeof (Header) ||
+	    memcmp (header.magic, FRAME_CACHE_MAGIC, sizeof (FRAME_CACHE_MAGIC)) != 0 ||
+	    header.version != FRAME_CACHE_VERSION ||
+	    header.signature != signature ||
+	    header.number_frames != number_frames ||
+	    (uint64_t) status.st_size < header.luts_offset + (uint64_t) number_frames * NUMBER_COLOUR_LEVELS) {
+		close (fd);
+		return NULL;
+	}
+	void *data = mmap (NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED)
+		return NULL;
+	madvise (data, status.st_size, MADV_SEQUENTIAL);
+	return new FrameCache ((const unsigned char *) data, status.st_size);
+}
+
+/**
+ * Decode all the frames of the folder and write them to the cache file.  The
+ * header is written last, so an interrupted build leaves an invalid file, and
+ * it is not written if a write failed, in which case the file is removed.
+ */
+void FrameCache::build (const RunParameters &run_parameters, const UserParameters &user_parameters, const string &filename, uint64_t signature)
+{
+	FILE *f = fopen (filename.c_str (), "w");
+	if (f == NULL) {
+		cerr << "Could not create frame cache " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	Header header;
+	memset (&header, 0, sizeof (Header));
+	bool ok = fwrite (&header, sizeof (Header), 1, f) == 1;
+	vector<unsigned char> luts (run_parameters.number_frames * NUMBER_COLOUR_LEVELS);
+	vector<unsigned char> padding;
+	FrameReader reader (run_parameters, user_parameters);
+	for (unsigned int index_frame = 1; index_frame <= run_parameters.number_frames; index_frame++) {
+		const Image &frame = reader.next ();
+		if (index_frame == 1) {
+			header.width = frame.cols;
+			header.height = frame.rows;
+			header.frame_stride = (frame.total () + FRAME_CACHE_ALIGNMENT - 1) / FRAME_CACHE_ALIGNMENT * FRAME_CACHE_ALIGNMENT;
+			header.frames_offset = FRAME_CACHE_FRAMES_OFFSET;
+			header.luts_offset = header.frames_offset + header.frame_stride * run_parameters.number_frames;
+			padding.assign (header.frame_stride - frame.total (), 0);
+			ok = ok && fseek (f, header.frames_offset, SEEK_SET) == 0;
+		}
+		else if ((uint32_t) frame.cols != header.width || (uint32_t) frame.rows != header.height) {
+			cerr << "Frame " << index_frame << " of folder " << user_parameters.folder << " has a different size!\n";
+			exit (EXIT_FAILURE);
+		}
+		for (int row = 0; row < frame.rows; row++)
+			ok = ok && fwrite (frame.ptr (row), 1, frame.cols, f) == (size_t) frame.cols;
+		ok = ok && fwrite (padding.data (), 1, padding.size (), f) == padding.size ();
+		compute_histogram_equalisation_lut (frame, &luts [(index_frame - 1) * NUMBER_COLOUR_LEVELS]);
+		run_parameters.print_progress (index_frame);
+	}
+	run_parameters.end_progress ();
+	ok = ok && fwrite (luts.data (), 1, luts.size (), f) == luts.size ();
+	memcpy (header.magic, FRAME_CACHE_MAGIC, sizeof (FRAME_CACHE_MAGIC));
+	header.version = FRAME_CACHE_VERSION;
+	header.number_frames = run_parameters.number_frames;
+	header.signature = signature;
+	// the frames and lookup tables reach the file before the header is written
+	ok = ok && fflush (f) == 0;
+	ok = ok && fseek (f, 0, SEEK_SET) == 0;
+	ok = ok && fwrite (&header, sizeof (Header), 1, f) == 1;
+	ok = fclose (f) == 0 && ok;
+	if (!ok) {
+		unlink (filename.c_str ());
+		cerr << "Could not write frame cache " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+/**
+ * Compute a signature of the source frames from the names, sizes and
+ * modification times of the frame files or of the video file.
+ */
+uint64_t FrameCache::source_signature (const RunParameters &run_parameters, const UserParameters &user_parameters)
+{
+	uint64_t result = HASH_OFFSET_BASIS;
+	result = hash_bytes (result, &run_parameters.number_frames, sizeof (run_parameters.number_frames));
+	if (!user_parameters.video.empty ())
+		result = hash_file_status (result, user_parameters.video_filename (run_parameters));
+	else
+		for (unsigned int index_frame = 1; index_frame <= run_parameters.number_frames; index_frame++)
+			result = hash_file_status (result, user_parameters.frame_filename (run_parameters, index_frame));
+	return result;
+}
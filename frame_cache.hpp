@@ -0,0 +1,66 @@
+#ifndef __FRAME_CACHE__
+#define __FRAME_CACHE__
+
+#include <stdint.h>
+#include <string>
+
+#include "image.hpp"
+
+class RunParameters;
+class UserParameters;
+
+/**
+ * @brief The FrameCache class represents a file with the decoded grey scale
+ * video frames of a folder.
+ *
+ * The file starts with a header, followed by the frames with a fixed stride,
+ * followed by the histogram equalisation lookup table of each frame.  The file
+ * is mapped in memory, and frames are returned as cv::Mat headers that point
+ * to the mapped memory, so no pixel data is copied.
+ *
+ * The header contains a signature of the source frames computed from the
+ * names, sizes and modification times of the frame image files or the video
+ * file.  A cache whose signature does not match is rebuilt.
+ */
+class FrameCache
+{
+public:
+	/**
+	 * @brief open Return the frame cache of the given folder.  The cache file is
+	 * built if it does not exist or if the source frames have changed.
+	 */
+	static FrameCache *open (const RunParameters &run_parameters, const UserParameters &user_parameters, std::ostream &log);
+	~FrameCache ();
+	/**
+	 * @brief frame Return the frame with the given number.  Frame numbers start
+	 * at one.  The image is read only and points to the mapped file.
+	 */
+	Image frame (unsigned int index_frame) const;
+	/**
+	 * @brief histogram_equalisation_lut Return the lookup table that performs
+	 * the histogram equalisation of the frame with the given number.
+	 */
+	const unsigned char *histogram_equalisation_lut (unsigned int index_frame) const;
+private:
+	struct Header
+	{
+		char magic [8];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t number_frames;
+		uint64_t signature;
+		uint64_t frame_stride;
+		uint64_t frames_offset;
+		uint64_t luts_offset;
+	};
+	const Header *header;
+	const unsigned char *data;
+	size_t size;
+	FrameCache (const unsigned char *data, size_t size);
+	static FrameCache *map (const std::string &filename, uint64_t signature, unsigned int number_frames);
+	static void build (const RunParameters &run_parameters, const UserParameters &user_parameters, const std::string &filename, uint64_t signature);
+	static uint64_t source_signature (const RunParameters &run_parameters, const UserParameters &user_parameters);
+};
+
+#endif
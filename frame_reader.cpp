@@ -0,0 +1,134 @@
+#include "frame_reader.hpp"
+#include "image_pool.hpp"
+#include "parameters.hpp"
+
+using namespace std;
+
+FrameReader::FrameReader (const RunParameters &run_parameters, const UserParameters &user_parameters):
+   FrameReader (run_parameters, user_parameters, 1, run_parameters.number_frames)
+{
+}
+
+FrameReader::FrameReader (const RunParameters &run_parameters, const UserParameters &user_parameters, unsigned int first_frame, unsigned int last_frame):
+   run_parameters (run_parameters),
+   user_parameters (user_parameters),
+   last_frame (last_frame),
+   heap_allocations (CountImageAllocations::counter ()),
+   slots (max (run_parameters.prefetch_depth, 1u)),
+   next_to_decode (first_frame),
+   next_to_deliver (first_frame),
+   delivered (false),
+   stop (false)
+{
+	for (Slot &slot : this->slots) {
+		slot.index_frame = 0;
+		slot.ready = false;
+	}
+	if (user_parameters.frame_cache != NULL)
+		return ;
+	unsigned int number_workers = run_parameters.decode_threads;
+	if (!user_parameters.video.empty ()) {
+		string filename = user_parameters.video_filename (run_parameters);
+		if (access (filename.c_str (), F_OK) != 0 || !this->capture.open (filename)) {
+			fprintf (stderr, "Could not open video: %s\n", filename.c_str ());
+			exit (EXIT_FAILURE);
+		}
+		for (unsigned int index_frame = 1; index_frame < first_frame; index_frame++)
+			if (!this->capture.grab ()) {
+				fprintf (stderr, "Failed reading frame %d from video %s\n", index_frame, filename.c_str ());
+				exit (EXIT_FAILURE);
+			}
+		number_workers = min (number_workers, 1u);
+	}
+	// the slots and the workers hold at most this many frames at the same time
+	if (number_workers > 0)
+		reserve_pooled_images (user_parameters.background.total (), this->slots.size () + number_workers);
+	for (unsigned int i = 0; i < number_workers; i++)
+		this->workers.push_back (thread (&FrameReader::decode, this));
+}
+
+FrameReader::~FrameReader ()
+{
+	{
+		lock_guard<std::mutex> lock (this->mutex);
+		this->stop = true;
+	}
+	this->slot_free.notify_all ();
+	for (thread &worker : this->workers)
+		worker.join ();
+}
+
+const Image &FrameReader::next ()
+{
+	if (this->workers.empty ()) {
+		Slot &slot = this->slots [0];
+		slot.frame = this->read_frame (this->next_to_deliver);
+		this->next_to_deliver++;
+		return slot.frame;
+	}
+	unique_lock<std::mutex> lock (this->mutex);
+	if (this->delivered) {
+		this->slots [this->next_to_deliver % this->slots.size ()].ready = false;
+		this->next_to_deliver++;
+		this->slot_free.notify_all ();
+	}
+	Slot &slot = this->slots [this->next_to_deliver % this->slots.size ()];
+	this->frame_ready.wait (lock, [this, &slot] {
+		return slot.ready && slot.index_frame == this->next_to_deliver;
+	});
+	this->delivered = true;
+	return slot.frame;
+}
+
+/**
+ * Worker thread loop.  A worker claims the next frame to decode as soon as its
+ * slot is no longer used by the consumer, decodes it without holding the lock
+ * and then marks the slot as ready.  The images it allocates are counted as
+ * the ones of the thread that constructed the reader.
+ */
+void FrameReader::decode ()
+{
+	const CountImageAllocations count (this->heap_allocations);
+	const unsigned int depth = this->slots.size ();
+	for (;;) {
+		unsigned int index_frame;
+		{
+			unique_lock<std::mutex> lock (this->mutex);
+			this->slot_free.wait (lock, [this, depth] {
+				return this->stop ||
+				      (this->next_to_decode <= this->last_frame &&
+				       this->next_to_decode < this->next_to_deliver + depth);
+			});
+			if (this->stop)
+				return ;
+			index_frame = this->next_to_decode++;
+		}
+		Image frame = this->read_frame (index_frame);
+		{
+			lock_guard<std::mutex> lock (this->mutex);
+			Slot &slot = this->slots [index_frame % depth];
+			slot.frame = frame;
+			slot.index_frame = index_frame;
+			slot.ready = true;
+		}
+		this->frame_ready.notify_all ();
+	}
+}
+
+Image FrameReader::read_frame (unsigned int index_frame)
+{
+	if (this->user_parameters.frame_cache != NULL)
+		return this->user_parameters.frame_cache->frame (index_frame);
+	if (this->user_parameters.video.empty ())
+		return read_image (this->user_parameters.frame_filename (this->run_parameters, index_frame));
+	Image frame;
+	if (!this->capture.read (frame)) {
+		fprintf (stderr, "Failed reading frame %d from video %s\n", index_frame, this->user_parameters.video_filename (this->run_parameters).c_str ());
+		exit (EXIT_FAILURE);
+	}
+	if (frame.channels () == 1)
+		return frame;
+	Image result;
+	cv::cvtColor (frame, result, CV_BGR2GRAY);
+	return result;
+}
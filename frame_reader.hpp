@@ -0,0 +1,91 @@
+#ifndef __FRAME_READER__
+#define __FRAME_READER__
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "image.hpp"
+
+class RunParameters;
+class UserParameters;
+
+/**
+ * @brief The FrameReader class reads the video frames of a folder in order.
+ *
+ * Frames are decoded by a pool of worker threads into a bounded queue of
+ * preallocated slots.  Workers decode ahead of the consumer by at most the
+ * queue depth, while method next returns the frames strictly in order.  This
+ * overlaps file input and image decoding with the analysis of previous frames.
+ *
+ * If the number of decode threads is zero, frames are decoded by the thread
+ * that calls method next.
+ *
+ * Frames are either read from image files, one per frame, or streamed from
+ * the video file given in the folder row of the CSV file.  Video containers
+ * can only be decoded sequentially, so they use at most one worker thread.
+ * Colour frames are converted to grey scale.
+ *
+ * A reader can be restricted to a contiguous range of frames.  For video files
+ * the frames before the range are grabbed and discarded, as seeking is not
+ * frame accurate in every container.
+ *
+ * If the folder has a frame cache, frames are returned from the cache by the
+ * thread that calls method next, without any decoding.
+ */
+class FrameReader
+{
+public:
+	FrameReader (const RunParameters &run_parameters, const UserParameters &user_parameters);
+	/**
+	 * @brief FrameReader Construct a reader of the frames in the range from
+	 * first_frame to last_frame, inclusive.  Frame numbers start at one.
+	 */
+	FrameReader (const RunParameters &run_parameters, const UserParameters &user_parameters, unsigned int first_frame, unsigned int last_frame);
+	~FrameReader ();
+	/**
+	 * @brief next Return the next video frame.  The frame remains valid until
+	 * the following call of this method.
+	 *
+	 * @return the next video frame.
+	 */
+	const Image &next ();
+private:
+	struct Slot
+	{
+		Image frame;
+		unsigned int index_frame;
+		bool ready;
+	};
+	const RunParameters &run_parameters;
+	const UserParameters &user_parameters;
+	const unsigned int last_frame;
+	/**
+	 * @brief heap_allocations Counter of the image pool allocations of the
+	 * thread that constructed the reader, used by the workers.
+	 */
+	std::atomic<size_t> *const heap_allocations;
+	cv::VideoCapture capture;
+	std::vector<Slot> slots;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable frame_ready;
+	std::condition_variable slot_free;
+	/**
+	 * @brief next_to_decode Index of the next frame to be claimed by a worker.
+	 */
+	unsigned int next_to_decode;
+	/**
+	 * @brief next_to_deliver Index of the frame held by the consumer, or of the
+	 * next frame to return if no frame has been returned yet.
+	 */
+	unsigned int next_to_deliver;
+	bool delivered;
+	bool stop;
+	void decode ();
+	Image read_frame (unsigned int index_frame);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <iostream>
+
+#include "frame_watcher.hpp"
+
+using namespace std;
+
+FrameWatcher::FrameWatcher ():
+   fd (inotify_init1 (IN_CLOEXEC))
+{
+	if (this->fd == -1) {
+		cerr << "Could not create an inotify instance!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+FrameWatcher::~FrameWatcher ()
+{
+	close (this->fd);
+}
+
+void FrameWatcher::add (const string &directory, size_t index)
+{
+	int wd = inotify_add_watch (this->fd, directory.c_str (), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (wd == -1) {
+		cerr << "Could not watch directory " << directory << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	this->indexes [wd] = index;
+}
+
+string FrameWatcher::wait (size_t &index)
+{
+	// large enough for several events with the longest file name
+	alignas (struct inotify_event) char buffer [16 * (sizeof (struct inotify_event) + NAME_MAX + 1)];
+	while (this->events.empty ()) {
+		ssize_t length = read (this->fd, buffer, sizeof (buffer));
+		if (length == -1 && errno == EINTR)
+			continue;
+		if (length <= 0) {
+			cerr << "Failed reading inotify events!\n";
+			exit (EXIT_FAILURE);
+		}
+		for (char *pointer = buffer; pointer < buffer + length; ) {
+			const struct inotify_event *event = (const struct inotify_event *) pointer;
+			map<int, size_t>::const_iterator directory = this->indexes.find (event->wd);
+			if (directory != this->indexes.end () && event->len > 0)
+				this->events.push_back (make_pair (directory->second, string (event->name)));
+			pointer += sizeof (struct inotify_event) + event->len;
+		}
+	}
+	index = this->events.front ().first;
+	string result = this->events.front ().second;
+	this->events.pop_front ();
+	return result;
+}
@@ -0,0 +1,47 @@
+#ifndef __FRAME_WATCHER__
+#define __FRAME_WATCHER__
+
+#include <deque>
+#include <map>
+#include <string>
+
+/**
+ * @brief The FrameWatcher class waits for files to arrive in a set of
+ * directories, using inotify.
+ *
+ * A file is reported when it is closed after being written, or when it is
+ * moved into a watched directory, so a reported file is complete.  Files that
+ * were already in a directory when it started being watched are not reported.
+ */
+class FrameWatcher
+{
+public:
+	FrameWatcher ();
+	~FrameWatcher ();
+	/**
+	 * @brief add Watch the given directory.  Its files are reported with the
+	 * given index.
+	 */
+	void add (const std::string &directory, size_t index);
+	/**
+	 * @brief wait Wait until a file arrives in one of the watched directories.
+	 *
+	 * @param index Set to the index of the directory of the file.
+	 *
+	 * @return The name of the file, without the directory.
+	 */
+	std::string wait (size_t &index);
+private:
+	int fd;
+	/**
+	 * @brief indexes Index of each directory by inotify watch descriptor.
+	 */
+	std::map<int, size_t> indexes;
+	/**
+	 * @brief events Files read from inotify that were not yet returned by
+	 * method wait.
+	 */
+	std::deque<std::pair<size_t, std::string> > events;
+};
+
+#endif
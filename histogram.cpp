@@ -1,8 +1,17 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <iostream>
 
 #include "histogram.hpp"
+#include "csv.hpp"
 #include "image.hpp"
+#include "packed_histograms.hpp"
 
 using namespace std;
 
@@ -11,60 +20,323 @@ Histogram::Histogram ():
 {
 }
 
-void Histogram::read (FILE *file)
+int Histogram::most_common_colour () const
 {
-	int value;
-	if (fscanf (file, "%d", &value) != 1) {
-		cerr << "Failed reading first value from histogram!\n";
+	int result = 0;
+	double best = (*this) [0];
+	for (unsigned int colour = 1; colour < NUMBER_COLOUR_LEVELS; colour++)
+		if ((*this) [colour] > best) {
+			best = (*this) [colour];
+			result = colour;
+		}
+	return result;
+}
+
+/**
+ * Alignment in bytes of the counts of a histogram matrix, the size of a cache
+ * line.
+ */
+static const size_t HISTOGRAM_MATRIX_ALIGNMENT = 64;
+
+HistogramMatrix::HistogramMatrix (unsigned int histograms_per_frame):
+   histograms_per_frame (histograms_per_frame),
+   number_bins (NUMBER_COLOUR_LEVELS),
+   frame_size ((size_t) histograms_per_frame * NUMBER_COLOUR_LEVELS),
+   counts (NULL),
+   frames (0),
+   capacity (0)
+{
+}
+
+HistogramMatrix::~HistogramMatrix ()
+{
+	free (this->counts);
+}
+
+void HistogramMatrix::reserve (size_t number_frames)
+{
+	if (number_frames <= this->capacity)
+		return ;
+	void *buffer;
+	if (posix_memalign (&buffer, HISTOGRAM_MATRIX_ALIGNMENT, max (number_frames * this->frame_size * sizeof (uint32_t), (size_t) 1)) != 0) {
+		cerr << "Could not allocate the histograms of " << number_frames << " frames!\n";
 		exit (EXIT_FAILURE);
 	}
-	(*this) [0] = value;
-	for (unsigned int i = 1; i < NUMBER_COLOUR_LEVELS; i++) {
-		if (fscanf (file, ",%d", &value) != 1) {
-			cerr << "Failed reading value #" << i + 1 << " from histogram!\n";
-			exit (EXIT_FAILURE);
+	if (this->counts != NULL)
+		memcpy (buffer, this->counts, this->frames * this->frame_size * sizeof (uint32_t));
+	free (this->counts);
+	this->counts = (uint32_t *) buffer;
+	this->capacity = number_frames;
+}
+
+uint32_t *HistogramMatrix::append_frame ()
+{
+	if (this->frames == this->capacity)
+		this->reserve (max ((size_t) 16, 2 * this->capacity));
+	uint32_t *result = this->counts + this->frames * this->frame_size;
+	memset (result, 0, this->frame_size * sizeof (uint32_t));
+	this->frames++;
+	this->undefined_frames.push_back (false);
+	return result;
+}
+
+void HistogramMatrix::append_undefined_frame ()
+{
+	this->append_frame ();
+	this->undefined_frames.back () = true;
+}
+
+void HistogramMatrix::append (const HistogramMatrix &other)
+{
+	this->reserve (this->frames + other.frames);
+	memcpy (this->counts + this->frames * this->frame_size, other.counts, other.frames * this->frame_size * sizeof (uint32_t));
+	this->frames += other.frames;
+	this->undefined_frames.insert (this->undefined_frames.end (), other.undefined_frames.begin (), other.undefined_frames.end ());
+}
+
+void HistogramMatrix::resize (size_t number_frames)
+{
+	this->reserve (number_frames);
+	if (number_frames > this->frames)
+		memset (this->counts + this->frames * this->frame_size, 0, (number_frames - this->frames) * this->frame_size * sizeof (uint32_t));
+	this->frames = number_frames;
+	this->undefined_frames.resize (number_frames, false);
+}
+
+void HistogramMatrix::set_undefined (size_t index_frame)
+{
+	memset (this->counts + index_frame * this->frame_size, 0, this->frame_size * sizeof (uint32_t));
+	this->undefined_frames [index_frame] = true;
+}
+
+bool HistogramMatrix::operator== (const HistogramMatrix &other) const
+{
+	return
+	      this->histograms_per_frame == other.histograms_per_frame &&
+	      this->frames == other.frames &&
+	      this->undefined_frames == other.undefined_frames &&
+	      (this->frames == 0 || memcmp (this->counts, other.counts, this->frames * this->frame_size * sizeof (uint32_t)) == 0);
+}
+
+CumulativeHistograms::CumulativeHistograms (const HistogramMatrix &histograms):
+   stride (NUMBER_COLOUR_LEVELS + 1),
+   sums (histograms.size () * (NUMBER_COLOUR_LEVELS + 1)),
+   undefined_histograms (histograms.size ())
+{
+	for (size_t index = 0; index < histograms.size (); index++) {
+		const uint32_t *histogram = histograms.histogram (index);
+		uint32_t *sum = &this->sums [index * this->stride];
+		sum [NUMBER_COLOUR_LEVELS] = 0;
+		for (int colour = NUMBER_COLOUR_LEVELS - 1; colour >= 0; colour--)
+			sum [colour] = sum [colour + 1] + histogram [colour];
+		this->undefined_histograms [index] = histograms.undefined (index);
+	}
+}
+
+void write_vector_histograms (const std::string &filename, const HistogramMatrix *vh)
+{
+	CSVWriter writer (filename);
+	for (size_t index_frame = 0; index_frame < vh->number_frames (); index_frame++) {
+		const HistogramMatrix::View frame = vh->frame (index_frame);
+		const bool undefined = vh->undefined_frame (index_frame);
+		for (size_t index = 0; index < frame.size (); index++) {
+			const uint32_t *h = frame [index];
+			for (unsigned int i = 0; i < NUMBER_COLOUR_LEVELS; i++) {
+				if (i > 0)
+					writer.separator ();
+				writer.write (undefined ? -1 : (int) h [i]);
+			}
+			writer.end_row ();
 		}
-		(*this) [i] = value;
 	}
 }
 
-void Histogram::write (FILE *file) const
+HistogramMatrix *read_vector_histograms (const std::string &filename, unsigned int number_frames, unsigned int histograms_per_frame)
 {
-	fprintf (file, "%d", (int) (*this) [0]);
-	for (unsigned int i = 1; i < NUMBER_COLOUR_LEVELS; i++)
-		fprintf (file, ",%d", (int) (*this) [i]);
+	const size_t size = (size_t) number_frames * histograms_per_frame;
+	vector<int> values (size * NUMBER_COLOUR_LEVELS);
+	CSVReader (filename).read (size, NUMBER_COLOUR_LEVELS, values.data ());
+	HistogramMatrix *result = new HistogramMatrix (histograms_per_frame);
+	result->resize (number_frames);
+	uint32_t *counts = result->data ();
+	for (size_t i = 0; i < values.size (); i++)
+		counts [i] = values [i];
+	for (unsigned int index_frame = 0; index_frame < number_frames; index_frame++)
+		if (histograms_per_frame > 0 && values [(size_t) index_frame * histograms_per_frame * NUMBER_COLOUR_LEVELS] == -1)
+			result->set_undefined (index_frame);
+	return result;
 }
 
-int Histogram::most_common_colour () const
+/**
+ * Header of the binary histogram files.  Its size is a multiple of the cache
+ * line size, so the counts are aligned.
+ */
+struct HistogramFileHeader
 {
-	int result = 0;
-	double best = (*this) [0];
-	for (unsigned int colour = 1; colour < NUMBER_COLOUR_LEVELS; colour++)
-		if ((*this) [colour] > best) {
-			best = (*this) [colour];
-			result = colour;
+	char magic [8];
+	uint32_t version;
+	uint32_t counts_type;
+	uint32_t number_frames;
+	uint32_t histograms_per_frame;
+	uint32_t number_bins;
+	uint32_t undefined_count;
+	char parameters [224];
+};
+
+static const char HISTOGRAM_FILE_MAGIC [8] = {'A', 'B', 'V', 'P', 'H', 'S', 'T', 0};
+static const uint32_t HISTOGRAM_FILE_VERSION = 1;
+/**
+ * The counts are stored as 32 bit unsigned integers in native byte order.
+ */
+static const uint32_t HISTOGRAM_FILE_COUNTS_UINT32 = 1;
+/**
+ * The counts are compressed by function encode_packed_histograms.
+ */
+static const uint32_t HISTOGRAM_FILE_COUNTS_PACKED = 2;
+static const uint32_t HISTOGRAM_FILE_UNDEFINED_COUNT = UINT32_MAX;
+
+static const char BINARY_HISTOGRAMS_EXTENSION [] = ".hist";
+
+/**
+ * Return the name of the given file without folder and extension.  It holds
+ * the analysis parameters in the names built by class UserParameters.
+ */
+static string histograms_parameters (const string &filename)
+{
+	size_t start = filename.find_last_of ('/');
+	start = start == string::npos ? 0 : start + 1;
+	size_t end = filename.find_last_of ('.');
+	if (end == string::npos || end < start)
+		end = filename.size ();
+	return filename.substr (start, min (end - start, sizeof (HistogramFileHeader::parameters) - 1));
+}
+
+string binary_histograms_filename (const string &csv_filename)
+{
+	const string csv_extension = ".csv";
+	if (csv_filename.size () >= csv_extension.size () &&
+	    csv_filename.compare (csv_filename.size () - csv_extension.size (), csv_extension.size (), csv_extension) == 0)
+		return csv_filename.substr (0, csv_filename.size () - csv_extension.size ()) + BINARY_HISTOGRAMS_EXTENSION;
+	return csv_filename + BINARY_HISTOGRAMS_EXTENSION;
+}
+
+/**
+ * Return the counts of the given histograms as stored in a binary file, with
+ * the counts of undefined frames equal to HISTOGRAM_FILE_UNDEFINED_COUNT.  If
+ * no frame is undefined, these are the counts of the matrix, otherwise they
+ * are copied to the given buffer.
+ */
+static const uint32_t *file_counts (const HistogramMatrix *vh, vector<uint32_t> &buffer)
+{
+	const size_t frame_size = (size_t) vh->histograms_per_frame * NUMBER_COLOUR_LEVELS;
+	for (size_t index_frame = 0; index_frame < vh->number_frames (); index_frame++)
+		if (vh->undefined_frame (index_frame)) {
+			if (buffer.empty ())
+				buffer.assign (vh->data (), vh->data () + vh->size () * NUMBER_COLOUR_LEVELS);
+			fill (buffer.begin () + index_frame * frame_size, buffer.begin () + (index_frame + 1) * frame_size, HISTOGRAM_FILE_UNDEFINED_COUNT);
 		}
-	return result;
+	return buffer.empty () ? vh->data () : buffer.data ();
 }
 
-void write_vector_histograms (const std::string &filename, const VectorHistograms *vh)
+void write_vector_histograms_binary (const string &filename, const HistogramMatrix *vh, bool compress)
 {
+	// older versions of the program made their histogram files read only
+	unlink (filename.c_str ());
 	FILE *f = fopen (filename.c_str (), "w");
-	for (const Histogram &h : *vh) {
-		h.write (f);
-		fprintf (f, "\n");
+	if (f == NULL) {
+		cerr << "Could not create histograms file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	const unsigned int number_frames = vh->number_frames ();
+	HistogramFileHeader header;
+	memset (&header, 0, sizeof (HistogramFileHeader));
+	// the header is written last, so an incomplete file has an invalid magic
+	bool ok = fwrite (&header, sizeof (HistogramFileHeader), 1, f) == 1;
+	header.histograms_per_frame = vh->histograms_per_frame;
+	vector<uint32_t> buffer;
+	const uint32_t *counts = file_counts (vh, buffer);
+	if (compress) {
+		vector<unsigned char> packed;
+		encode_packed_histograms (counts, number_frames, header.histograms_per_frame, packed);
+		ok = ok && fwrite (packed.data (), 1, packed.size (), f) == packed.size ();
+	}
+	else
+		ok = ok && fwrite (counts, sizeof (uint32_t), vh->size () * NUMBER_COLOUR_LEVELS, f) == vh->size () * NUMBER_COLOUR_LEVELS;
+	memcpy (header.magic, HISTOGRAM_FILE_MAGIC, sizeof (HISTOGRAM_FILE_MAGIC));
+	header.version = HISTOGRAM_FILE_VERSION;
+	header.counts_type = compress ? HISTOGRAM_FILE_COUNTS_PACKED : HISTOGRAM_FILE_COUNTS_UINT32;
+	header.number_frames = number_frames;
+	header.number_bins = NUMBER_COLOUR_LEVELS;
+	header.undefined_count = HISTOGRAM_FILE_UNDEFINED_COUNT;
+	string parameters = histograms_parameters (filename);
+	memcpy (header.parameters, parameters.c_str (), parameters.size ());
+	ok = ok && fseek (f, 0, SEEK_SET) == 0;
+	ok = ok && fwrite (&header, sizeof (HistogramFileHeader), 1, f) == 1;
+	ok = fclose (f) == 0 && ok;
+	if (!ok) {
+		unlink (filename.c_str ());
+		cerr << "Could not write histograms file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+#ifdef DEBUG
+	HistogramMatrix *check = read_vector_histograms_binary (filename, number_frames, vh->histograms_per_frame);
+	if (!(*check == *vh)) {
+		cerr << "The histograms read from file " << filename << " differ from the ones written!\n";
+		exit (EXIT_FAILURE);
 	}
-	fclose (f);
-	chmod (filename.c_str (), S_IRUSR);
+	delete check;
+#endif
 }
 
-VectorHistograms *read_vector_histograms (const std::string &filename, size_t size)
+HistogramMatrix *read_vector_histograms_binary (const string &filename, unsigned int number_frames, unsigned int histograms_per_frame)
 {
-	VectorHistograms *result = new VectorHistograms (size);
-	FILE *f = fopen (filename.c_str (), "r");
-	for (unsigned int index = 0; index < size; index++) {
-		result->at (index).read (f);
+	int fd = open (filename.c_str (), O_RDONLY);
+	if (fd == -1) {
+		cerr << "Could not open histograms file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	struct stat status;
+	if (fstat (fd, &status) != 0 ||
+	    (size_t) status.st_size < sizeof (HistogramFileHeader)) {
+		cerr << "Histograms file " << filename << " is too short!\n";
+		exit (EXIT_FAILURE);
+	}
+	void *data = mmap (NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) {
+		cerr << "Could not map histograms file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	const HistogramFileHeader *header = (const HistogramFileHeader *) data;
+	const string parameters = histograms_parameters (filename);
+	if (memcmp (header->magic, HISTOGRAM_FILE_MAGIC, sizeof (HISTOGRAM_FILE_MAGIC)) != 0 ||
+	    header->version != HISTOGRAM_FILE_VERSION ||
+	    (header->counts_type != HISTOGRAM_FILE_COUNTS_UINT32 && header->counts_type != HISTOGRAM_FILE_COUNTS_PACKED) ||
+	    header->number_frames != number_frames ||
+	    (number_frames > 0 && header->histograms_per_frame != histograms_per_frame) ||
+	    header->number_bins != NUMBER_COLOUR_LEVELS ||
+	    strncmp (header->parameters, parameters.c_str (), sizeof (header->parameters)) != 0) {
+		cerr << "Histograms file " << filename << " has an invalid header or does not match the analysis!\n";
+		exit (EXIT_FAILURE);
+	}
+	const size_t data_size = status.st_size - sizeof (HistogramFileHeader);
+	HistogramMatrix *result = new HistogramMatrix (histograms_per_frame);
+	result->resize (number_frames);
+	if (header->counts_type == HISTOGRAM_FILE_COUNTS_PACKED) {
+		if (!decode_packed_histograms ((const unsigned char *) (header + 1), data_size, number_frames, histograms_per_frame, result->data ())) {
+			cerr << "Histograms file " << filename << " has invalid compressed data!\n";
+			exit (EXIT_FAILURE);
+		}
+	}
+	else if (data_size != result->size () * NUMBER_COLOUR_LEVELS * sizeof (uint32_t)) {
+		cerr << "Histograms file " << filename << " does not have the expected size!\n";
+		exit (EXIT_FAILURE);
 	}
-	fclose (f);
+	else
+		memcpy (result->data (), header + 1, data_size);
+	for (unsigned int index_frame = 0; index_frame < number_frames; index_frame++)
+		if (histograms_per_frame > 0 && *result->histogram (index_frame, 0) == header->undefined_count)
+			result->set_undefined (index_frame);
+	munmap (data, status.st_size);
 	return result;
 }
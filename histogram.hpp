@@ -1,7 +1,9 @@
 #ifndef __HISTOGRAM__
 #define __HISTOGRAM__
 
+#include <stdint.h>
 #include <stdio.h>
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -11,24 +13,212 @@ class Histogram:
 public:
 	Histogram ();
 	/**
-	 * @brief read Read an histogram from the given file.  The data format is CSV.
-	 * @param file
+	 * Return the most common colour in this histogram.
 	 */
-	void read (FILE *file);
+	int most_common_colour () const;
+};
+
+/**
+ * @brief The HistogramMatrix class holds the histograms of a sequence of
+ * frames, with the same number of histograms in every frame.
+ *
+ * The counts are stored as 32 bit unsigned integers in a single aligned
+ * buffer indexed by frame, histogram in the frame and colour, so the
+ * histogram with index I is histogram I modulo H of frame I / H, where H is
+ * the number of histograms per frame.  Frames whose histograms have no value,
+ * such as the bee speed of the first frames of a video, are flagged as
+ * undefined and their counts are zero.  The buffer grows geometrically as
+ * frames are appended.
+ */
+class HistogramMatrix
+{
+public:
 	/**
-	 * @brief write Write a histogram to the given file.  The data format is CSV.
-	 * @param file
+	 * @brief The View class is a sequence of histograms of a matrix that are a
+	 * constant number of counts apart, such as the histograms of a frame or the
+	 * histograms of a region of interest in every frame.
 	 */
-	void write (FILE *file) const;
+	class View
+	{
+	public:
+		View (const uint32_t *counts, size_t stride, size_t size):
+		   counts (counts),
+		   stride (stride),
+		   length (size)
+		{
+		}
+		inline const uint32_t *operator[] (size_t index) const
+		{
+			return this->counts + index * this->stride;
+		}
+		inline size_t size () const
+		{
+			return this->length;
+		}
+	private:
+		const uint32_t *counts;
+		size_t stride;
+		size_t length;
+	};
+	const unsigned int histograms_per_frame;
+	HistogramMatrix (unsigned int histograms_per_frame);
+	HistogramMatrix (const HistogramMatrix &) = delete;
+	HistogramMatrix &operator= (const HistogramMatrix &) = delete;
+	~HistogramMatrix ();
+	inline size_t number_frames () const
+	{
+		return this->frames;
+	}
 	/**
-	 * Return the most common colour in this histogram.
+	 * @brief size Return the number of histograms.
 	 */
-	int most_common_colour () const;
+	inline size_t size () const
+	{
+		return this->frames * this->histograms_per_frame;
+	}
+	inline const uint32_t *data () const
+	{
+		return this->counts;
+	}
+	inline uint32_t *data ()
+	{
+		return this->counts;
+	}
+	inline const uint32_t *histogram (size_t index_histogram) const
+	{
+		return this->counts + index_histogram * this->number_bins;
+	}
+	inline const uint32_t *histogram (size_t index_frame, unsigned int index_histogram) const
+	{
+		return this->counts + index_frame * this->frame_size + index_histogram * this->number_bins;
+	}
+	inline bool undefined (size_t index_histogram) const
+	{
+		return this->undefined_frames [index_histogram / this->histograms_per_frame];
+	}
+	inline bool undefined_frame (size_t index_frame) const
+	{
+		return this->undefined_frames [index_frame];
+	}
+	/**
+	 * @brief frame Return the histograms of the given frame.
+	 */
+	inline View frame (size_t index_frame) const
+	{
+		return View (this->counts + index_frame * this->frame_size, this->number_bins, this->histograms_per_frame);
+	}
+	/**
+	 * @brief column Return the histogram with the given index in every frame,
+	 * such as the histograms of a region of interest.
+	 */
+	inline View column (unsigned int index_histogram) const
+	{
+		return View (this->counts + index_histogram * this->number_bins, this->frame_size, this->frames);
+	}
+	/**
+	 * @brief reserve Allocate space for the given number of frames, so that
+	 * appending up to that many frames does not move the counts.
+	 */
+	void reserve (size_t number_frames);
+	/**
+	 * @brief append_frame Append a frame whose counts are zero, and return its
+	 * counts.  The pointer is valid until the next frame is appended.
+	 */
+	uint32_t *append_frame ();
+	void append_undefined_frame ();
+	/**
+	 * @brief append Append the frames of the given matrix, which must have the
+	 * same number of histograms per frame.
+	 */
+	void append (const HistogramMatrix &other);
+	/**
+	 * @brief resize Keep the given number of frames, appending frames whose
+	 * counts are zero if there are fewer.
+	 */
+	void resize (size_t number_frames);
+	/**
+	 * @brief set_undefined Flag the given frame as undefined and set its counts
+	 * to zero.
+	 */
+	void set_undefined (size_t index_frame);
+	bool operator== (const HistogramMatrix &other) const;
+private:
+	const size_t number_bins;
+	const size_t frame_size;
+	uint32_t *counts;
+	size_t frames;
+	size_t capacity;
+	std::vector<bool> undefined_frames;
 };
 
-typedef std::vector<Histogram> VectorHistograms;
+/**
+ * @brief The CumulativeHistograms class is an index of a matrix of histograms
+ * that returns the number of pixels with a colour equal to or higher than a
+ * given level with a single lookup.
+ *
+ * For each histogram it stores the suffix sums of the bins.  Histograms of
+ * undefined frames are reported as such.
+ */
+class CumulativeHistograms
+{
+public:
+	CumulativeHistograms (const HistogramMatrix &histograms);
+	/**
+	 * @brief count_from Return the sum of the bins of the given histogram from
+	 * the given colour level up to the highest colour.  Levels above the
+	 * highest colour, which same colour thresholds above 100 give, count no
+	 * pixel.
+	 */
+	inline uint32_t count_from (size_t index_histogram, unsigned int level) const
+	{
+		// the last sum of each histogram is zero
+		return this->sums [index_histogram * this->stride + std::min (level, (unsigned int) this->stride - 1)];
+	}
+	inline bool undefined (size_t index_histogram) const
+	{
+		return this->undefined_histograms [index_histogram];
+	}
+private:
+	const size_t stride;
+	std::vector<uint32_t> sums;
+	std::vector<bool> undefined_histograms;
+};
+
+/**
+ * @brief write_vector_histograms Write a matrix of histograms in a CSV file,
+ * one histogram per row.  The bins of undefined histograms are written as -1.
+ */
+void write_vector_histograms (const std::string &filename, const HistogramMatrix *vh);
+HistogramMatrix *read_vector_histograms (const std::string &filename, unsigned int number_frames, unsigned int histograms_per_frame);
+
+/**
+ * @brief binary_histograms_filename Return the name of the binary file that
+ * holds the same histograms as the given CSV file.
+ */
+std::string binary_histograms_filename (const std::string &csv_filename);
 
-void write_vector_histograms (const std::string &filename, const VectorHistograms *vh);
-VectorHistograms *read_vector_histograms (const std::string &filename, size_t size);
+/**
+ * @brief write_vector_histograms_binary Write a matrix of histograms in the
+ * binary format.
+ *
+ * The file starts with a header with a version number, the number of frames,
+ * the number of histograms per frame, the number of bins, the type of the
+ * counts and the analysis parameters, which are taken from the file name.  The
+ * header is followed by the counts of every histogram as contiguous 32 bit
+ * unsigned integers, which is the layout of the matrix.  Histograms of
+ * undefined frames are stored with every bin equal to UINT32_MAX.  If
+ * compression is requested, the counts are encoded by function
+ * encode_packed_histograms instead.  The header is written last, so an
+ * interrupted write leaves an invalid file.
+ */
+void write_vector_histograms_binary (const std::string &filename, const HistogramMatrix *vh, bool compress);
+/**
+ * @brief read_vector_histograms_binary Read a matrix of histograms written by
+ * write_vector_histograms_binary.  The file is mapped in memory and the counts
+ * are copied, or decoded if they are compressed, without any parsing.  The
+ * program exits if the header does not match the given number of frames and
+ * histograms per frame.
+ */
+HistogramMatrix *read_vector_histograms_binary (const std::string &filename, unsigned int number_frames, unsigned int histograms_per_frame);
 
 #endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "image.hpp"
@@ -32,3 +33,71 @@ void compute_histogram (const cv::Mat &image, const cv::Mat &mask, Histogram &hi
 		histogram [i] = hist.at<float> (i);
 	}
 }
+
+void compute_histogram_equalisation_lut (const Image &image, unsigned char *lut)
+{
+	// cv::equalizeHist returns an empty image, the identity table keeps it unchanged
+	if (image.empty ()) {
+		for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+			lut [colour] = colour;
+		return ;
+	}
+	int hist [NUMBER_COLOUR_LEVELS] = {0};
+	for (int row = 0; row < image.rows; row++) {
+		const unsigned char *pixel = image.ptr<unsigned char> (row);
+		for (int column = 0; column < image.cols; column++)
+			hist [pixel [column]]++;
+	}
+	// same computation as cv::equalizeHist
+	unsigned int i = 0;
+	while (i < NUMBER_COLOUR_LEVELS - 1 && hist [i] == 0)
+		i++;
+	const int total = (int) image.total ();
+	if (hist [i] == total) {
+		for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+			lut [colour] = i;
+		return ;
+	}
+	const float scale = (NUMBER_COLOUR_LEVELS - 1.f) / (total - hist [i]);
+	int sum = 0;
+	for (unsigned int colour = 0; colour < i; colour++)
+		lut [colour] = 0;
+	for (lut [i++] = 0; i < NUMBER_COLOUR_LEVELS; i++) {
+		sum += hist [i];
+		lut [i] = cv::saturate_cast<unsigned char> (sum * scale);
+	}
+}
+
+cv::Rect compute_masks_bounding_box (const std::vector<Image> &masks, int width, int height)
+{
+	int left = width, top = height, right = 0, bottom = 0;
+	for (const Image &mask : masks) {
+		for (int row = 0; row < mask.rows; row++) {
+			const unsigned char *pixel = mask.ptr<unsigned char> (row);
+			int first = 0;
+			while (first < mask.cols && pixel [first] == 0)
+				first++;
+			if (first == mask.cols)
+				continue;
+			int last = mask.cols - 1;
+			while (pixel [last] == 0)
+				last--;
+			left = std::min (left, first);
+			right = std::max (right, last + 1);
+			top = std::min (top, row);
+			bottom = std::max (bottom, row + 1);
+		}
+	}
+	if (left >= right || top >= bottom)
+		return cv::Rect (0, 0, width, height);
+	else
+		return cv::Rect (left, top, right - left, bottom - top);
+}
+
+void equalise_histogram (const Image &image, const unsigned char *lut, Image &result)
+{
+	if (lut == NULL)
+		cv::equalizeHist (image, result);
+	else
+		cv::LUT (image, cv::Mat (1, NUMBER_COLOUR_LEVELS, CV_8UC1, (void *) lut), result);
+}
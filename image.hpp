@@ -2,6 +2,7 @@
 #define __IMAGE__
 
 #include <unistd.h>
+#include <vector>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -21,17 +22,34 @@ inline Image read_image (const std::string &filename)
 	return cv::imread (filename, CV_LOAD_IMAGE_GRAYSCALE);
 }
 
-inline const Image *preprocess_histogram_equalisation (const Image *image)
-{
-	static Image result;
-	cv::equalizeHist (*image, result);
-	return &result;
-}
-
-inline const Image *preprocess_raw (const Image *image)
-{
-	return image;
-}
+/**
+ * @brief compute_histogram_equalisation_lut Compute the lookup table that
+ * cv::equalizeHist applies to the given image.
+ *
+ * @param image A grey scale image.  The table of an empty image is the
+ * identity.
+ * @param lut Array with NUMBER_COLOUR_LEVELS entries where the table is stored.
+ */
+void compute_histogram_equalisation_lut (const Image &image, unsigned char *lut);
+
+/**
+ * @brief equalise_histogram Perform the histogram equalisation of the given
+ * image.  If a lookup table computed by compute_histogram_equalisation_lut is
+ * given, it is applied to the image, otherwise cv::equalizeHist is used.
+ */
+void equalise_histogram (const Image &image, const unsigned char *lut, Image &result);
+
+/**
+ * @brief compute_masks_bounding_box Compute the bounding rectangle of the
+ * non-zero pixels of the given masks.
+ *
+ * The rows are scanned instead of calling cv::boundingRect, which only accepts
+ * a raster mask since OpenCV 3.4.
+ *
+ * @return The bounding rectangle, or the entire image with the given size if
+ * every mask is empty or there are no masks.
+ */
+cv::Rect compute_masks_bounding_box (const std::vector<Image> &masks, int width, int height);
 
 void compute_histogram (const Image &image, const cv::Mat &mask, Histogram &histogram);
 
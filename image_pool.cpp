@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <new>
+
+#include "image_pool.hpp"
+
+using namespace std;
+
+const size_t IMAGE_ALIGNMENT = 64;
+
+/**
+ * @brief heap_allocations Counter of the allocations of the current thread.
+ */
+static thread_local atomic<size_t> *heap_allocations = NULL;
+
+#if CV_MAJOR_VERSION >= 3
+
+static void count_heap_allocation ()
+{
+	if (heap_allocations != NULL)
+		(*heap_allocations)++;
+}
+
+/**
+ * @brief The ImagePool class is the allocator installed by function
+ * install_image_pool.
+ *
+ * Besides the pixel buffers, the pool also reuses the storage of the
+ * cv::UMatData headers.  Free buffers and headers are kept in vectors, whose
+ * capacity only grows when more images are released than ever before.  Only
+ * buffers whose size has a positive count in pooled_sizes are kept.
+ */
+class ImagePool:
+      public cv::MatAllocator
+{
+	mutable std::mutex mutex;
+	mutable vector<pair<size_t, unsigned char *> > free_buffers;
+	mutable vector<void *> free_headers;
+	map<size_t, unsigned int> pooled_sizes;
+public:
+	void add_sizes (const vector<size_t> &sizes)
+	{
+		lock_guard<std::mutex> lock (this->mutex);
+		for (size_t size : sizes)
+			this->pooled_sizes [size]++;
+	}
+	void remove_sizes (const vector<size_t> &sizes)
+	{
+		lock_guard<std::mutex> lock (this->mutex);
+		for (size_t size : sizes) {
+			map<size_t, unsigned int>::iterator pooled = this->pooled_sizes.find (size);
+			if (pooled == this->pooled_sizes.end () || --pooled->second > 0)
+				continue;
+			this->pooled_sizes.erase (pooled);
+			for (size_t index = this->free_buffers.size (); index-- > 0; )
+				if (this->free_buffers [index].first == size) {
+					free (this->free_buffers [index].second);
+					this->free_buffers [index] = this->free_buffers.back ();
+					this->free_buffers.pop_back ();
+				}
+		}
+	}
+	void reserve (size_t size, unsigned int count)
+	{
+		lock_guard<std::mutex> lock (this->mutex);
+		if (this->pooled_sizes.count (size) == 0)
+			return ;
+		for (unsigned int index = 0; index < count; index++) {
+			this->free_buffers.push_back (make_pair (size, new_buffer (size)));
+			this->free_headers.push_back (::operator new (sizeof (cv::UMatData)));
+			count_heap_allocation ();
+		}
+	}
+	virtual cv::UMatData *allocate (int dims, const int *sizes, int type, void *data, size_t *step, int /*flags*/, cv::UMatUsageFlags /*usage_flags*/) const
+	{
+		// same layout as the standard allocator of OpenCV
+		size_t total = CV_ELEM_SIZE (type);
+		for (int i = dims - 1; i >= 0; i--) {
+			if (step != NULL) {
+				if (data != NULL && step [i] != CV_AUTOSTEP)
+					total = step [i];
+				else
+					step [i] = total;
+			}
+			total *= sizes [i];
+		}
+		lock_guard<std::mutex> lock (this->mutex);
+		void *header;
+		if (this->free_headers.empty ()) {
+			header = ::operator new (sizeof (cv::UMatData));
+			count_heap_allocation ();
+		}
+		else {
+			header = this->free_headers.back ();
+			this->free_headers.pop_back ();
+		}
+		cv::UMatData *result = new (header) cv::UMatData (this);
+		result->size = total;
+		if (data != NULL) {
+			result->data = result->origdata = (unsigned char *) data;
+			result->flags |= cv::UMatData::USER_ALLOCATED;
+		}
+		else
+			result->data = result->origdata = this->take_buffer (total);
+		return result;
+	}
+	virtual bool allocate (cv::UMatData *data, int /*access_flags*/, cv::UMatUsageFlags /*usage_flags*/) const
+	{
+		return data != NULL;
+	}
+	virtual void deallocate (cv::UMatData *data) const
+	{
+		if (data == NULL)
+			return ;
+		lock_guard<std::mutex> lock (this->mutex);
+		if (!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+			if (this->pooled_sizes.count (data->size) > 0)
+				this->free_buffers.push_back (make_pair (data->size, data->origdata));
+			else
+				free (data->origdata);
+		}
+		data->~UMatData ();
+		this->free_headers.push_back (data);
+	}
+private:
+	unsigned char *take_buffer (size_t size) const
+	{
+		for (size_t index = 0; index < this->free_buffers.size (); index++)
+			if (this->free_buffers [index].first == size) {
+				unsigned char *result = this->free_buffers [index].second;
+				this->free_buffers [index] = this->free_buffers.back ();
+				this->free_buffers.pop_back ();
+				return result;
+			}
+		return new_buffer (size);
+	}
+	static unsigned char *new_buffer (size_t size)
+	{
+		void *result;
+		if (posix_memalign (&result, IMAGE_ALIGNMENT, max (size, (size_t) 1)) != 0) {
+			fprintf (stderr, "Could not allocate an image with %zu bytes\n", size);
+			exit (EXIT_FAILURE);
+		}
+		count_heap_allocation ();
+		return (unsigned char *) result;
+	}
+};
+
+static ImagePool *image_pool = NULL;
+
+void install_image_pool ()
+{
+	// the pool is never destroyed, as images may be released after main returns
+	if (image_pool == NULL)
+		image_pool = new ImagePool ();
+	cv::Mat::setDefaultAllocator (image_pool);
+}
+
+void reserve_pooled_images (size_t size, unsigned int count)
+{
+	if (image_pool != NULL)
+		image_pool->reserve (size, count);
+}
+
+PooledImageSizes::PooledImageSizes (const vector<size_t> &sizes):
+   sizes (sizes)
+{
+	if (image_pool != NULL)
+		image_pool->add_sizes (this->sizes);
+}
+
+PooledImageSizes::~PooledImageSizes ()
+{
+	if (image_pool != NULL)
+		image_pool->remove_sizes (this->sizes);
+}
+
+#else
+
+void install_image_pool ()
+{
+}
+
+void reserve_pooled_images (size_t /*size*/, unsigned int /*count*/)
+{
+}
+
+PooledImageSizes::PooledImageSizes (const vector<size_t> &sizes):
+   sizes (sizes)
+{
+}
+
+PooledImageSizes::~PooledImageSizes ()
+{
+}
+
+#endif
+
+CountImageAllocations::CountImageAllocations (atomic<size_t> *counter):
+   previous (heap_allocations)
+{
+	heap_allocations = counter;
+}
+
+CountImageAllocations::~CountImageAllocations ()
+{
+	heap_allocations = this->previous;
+}
+
+atomic<size_t> *CountImageAllocations::counter ()
+{
+	return heap_allocations;
+}
+
+FrameRing::FrameRing ():
+   first (0),
+   number_frames (0)
+{
+}
+
+void FrameRing::reset (unsigned int depth, const cv::Size &size)
+{
+	this->images.resize (depth == 0 ? 0 : depth + 1);
+	for (Image &image : this->images)
+		image.create (size, CV_8UC1);
+	this->first = 0;
+	this->number_frames = 0;
+}
+
+void FrameRing::push ()
+{
+	if (this->number_frames < this->depth ())
+		this->number_frames++;
+	else
+		this->first = (this->first + 1) % this->images.size ();
+}
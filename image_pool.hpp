@@ -0,0 +1,156 @@
+#ifndef __IMAGE_POOL__
+#define __IMAGE_POOL__
+
+#include <atomic>
+#include <vector>
+
+#include "image.hpp"
+
+/**
+ * @brief IMAGE_ALIGNMENT Alignment in bytes of the image buffers of the pool.
+ * It is the size of a cache line, and of the widest SIMD registers.
+ */
+extern const size_t IMAGE_ALIGNMENT;
+
+/**
+ * @brief install_image_pool Make the image pool the default allocator of
+ * cv::Mat.
+ *
+ * The pool keeps the pixel buffers of released images whose size is given by
+ * a PooledImageSizes object, and hands them out again to images with the same
+ * number of bytes, so the decoded frames and the work images of the frame pass
+ * reuse a small set of buffers instead of requesting memory from the system
+ * for every frame.  Buffers of other sizes, such as those of masks,
+ * backgrounds and temporary images, are returned to the system when they are
+ * released.  Buffers are aligned to IMAGE_ALIGNMENT bytes.
+ *
+ * With OpenCV 2 the allocator interface is different and the pool is not
+ * used.
+ */
+void install_image_pool ();
+
+/**
+ * @brief reserve_pooled_images Add to the image pool the given number of new
+ * buffers with the given number of bytes, and as many image headers.
+ *
+ * A frame pass reserves the images it may hold at the same time before it
+ * starts, so they do not come from the buffers released by other frame passes.
+ * Nothing is reserved if the size is not given by a PooledImageSizes object.
+ */
+void reserve_pooled_images (size_t size, unsigned int count);
+
+/**
+ * @brief The CountImageAllocations class counts the times the image pool
+ * requests memory from the system for the images allocated by the current
+ * thread while it exists.
+ *
+ * Each frame pass counts its own allocations: the thread of the pass, the
+ * threads of its frame ranges and the threads of its frame readers count in
+ * the counter of the pass, so folders processed at the same time do not add
+ * to each other's counts.  The count does not change once the frame pass is in
+ * its steady state.
+ */
+class CountImageAllocations
+{
+public:
+	/**
+	 * @brief CountImageAllocations Count the allocations of the current thread
+	 * in the given counter, which may be NULL, until the object is destroyed.
+	 */
+	CountImageAllocations (std::atomic<size_t> *counter);
+	~CountImageAllocations ();
+	CountImageAllocations (const CountImageAllocations &) = delete;
+	CountImageAllocations &operator= (const CountImageAllocations &) = delete;
+	/**
+	 * @brief counter Return the counter of the current thread, or NULL if its
+	 * allocations are not counted.
+	 */
+	static std::atomic<size_t> *counter ();
+private:
+	std::atomic<size_t> *const previous;
+};
+
+/**
+ * @brief The PooledImageSizes class makes the image pool keep the released
+ * buffers with the given numbers of bytes while it exists.
+ *
+ * The frame pass of a folder pools the sizes of its frames, so the pool holds
+ * at most the peak number of frames alive at the same time in the folders
+ * being processed.  Folders processed at the same time may pool the same
+ * sizes, and when the last of them finishes the free buffers of those sizes
+ * are returned to the system.  Thus folders with different frame sizes do not
+ * accumulate buffers.
+ */
+class PooledImageSizes
+{
+public:
+	PooledImageSizes (const std::vector<size_t> &sizes);
+	~PooledImageSizes ();
+	PooledImageSizes (const PooledImageSizes &) = delete;
+	PooledImageSizes &operator= (const PooledImageSizes &) = delete;
+private:
+	const std::vector<size_t> sizes;
+};
+
+/**
+ * @brief The FrameRing class holds the last frames of a frame pass in a fixed
+ * set of images that are reused in turn.
+ *
+ * The ring has one image more than the number of previous frames it keeps.
+ * The current frame is written in that image, and method push turns it into
+ * the most recent previous frame, dropping the oldest one if the ring is full.
+ * The images are allocated when the ring is reset and keep their size, so the
+ * frames never allocate them.
+ */
+class FrameRing
+{
+public:
+	FrameRing ();
+	/**
+	 * @brief reset Empty the ring and make it keep the given number of previous
+	 * frames with the given size.
+	 */
+	void reset (unsigned int depth, const cv::Size &size);
+	/**
+	 * @brief depth Return the number of previous frames the ring keeps.
+	 */
+	unsigned int depth () const
+	{
+		return this->images.empty () ? 0 : this->images.size () - 1;
+	}
+	/**
+	 * @brief size Return the number of previous frames in the ring.
+	 */
+	unsigned int size () const
+	{
+		return this->number_frames;
+	}
+	/**
+	 * @brief current Return the image where the current frame is written.
+	 */
+	Image &current ()
+	{
+		return this->images [(this->first + this->number_frames) % this->images.size ()];
+	}
+	/**
+	 * @brief previous Return a previous frame.  Distance zero is the most
+	 * recent one.  The distance must be lower than the size of the ring.
+	 */
+	const Image &previous (unsigned int distance) const
+	{
+		return this->images [(this->first + this->number_frames - 1 - distance) % this->images.size ()];
+	}
+	/**
+	 * @brief push Make the current frame the most recent previous frame.
+	 */
+	void push ();
+private:
+	std::vector<Image> images;
+	/**
+	 * @brief first Index of the oldest previous frame.
+	 */
+	unsigned int first;
+	unsigned int number_frames;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include <boost/program_options.hpp>
 
 #include "experiment.hpp"
+#include "image_pool.hpp"
 #include "parameters.hpp"
 
 using namespace std;
@@ -11,6 +12,7 @@ static po::variables_map process_options (int argc, char *argv[]);
 
 int main (int argc, char *argv[])
 {
+	install_image_pool ();
 	po::variables_map vm = process_options (argc, argv);
 	Experiment experiment (vm);
 	experiment.process_data_plots_file ();
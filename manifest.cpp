@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "manifest.hpp"
+#include "parameters.hpp"
+
+using namespace std;
+
+const uint64_t HASH_OFFSET_BASIS = 14695981039346656037ULL;
+
+/**
+ * Version of the results.  Increase it when a change in the program changes
+ * the content of any result file, so that the results of older versions are
+ * computed again.
+ */
+static const uint32_t RESULTS_VERSION = 1;
+
+static uint64_t hash_image (uint64_t hash, const Image &image);
+
+Manifest::Manifest (const RunParameters &run_parameters, const UserParameters &user_parameters):
+   folder (user_parameters.folder),
+   filename (user_parameters.manifest_filename ()),
+   masks_hash (HASH_OFFSET_BASIS),
+   background_hash (hash_image (HASH_OFFSET_BASIS, user_parameters.background))
+{
+	if (!user_parameters.video.empty ())
+		this->frame_filenames.push_back (user_parameters.video_filename (run_parameters));
+	else
+		for (unsigned int index_frame = 1; index_frame <= run_parameters.number_frames; index_frame++)
+			this->frame_filenames.push_back (user_parameters.frame_filename (run_parameters, index_frame));
+	for (const Image &mask : user_parameters.masks)
+		this->masks_hash = hash_image (this->masks_hash, mask);
+	ifstream manifest (this->filename);
+	string line;
+	while (std::getline (manifest, line)) {
+		// the file name is the rest of the line, as it may have spaces
+		istringstream fields (line);
+		uint64_t hash;
+		unsigned int number_frames;
+		string name;
+		if (fields >> hex >> hash >> dec >> number_frames && fields.get () == ' ' && std::getline (fields, name) && !name.empty ())
+			this->entries [name] = {hash, number_frames};
+	}
+}
+
+uint64_t Manifest::inputs_hash (const RunParameters &run_parameters, unsigned int inputs, unsigned int number_frames) const
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	return this->hash_inputs (run_parameters, inputs, number_frames);
+}
+
+bool Manifest::up_to_date (const string &filename, uint64_t hash) const
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	map<string, Entry>::const_iterator entry = this->entries.find (this->key (filename));
+	return
+	      entry != this->entries.end () &&
+	      entry->second.hash == hash &&
+	      access (filename.c_str (), F_OK) == 0;
+}
+
+unsigned int Manifest::covered_frames (const string &filename, const RunParameters &run_parameters, unsigned int inputs) const
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	map<string, Entry>::const_iterator entry = this->entries.find (this->key (filename));
+	if (entry == this->entries.end () ||
+	    entry->second.number_frames > run_parameters.number_frames ||
+	    entry->second.hash != this->hash_inputs (run_parameters, inputs, entry->second.number_frames) ||
+	    access (filename.c_str (), F_OK) != 0)
+		return 0;
+	return entry->second.number_frames;
+}
+
+void Manifest::record (const string &filename, uint64_t hash, unsigned int number_frames)
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	this->entries [this->key (filename)] = {hash, number_frames};
+	this->save ();
+}
+
+void Manifest::remove (const string &filename)
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	if (this->entries.erase (this->key (filename)) > 0)
+		this->save ();
+}
+
+/**
+ * Hash the given inputs.  The caller holds the mutex, as the frames are hashed
+ * the first time.
+ */
+uint64_t Manifest::hash_inputs (const RunParameters &run_parameters, unsigned int inputs, unsigned int number_frames) const
+{
+	uint64_t result = HASH_OFFSET_BASIS;
+	result = hash_bytes (result, &RESULTS_VERSION, sizeof (RESULTS_VERSION));
+	result = hash_bytes (result, &inputs, sizeof (inputs));
+	if (inputs & FRAMES) {
+		if (this->frame_hashes.empty ())
+			for (const string &frame_filename : this->frame_filenames)
+				this->frame_hashes.push_back (hash_file_status (HASH_OFFSET_BASIS, frame_filename));
+		result = hash_bytes (result, &number_frames, sizeof (number_frames));
+		const size_t number_hashes = this->frame_hashes.size () == 1 ? 1 : number_frames;
+		result = hash_bytes (result, this->frame_hashes.data (), number_hashes * sizeof (uint64_t));
+	}
+	if (inputs & MASKS)
+		result = hash_bytes (result, &this->masks_hash, sizeof (this->masks_hash));
+	if (inputs & BACKGROUND)
+		result = hash_bytes (result, &this->background_hash, sizeof (this->background_hash));
+	if (inputs & SAME_COLOUR_THRESHOLD)
+		result = hash_bytes (result, &run_parameters.same_colour_threshold, sizeof (run_parameters.same_colour_threshold));
+	if (inputs & DELTA_FRAME)
+		result = hash_bytes (result, &run_parameters.delta_frame, sizeof (run_parameters.delta_frame));
+	if (inputs & DELTA_VELOCITY)
+		result = hash_bytes (result, &run_parameters.delta_velocity, sizeof (run_parameters.delta_velocity));
+	return result;
+}
+
+/**
+ * Result files are recorded by their name relative to the folder.
+ */
+string Manifest::key (const string &filename) const
+{
+	if (filename.compare (0, this->folder.size (), this->folder) == 0)
+		return filename.substr (this->folder.size ());
+	return filename;
+}
+
+void Manifest::save () const
+{
+	string temporary = this->filename + ".tmp";
+	FILE *f = fopen (temporary.c_str (), "w");
+	if (f == NULL) {
+		cerr << "Could not create manifest file " << temporary << "!\n";
+		exit (EXIT_FAILURE);
+	}
+	for (const pair<const string, Entry> &entry : this->entries)
+		fprintf (f, "%016llx %u %s\n", (unsigned long long) entry.second.hash, entry.second.number_frames, entry.first.c_str ());
+	if (fclose (f) != 0 || rename (temporary.c_str (), this->filename.c_str ()) != 0) {
+		cerr << "Could not write manifest file " << this->filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+/**
+ * FNV-1a hash of the given bytes.
+ */
+uint64_t hash_bytes (uint64_t hash, const void *bytes, size_t size)
+{
+	const unsigned char *b = (const unsigned char *) bytes;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= b [i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+uint64_t hash_file_status (uint64_t hash, const string &filename)
+{
+	struct stat status;
+	if (stat (filename.c_str (), &status) != 0) {
+		fprintf (stderr, "There is no such file: %s\n", filename.c_str ());
+		exit (EXIT_FAILURE);
+	}
+	hash = hash_bytes (hash, filename.c_str (), filename.size ());
+	int64_t values [3] = {(int64_t) status.st_size, (int64_t) status.st_mtim.tv_sec, (int64_t) status.st_mtim.tv_nsec};
+	return hash_bytes (hash, values, sizeof (values));
+}
+
+/**
+ * Hash the size, type and pixels of the given image.  The rows are hashed one
+ * by one, as the image may not be continuous.
+ */
+static uint64_t hash_image (uint64_t hash, const Image &image)
+{
+	int values [3] = {image.rows, image.cols, image.type ()};
+	hash = hash_bytes (hash, values, sizeof (values));
+	const size_t row_size = image.cols * image.elemSize ();
+	for (int row = 0; row < image.rows; row++)
+		hash = hash_bytes (hash, image.ptr (row), row_size);
+	return hash;
+}
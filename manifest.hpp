@@ -0,0 +1,133 @@
+#ifndef __MANIFEST__
+#define __MANIFEST__
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RunParameters;
+class UserParameters;
+
+/**
+ * @brief HASH_OFFSET_BASIS Initial value of the hashes computed by function
+ * hash_bytes.
+ */
+extern const uint64_t HASH_OFFSET_BASIS;
+
+/**
+ * @brief hash_bytes Update the given FNV-1a hash with the given bytes.
+ */
+uint64_t hash_bytes (uint64_t hash, const void *bytes, size_t size);
+
+/**
+ * @brief hash_file_status Update the given hash with the name, size and
+ * modification time of the given file.  The program exits if the file does not
+ * exist.
+ */
+uint64_t hash_file_status (uint64_t hash, const std::string &filename);
+
+/**
+ * @brief The Manifest class records which inputs each result file of a folder
+ * was computed from.
+ *
+ * For each result file, the manifest stores how many frames it covers and a
+ * hash of the inputs it depends on: those frames, the masks of the regions of
+ * interest, the background image, the parameters used to compute it, and the
+ * version of the results.  A result file is up to date only if it exists and
+ * its hash matches the hash of the current inputs, otherwise it is computed
+ * again.  If the hash matches the hash of the current inputs restricted to the
+ * frames the file covers, the file can be extended with the frames that were
+ * added since.
+ *
+ * The frames are hashed from the names, sizes and modification times of the
+ * frame files or of the video file, as in the frame cache.  As a video file
+ * changes when frames are added, only frame files can be extended.  The masks
+ * and the background image are hashed from their pixels.  The manifest is a
+ * text file in the folder, with one line per result file containing the hash,
+ * the number of frames and the file name relative to the folder.  It is
+ * written to a temporary file and renamed after every change, so it always
+ * describes files that were completely written.  The methods can be called by
+ * analysis stages that run at the same time.
+ */
+class Manifest
+{
+public:
+	/**
+	 * Inputs a result file may depend on, to be ORed in the argument of method
+	 * inputs_hash.
+	 */
+	enum Input {
+		FRAMES = 1,
+		MASKS = 2,
+		BACKGROUND = 4,
+		SAME_COLOUR_THRESHOLD = 8,
+		DELTA_FRAME = 16,
+		DELTA_VELOCITY = 32
+	};
+	/**
+	 * @brief Manifest Read the manifest of the given folder, and hash its masks
+	 * and background image.  The frames are hashed when a hash of inputs with
+	 * frames is first needed.  A missing manifest is empty.
+	 */
+	Manifest (const RunParameters &run_parameters, const UserParameters &user_parameters);
+	/**
+	 * @brief inputs_hash Return the hash of the given inputs, with the
+	 * parameters taken from the given run parameters, and the given number of
+	 * frames from the first one.
+	 */
+	uint64_t inputs_hash (const RunParameters &run_parameters, unsigned int inputs, unsigned int number_frames) const;
+	/**
+	 * @brief up_to_date Return whether the given result file exists and was
+	 * computed from inputs with the given hash.
+	 */
+	bool up_to_date (const std::string &filename, uint64_t hash) const;
+	/**
+	 * @brief covered_frames Return how many frames from the first one the given
+	 * result file covers, if it exists and was computed from the given inputs
+	 * restricted to those frames.  Otherwise return zero.
+	 */
+	unsigned int covered_frames (const std::string &filename, const RunParameters &run_parameters, unsigned int inputs) const;
+	/**
+	 * @brief record Record that the given result file covers the given number
+	 * of frames and was computed from inputs with the given hash.
+	 */
+	void record (const std::string &filename, uint64_t hash, unsigned int number_frames);
+	/**
+	 * @brief remove Remove the entry of the given result file, before it is
+	 * computed again.
+	 */
+	void remove (const std::string &filename);
+private:
+	struct Entry
+	{
+		uint64_t hash;
+		unsigned int number_frames;
+	};
+	const std::string folder;
+	const std::string filename;
+	/**
+	 * @brief frame_filenames Name of each frame file, or the name of the video
+	 * file.
+	 */
+	std::vector<std::string> frame_filenames;
+	/**
+	 * @brief frame_hashes Hash of each file in attribute frame_filenames, or
+	 * empty if the frames were not hashed yet.
+	 */
+	mutable std::vector<uint64_t> frame_hashes;
+	uint64_t masks_hash;
+	uint64_t background_hash;
+	std::map<std::string, Entry> entries;
+	/**
+	 * @brief mutex Serialises the access to the entries, to the frame hashes
+	 * and to the manifest file.
+	 */
+	mutable std::mutex mutex;
+	uint64_t hash_inputs (const RunParameters &run_parameters, unsigned int inputs, unsigned int number_frames) const;
+	std::string key (const std::string &filename) const;
+	void save () const;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <iostream>
+#include <sstream>
+
+#include "metrics.hpp"
+
+using namespace std;
+
+/**
+ * Name of each step of the frame pass in the JSON object.
+ */
+static const char *STEP_NAMES [Metrics::NUMBER_STEPS] = {
+	"decode",
+	"equalisation",
+	"histograms",
+	"counts",
+	"bee_speed",
+	"write"
+};
+
+static string json_string (const string &value);
+
+uint64_t metrics_clock ()
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t peak_rss ()
+{
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	// Linux reports kilobytes
+	return (uint64_t) usage.ru_maxrss * 1024;
+}
+
+Metrics::Metrics (const string &folder):
+   folder (folder),
+   start (metrics_clock ()),
+   step_nanoseconds (),
+   frame_pass_nanoseconds (0),
+   number_frames (0),
+   bytes_read (0),
+   steady_heap_allocations (0)
+{
+}
+
+void Metrics::add_stage (const string &description, const char *action, uint64_t nanoseconds, uint64_t bytes_read)
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	this->stages.push_back ({description, action, nanoseconds, bytes_read});
+	this->bytes_read += bytes_read;
+}
+
+void Metrics::add_frame_pass (const uint64_t *step_nanoseconds, unsigned int number_frames, uint64_t bytes_read, uint64_t steady_heap_allocations)
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	for (unsigned int step = 0; step < NUMBER_STEPS; step++) {
+		this->step_nanoseconds [step] += step_nanoseconds [step];
+		if (step != WRITE)
+			this->frame_pass_nanoseconds += step_nanoseconds [step];
+	}
+	this->number_frames += number_frames;
+	this->bytes_read += bytes_read;
+	this->steady_heap_allocations += steady_heap_allocations;
+}
+
+void Metrics::add_folder (const Metrics &folder)
+{
+	string object = folder.json ("    ");
+	lock_guard<std::mutex> lock (this->mutex);
+	lock_guard<std::mutex> folder_lock (folder.mutex);
+	for (unsigned int step = 0; step < NUMBER_STEPS; step++)
+		this->step_nanoseconds [step] += folder.step_nanoseconds [step];
+	this->frame_pass_nanoseconds += folder.frame_pass_nanoseconds;
+	this->number_frames += folder.number_frames;
+	this->bytes_read += folder.bytes_read;
+	this->steady_heap_allocations += folder.steady_heap_allocations;
+	for (const Stage &stage : folder.stages) {
+		vector<Stage>::iterator total = this->stages.begin ();
+		while (total != this->stages.end () && (total->description != stage.description || strcmp (total->action, stage.action) != 0))
+			total++;
+		if (total == this->stages.end ())
+			this->stages.push_back (stage);
+		else {
+			total->nanoseconds += stage.nanoseconds;
+			total->bytes_read += stage.bytes_read;
+		}
+	}
+	this->folders.push_back (object);
+}
+
+void Metrics::write (const string &filename) const
+{
+	string object = this->json ("");
+	FILE *f = fopen (filename.c_str (), "w");
+	if (f == NULL || fprintf (f, "%s\n", object.c_str ()) < 0 || fclose (f) != 0) {
+		cerr << "Could not write metrics file " << filename << "!\n";
+		exit (EXIT_FAILURE);
+	}
+}
+
+/**
+ * Format the metrics as a JSON object whose lines start with the given
+ * indentation.  The stages of a run are the stages of its folders summed by
+ * description and action.
+ */
+string Metrics::json (const string &indent) const
+{
+	lock_guard<std::mutex> lock (this->mutex);
+	const double wall_seconds = (metrics_clock () - this->start) / 1e9;
+	const double frame_pass_seconds = this->frame_pass_nanoseconds / 1e9;
+	ostringstream result;
+	result << "{\n";
+	if (!this->folder.empty ())
+		result << indent << "  \"folder\": " << json_string (this->folder) << ",\n";
+	result
+	      << indent << "  \"wall_seconds\": " << wall_seconds << ",\n"
+	      << indent << "  \"frames\": " << this->number_frames << ",\n"
+	      << indent << "  \"frame_pass_seconds\": " << frame_pass_seconds << ",\n"
+	      << indent << "  \"frames_per_second\": " << (frame_pass_seconds > 0 ? this->number_frames / frame_pass_seconds : 0) << ",\n"
+	      << indent << "  \"bytes_read\": " << this->bytes_read << ",\n"
+	      << indent << "  \"peak_rss_bytes\": " << peak_rss () << ",\n"
+	      << indent << "  \"frame_pass_steady_heap_allocations\": " << this->steady_heap_allocations << ",\n"
+	      << indent << "  \"frame_pass_steps_seconds\": {";
+	for (unsigned int step = 0; step < NUMBER_STEPS; step++)
+		result << (step == 0 ? "" : ",") << "\n" << indent << "    \"" << STEP_NAMES [step] << "\": " << this->step_nanoseconds [step] / 1e9;
+	result << "\n" << indent << "  },\n" << indent << "  \"stages\": [";
+	for (size_t index = 0; index < this->stages.size (); index++) {
+		const Stage &stage = this->stages [index];
+		result
+		      << (index == 0 ? "" : ",") << "\n"
+		      << indent << "    {\"description\": " << json_string (stage.description)
+		      << ", \"action\": \"" << stage.action << "\""
+		      << ", \"seconds\": " << stage.nanoseconds / 1e9
+		      << ", \"bytes_read\": " << stage.bytes_read << "}";
+	}
+	result << "\n" << indent << "  ]";
+	if (this->folder.empty ()) {
+		result << ",\n" << indent << "  \"folders\": [";
+		for (size_t index = 0; index < this->folders.size (); index++)
+			result << (index == 0 ? "" : ",") << "\n" << indent << "    " << this->folders [index];
+		result << "\n" << indent << "  ]";
+	}
+	result << "\n" << indent << "}";
+	return result.str ();
+}
+
+static string json_string (const string &value)
+{
+	string result = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\')
+			result += '\\';
+		if ((unsigned char) c < 0x20) {
+			char escape [8];
+			snprintf (escape, sizeof (escape), "\\u%04x", c);
+			result += escape;
+		}
+		else
+			result += c;
+	}
+	return result + "\"";
+}
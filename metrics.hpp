@@ -0,0 +1,94 @@
+#ifndef __METRICS__
+#define __METRICS__
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief metrics_clock Return the time of a monotonic clock in nanoseconds.
+ */
+uint64_t metrics_clock ();
+
+/**
+ * @brief peak_rss Return the peak resident set size of the process in bytes.
+ */
+uint64_t peak_rss ();
+
+/**
+ * @brief The Metrics class collects how long the analysis of a folder, or of a
+ * whole run, takes and where the time goes.
+ *
+ * The time of each analysis stage is measured once per stage.  The time of
+ * each step of the frame pass is accumulated per frame in the frame pass, and
+ * added when the pass ends, so the per frame cost is a few clock reads.  The
+ * metrics are written as a JSON object.  The methods can be called by stages
+ * that run at the same time.
+ */
+class Metrics
+{
+public:
+	/**
+	 * Steps of the frame pass.  DECODE is the time spent waiting for a decoded
+	 * frame, WRITE the time spent writing the histogram files after the pass.
+	 */
+	enum Step {
+		DECODE,
+		EQUALISATION,
+		HISTOGRAMS,
+		COUNTS,
+		BEE_SPEED,
+		WRITE,
+		NUMBER_STEPS
+	};
+	/**
+	 * @brief Metrics Start measuring the wall time of the given folder, or of
+	 * the run if the folder is empty.
+	 */
+	Metrics (const std::string &folder);
+	/**
+	 * @brief add_stage Add the time and bytes read of an analysis stage.
+	 */
+	void add_stage (const std::string &description, const char *action, uint64_t nanoseconds, uint64_t bytes_read);
+	/**
+	 * @brief add_frame_pass Add the time of each step of a frame pass, in
+	 * nanoseconds, how many frames it processed, how many bytes of frames it
+	 * read and how many times the image pool requested memory after its first
+	 * frames.
+	 */
+	void add_frame_pass (const uint64_t *step_nanoseconds, unsigned int number_frames, uint64_t bytes_read, uint64_t steady_heap_allocations);
+	/**
+	 * @brief add_folder Add the totals of the given folder metrics, and keep
+	 * its JSON object to be written with the run.
+	 */
+	void add_folder (const Metrics &folder);
+	/**
+	 * @brief write Write the metrics to the given JSON file.
+	 */
+	void write (const std::string &filename) const;
+private:
+	struct Stage
+	{
+		std::string description;
+		const char *action;
+		uint64_t nanoseconds;
+		uint64_t bytes_read;
+	};
+	const std::string folder;
+	const uint64_t start;
+	mutable std::mutex mutex;
+	uint64_t step_nanoseconds [NUMBER_STEPS];
+	uint64_t frame_pass_nanoseconds;
+	unsigned int number_frames;
+	uint64_t bytes_read;
+	uint64_t steady_heap_allocations;
+	std::vector<Stage> stages;
+	/**
+	 * @brief folders JSON objects of the folders of a run.
+	 */
+	std::vector<std::string> folders;
+	std::string json (const std::string &indent) const;
+};
+
+#endif
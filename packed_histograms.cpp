@@ -0,0 +1,174 @@
+#include <string.h>
+#include <iostream>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "packed_histograms.hpp"
+#include "image.hpp"
+
+using namespace std;
+
+const unsigned int PACKED_BLOCK_FRAMES = 32;
+
+/**
+ * Number of bins encoded together, one per SIMD lane.
+ */
+static const unsigned int PACKED_LANES = 4;
+
+#if defined (DEBUG) || !defined (__SSE2__)
+static void decode_block_reference (const unsigned char *data, unsigned int width, uint32_t *running, uint32_t *values);
+#endif
+
+static void decode_block (const unsigned char *data, unsigned int width, uint32_t *running, uint32_t *values);
+
+static inline uint32_t zigzag (uint32_t difference)
+{
+	return (difference << 1) ^ (uint32_t) ((int32_t) difference >> 31);
+}
+
+static inline uint32_t unzigzag (uint32_t value)
+{
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+void encode_packed_histograms (const uint32_t *counts, unsigned int number_frames, unsigned int histograms_per_frame, vector<unsigned char> &result)
+{
+	const size_t frame_size = (size_t) histograms_per_frame * NUMBER_COLOUR_LEVELS;
+	uint32_t values [PACKED_BLOCK_FRAMES * PACKED_LANES];
+	uint32_t words [32 * PACKED_LANES];
+	for (size_t column = 0; column < frame_size; column += PACKED_LANES) {
+		uint32_t previous [PACKED_LANES] = {0};
+		for (unsigned int first_frame = 0; first_frame < number_frames; first_frame += PACKED_BLOCK_FRAMES) {
+			uint32_t all_bits = 0;
+			for (unsigned int j = 0; j < PACKED_BLOCK_FRAMES; j++)
+				for (unsigned int lane = 0; lane < PACKED_LANES; lane++) {
+					// frames after the last one repeat it, so their difference is zero
+					uint32_t count = first_frame + j < number_frames ? counts [(first_frame + j) * frame_size + column + lane] : previous [lane];
+					values [j * PACKED_LANES + lane] = zigzag (count - previous [lane]);
+					all_bits |= values [j * PACKED_LANES + lane];
+					previous [lane] = count;
+				}
+			const unsigned int width = all_bits == 0 ? 0 : 32 - __builtin_clz (all_bits);
+			memset (words, 0, width * PACKED_LANES * sizeof (uint32_t));
+			for (unsigned int j = 0; j < PACKED_BLOCK_FRAMES; j++) {
+				const unsigned int position = j * width;
+				const unsigned int word = position / 32;
+				const unsigned int shift = position % 32;
+				for (unsigned int lane = 0; lane < PACKED_LANES; lane++) {
+					const uint32_t value = values [j * PACKED_LANES + lane];
+					words [word * PACKED_LANES + lane] |= value << shift;
+					if (shift + width > 32)
+						words [(word + 1) * PACKED_LANES + lane] |= value >> (32 - shift);
+				}
+			}
+			result.push_back (width);
+			const unsigned char *bytes = (const unsigned char *) words;
+			result.insert (result.end (), bytes, bytes + width * PACKED_LANES * sizeof (uint32_t));
+		}
+	}
+}
+
+bool decode_packed_histograms (const unsigned char *data, size_t size, unsigned int number_frames, unsigned int histograms_per_frame, uint32_t *counts)
+{
+	const size_t frame_size = (size_t) histograms_per_frame * NUMBER_COLOUR_LEVELS;
+	const unsigned char *end = data + size;
+	uint32_t values [PACKED_BLOCK_FRAMES * PACKED_LANES];
+	for (size_t column = 0; column < frame_size; column += PACKED_LANES) {
+		uint32_t running [PACKED_LANES] = {0};
+		for (unsigned int first_frame = 0; first_frame < number_frames; first_frame += PACKED_BLOCK_FRAMES) {
+			if (data == end || *data > 32 || (size_t) (end - data - 1) < *data * PACKED_LANES * sizeof (uint32_t))
+				return false;
+			const unsigned int width = *data;
+#ifdef DEBUG
+			uint32_t expected_running [PACKED_LANES];
+			uint32_t expected [PACKED_BLOCK_FRAMES * PACKED_LANES];
+			memcpy (expected_running, running, sizeof (running));
+			decode_block_reference (data + 1, width, expected_running, expected);
+#endif
+			decode_block (data + 1, width, running, values);
+#ifdef DEBUG
+			if (memcmp (expected, values, sizeof (values)) != 0) {
+				cerr << "The histogram decoding kernel does not match its reference implementation!\n";
+				exit (EXIT_FAILURE);
+			}
+#endif
+			data += 1 + width * PACKED_LANES * sizeof (uint32_t);
+			const unsigned int number_values = min (PACKED_BLOCK_FRAMES, number_frames - first_frame);
+			for (unsigned int j = 0; j < number_values; j++)
+				memcpy (counts + (first_frame + j) * frame_size + column, values + j * PACKED_LANES, PACKED_LANES * sizeof (uint32_t));
+		}
+	}
+	return data == end;
+}
+
+#if defined (DEBUG) || !defined (__SSE2__)
+/**
+ * Reference implementation of the block decoding kernel.  The values of each
+ * lane are unpacked, turned back into differences and added to the running
+ * count of the lane.
+ */
+static void decode_block_reference (const unsigned char *data, unsigned int width, uint32_t *running, uint32_t *values)
+{
+	const uint32_t mask = width == 32 ? 0xFFFFFFFF : ((uint32_t) 1 << width) - 1;
+	for (unsigned int j = 0; j < PACKED_BLOCK_FRAMES; j++) {
+		const unsigned int position = j * width;
+		const unsigned int word = position / 32;
+		const unsigned int shift = position % 32;
+		for (unsigned int lane = 0; lane < PACKED_LANES; lane++) {
+			uint32_t value = 0;
+			if (width > 0) {
+				uint32_t low, high;
+				memcpy (&low, data + (word * PACKED_LANES + lane) * sizeof (uint32_t), sizeof (uint32_t));
+				value = low >> shift;
+				if (shift + width > 32) {
+					memcpy (&high, data + ((word + 1) * PACKED_LANES + lane) * sizeof (uint32_t), sizeof (uint32_t));
+					value |= high << (32 - shift);
+				}
+				value &= mask;
+			}
+			running [lane] += unzigzag (value);
+			values [j * PACKED_LANES + lane] = running [lane];
+		}
+	}
+}
+#endif
+
+#ifdef __SSE2__
+/**
+ * Vectorised block decoding kernel.  The four lanes are unpacked, decoded and
+ * accumulated at the same time, with shifts by a variable count.
+ */
+static void decode_block (const unsigned char *data, unsigned int width, uint32_t *running, uint32_t *values)
+{
+	__m128i sum = _mm_loadu_si128 ((const __m128i *) running);
+	if (width == 0) {
+		for (unsigned int j = 0; j < PACKED_BLOCK_FRAMES; j++)
+			_mm_storeu_si128 ((__m128i *) (values + j * PACKED_LANES), sum);
+		return ;
+	}
+	const __m128i mask = _mm_set1_epi32 (width == 32 ? -1 : (int) (((uint32_t) 1 << width) - 1));
+	const __m128i one = _mm_set1_epi32 (1);
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i *words = (const __m128i *) data;
+	for (unsigned int j = 0; j < PACKED_BLOCK_FRAMES; j++) {
+		const unsigned int position = j * width;
+		const unsigned int word = position / 32;
+		const unsigned int shift = position % 32;
+		__m128i value = _mm_srl_epi32 (_mm_loadu_si128 (words + word), _mm_cvtsi32_si128 (shift));
+		if (shift + width > 32)
+			value = _mm_or_si128 (value, _mm_sll_epi32 (_mm_loadu_si128 (words + word + 1), _mm_cvtsi32_si128 (32 - shift)));
+		value = _mm_and_si128 (value, mask);
+		__m128i difference = _mm_xor_si128 (_mm_srli_epi32 (value, 1), _mm_sub_epi32 (zero, _mm_and_si128 (value, one)));
+		sum = _mm_add_epi32 (sum, difference);
+		_mm_storeu_si128 ((__m128i *) (values + j * PACKED_LANES), sum);
+	}
+	_mm_storeu_si128 ((__m128i *) running, sum);
+}
+#else
+static void decode_block (const unsigned char *data, unsigned int width, uint32_t *running, uint32_t *values)
+{
+	decode_block_reference (data, width, running, values);
+}
+#endif
@@ -0,0 +1,51 @@
+#ifndef __PACKED_HISTOGRAMS__
+#define __PACKED_HISTOGRAMS__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Compressed encoding of the counts of a vector of histograms, used by the
+ * binary histogram files.
+ *
+ * The counts are a matrix with one row per frame and, in each row, the bins of
+ * every histogram of the frame.  The encoding is columnar: every bin is seen
+ * as a series over time, and four adjacent bins of the same histogram are
+ * encoded together, one per 32 bit lane.  Each series is replaced by the
+ * differences between consecutive frames, mapped to unsigned values with
+ * zigzag encoding, so that small changes of either sign become small numbers.
+ * The values are then bit packed in blocks of PACKED_BLOCK_FRAMES frames.  A
+ * block starts with a byte with the number of bits of its largest value,
+ * followed by the values of the four lanes interleaved word by word, so a
+ * block is decoded with four lane SIMD shifts and additions.  The high bins of
+ * difference images are almost always zero, and their blocks take a single
+ * byte.
+ *
+ * Differences are computed modulo 2^32, so any count, including the
+ * UINT32_MAX of undefined histograms, is encoded without loss.
+ */
+
+/**
+ * @brief PACKED_BLOCK_FRAMES Number of frames in a block.
+ */
+extern const unsigned int PACKED_BLOCK_FRAMES;
+
+/**
+ * @brief encode_packed_histograms Append the encoding of the given counts to
+ * a buffer.
+ *
+ * @param counts Matrix with number_frames rows of histograms_per_frame
+ * histograms with NUMBER_COLOUR_LEVELS bins.
+ */
+void encode_packed_histograms (const uint32_t *counts, unsigned int number_frames, unsigned int histograms_per_frame, std::vector<unsigned char> &result);
+
+/**
+ * @brief decode_packed_histograms Decode counts encoded by
+ * encode_packed_histograms.
+ *
+ * @return false if the data is truncated or invalid.
+ */
+bool decode_packed_histograms (const unsigned char *data, size_t size, unsigned int number_frames, unsigned int histograms_per_frame, uint32_t *counts);
+
+#endif
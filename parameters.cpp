@@ -17,14 +17,22 @@ static vector<cv::Mat> read_masks (const RunParameters &run_parameters, const Us
 #define PO_BACKGROUND_FILENAME "background-filename"
 #define PO_NUMBER_ROIs "number-ROIs"
 #define PO_DELTA_FRAME "delta-frame"
+#define PO_DELTA_FRAMES_SWEEP "delta-frames-sweep"
 #define PO_NUMBER_FRAMES "number-frames"
 #define PO_SAME_COLOUR_THRESHOLD "same-colour-threshold"
+#define PO_SAME_COLOUR_THRESHOLDS_SWEEP "same-colour-thresholds-sweep"
 #define PO_DELTA_VELOCITY "delta-velocity"
 #define PO_MASK_NUMBER_STARTS_AT_0 "mask-number-starts-at-0"
 #define PO_FRAME_FILENAME_PREFIX "frame-filename-prefix"
 #define PO_SUBFOLDER_FRAMES "subfolder-frames"
 #define PO_SUBFOLDER_BACKGROUND "subfolder-background"
 #define PO_SUBFOLDER_MASK "subfolder-mask"
+#define PO_DECODE_THREADS "decode-threads"
+#define PO_PREFETCH_DEPTH "prefetch-depth"
+#define PO_JOBS "jobs"
+#define PO_MEMORY_BUDGET "memory-budget"
+#define PO_FRAME_SHARDS "frame-shards"
+#define PO_FRAME_CACHE "frame-cache"
 
 
 RunParameters::RunParameters (const po::variables_map &vm):
@@ -34,15 +42,52 @@ RunParameters::RunParameters (const po::variables_map &vm):
    background_filename (vm [PO_BACKGROUND_FILENAME].as<string> ()),
    number_ROIs (vm [PO_NUMBER_ROIs].as<unsigned int> ()),
    delta_frame (vm [PO_DELTA_FRAME].as<unsigned int> ()),
+   delta_frames_sweep (vm.count (PO_DELTA_FRAMES_SWEEP) > 0 ? vm [PO_DELTA_FRAMES_SWEEP].as<vector<unsigned int> > () : vector<unsigned int> ()),
    number_frames (vm [PO_NUMBER_FRAMES].as<unsigned int> ()),
    same_colour_threshold (vm [PO_SAME_COLOUR_THRESHOLD].as<unsigned int> ()),
    same_colour_level (round ((NUMBER_COLOUR_LEVELS * same_colour_threshold) / 100.0)),
+   same_colour_thresholds_sweep (vm.count (PO_SAME_COLOUR_THRESHOLDS_SWEEP) > 0 ? vm [PO_SAME_COLOUR_THRESHOLDS_SWEEP].as<vector<unsigned int> > () : vector<unsigned int> ()),
    delta_velocity (vm [PO_DELTA_VELOCITY].as<unsigned int> ()),
    mask_number_starts_at_0 (vm.count (PO_MASK_NUMBER_STARTS_AT_0) > 0),
    frame_filename_prefix (vm [PO_FRAME_FILENAME_PREFIX].as<string> ()),
    subfolder_frames (verify_slash_at_end (vm [PO_SUBFOLDER_FRAMES].as<string> ())),
    subfolder_background (verify_slash_at_end (vm [PO_SUBFOLDER_BACKGROUND].as<string> ())),
-   subfolder_mask (verify_slash_at_end (vm [PO_SUBFOLDER_MASK].as<string> ()))
+   subfolder_mask (verify_slash_at_end (vm [PO_SUBFOLDER_MASK].as<string> ())),
+   decode_threads (vm [PO_DECODE_THREADS].as<unsigned int> ()),
+   prefetch_depth (vm [PO_PREFETCH_DEPTH].as<unsigned int> ()),
+   jobs (vm [PO_JOBS].as<unsigned int> ()),
+   memory_budget (vm [PO_MEMORY_BUDGET].as<size_t> () * 1024 * 1024),
+   frame_shards (vm [PO_FRAME_SHARDS].as<unsigned int> ()),
+   use_frame_cache (vm.count (PO_FRAME_CACHE) > 0),
+   show_progress (jobs <= 1 && frame_shards <= 1)
+{
+}
+
+RunParameters::RunParameters (const RunParameters &parameters, unsigned int same_colour_threshold, unsigned int delta_frame, bool show_progress):
+   csv_filename (parameters.csv_filename),
+   frame_file_type (parameters.frame_file_type),
+   mask_file_type (parameters.mask_file_type),
+   background_filename (parameters.background_filename),
+   number_ROIs (parameters.number_ROIs),
+   delta_frame (delta_frame),
+   delta_frames_sweep (),
+   number_frames (parameters.number_frames),
+   same_colour_threshold (same_colour_threshold),
+   same_colour_level (round ((NUMBER_COLOUR_LEVELS * same_colour_threshold) / 100.0)),
+   same_colour_thresholds_sweep (),
+   delta_velocity (parameters.delta_velocity),
+   mask_number_starts_at_0 (parameters.mask_number_starts_at_0),
+   frame_filename_prefix (parameters.frame_filename_prefix),
+   subfolder_frames (parameters.subfolder_frames),
+   subfolder_background (parameters.subfolder_background),
+   subfolder_mask (parameters.subfolder_mask),
+   decode_threads (parameters.decode_threads),
+   prefetch_depth (parameters.prefetch_depth),
+   jobs (parameters.jobs),
+   memory_budget (parameters.memory_budget),
+   frame_shards (parameters.frame_shards),
+   use_frame_cache (parameters.use_frame_cache),
+   show_progress (parameters.show_progress && show_progress)
 {
 }
 
@@ -55,7 +100,7 @@ po::options_description RunParameters::program_options ()
 	         po::value<string> ()
 	         ->default_value ("data-analyse.csv")
 	         ->value_name ("FILENAME"),
-	         "CSV file with data of which folders to analyse"
+	         "CSV file with data of which folders to analyse, one folder per row with cells: folder, x1, y1, x2, y2, use and optionally a video file (relative to the frames folder) to read the frames from"
 	         )
 	      (
 	         PO_NUMBER_ROIs",r",
@@ -82,6 +127,13 @@ po::options_description RunParameters::program_options ()
 	         ->value_name ("D"),
 	         "how many frames apart are used when computing bee movement"
 	         )
+	      (
+	         PO_DELTA_FRAMES_SWEEP,
+	         po::value<vector<unsigned int> > ()
+	         ->multitoken ()
+	         ->value_name ("D..."),
+	         "other values of frames apart for which bee movement and the features are computed, in the same pass over the frames"
+	         )
 	      (
 	         PO_SAME_COLOUR_THRESHOLD",c",
 	         po::value<unsigned int> ()
@@ -89,6 +141,13 @@ po::options_description RunParameters::program_options ()
 	         ->value_name ("PERC"),
 	         "threshold value used when deciding if two colour intensities are equal, percentage value"
 	         )
+	      (
+	         PO_SAME_COLOUR_THRESHOLDS_SWEEP,
+	         po::value<vector<unsigned int> > ()
+	         ->multitoken ()
+	         ->value_name ("PERC..."),
+	         "other threshold values for which the features are computed, reusing the histograms computed or read for the main threshold value"
+	         )
 	      (
 	         PO_DELTA_VELOCITY",v",
 	         po::value<unsigned int> ()
@@ -155,23 +214,79 @@ po::options_description RunParameters::program_options ()
 	         "file name of the background image"
 	         )
 	      ;
+	po::options_description performance ("Options that affect performance but not the analysis results");
+	performance.add_options ()
+	      (
+	         PO_DECODE_THREADS,
+	         po::value<unsigned int> ()
+	         ->default_value (2)
+	         ->value_name ("N"),
+	         "how many threads decode video frames ahead of the analysis (zero decodes frames when they are needed)"
+	         )
+	      (
+	         PO_PREFETCH_DEPTH,
+	         po::value<unsigned int> ()
+	         ->default_value (8)
+	         ->value_name ("N"),
+	         "how many decoded video frames can be waiting to be analysed"
+	         )
+	      (
+	         PO_JOBS",j",
+	         po::value<unsigned int> ()
+	         ->default_value (1)
+	         ->value_name ("N"),
+	         "how many folders are processed at the same time"
+	         )
+	      (
+	         PO_MEMORY_BUDGET,
+	         po::value<size_t> ()
+	         ->default_value (0)
+	         ->value_name ("MB"),
+	         "upper bound of the estimated memory used by the folders processed at the same time, zero means no bound"
+	         )
+	      (
+	         PO_FRAME_SHARDS,
+	         po::value<unsigned int> ()
+	         ->default_value (1)
+	         ->value_name ("N"),
+	         "in how many contiguous frame ranges the frames of a folder are split, each range is processed by its own thread"
+	         )
+	      (
+	         PO_FRAME_CACHE,
+	         "keep the decoded frames and their histogram equalisation lookup tables in a file per folder, and read frames from it in later runs"
+	         )
+	      ;
 	po::options_description result;
 	result.add (config);
 	result.add (analysis);
 	result.add (logistic);
+	result.add (performance);
 	return result;
 }
 
-UserParameters::UserParameters (const RunParameters &run_parameters, const string &folder, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, bool use):
+UserParameters::UserParameters (const RunParameters &run_parameters, const string &folder, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, bool use, const string &video):
    folder (verify_slash_at_end (folder)),
    x1 (x1),
    y1 (y1),
    x2 (x2),
    y2 (y2),
    use (use),
+   video (video),
    background (read_image (this->background_filename (run_parameters))),
-   masks (use ? read_masks (run_parameters, *this) : std::vector<Image> ())
+   masks (use ? read_masks (run_parameters, *this) : std::vector<Image> ()),
+   ROIs_bounding_box (compute_masks_bounding_box (this->masks, this->background.cols, this->background.rows)),
+   ROI_labels (this->masks, this->ROIs_bounding_box),
+   frame_cache (NULL),
+   manifest (NULL),
+   metrics (NULL)
+{
+}
+
+UserParameters::~UserParameters ()
 {
+	delete this->frame_cache;
+	delete this->manifest;
+	delete this->metrics;
 }
 
 UserParameters *UserParameters::parse (const RunParameters &run_parameters, const string &csv_row)
@@ -182,13 +297,16 @@ UserParameters *UserParameters::parse (const RunParameters &run_parameters, cons
 	while (std::getline (lineStream, cell, ',')) {
 		cs.push_back (cell);
 	}
-	if (cs.size () != 6) {
-		cerr << "The number of cells is different from 6!\n";
+	if (cs.size () != 6 && cs.size () != 7) {
+		cerr << "The number of cells is different from 6 or 7!\n";
 		exit (EXIT_FAILURE);
 	}
 	std::string folder = cs [0];
 	folder = folder.substr (1, folder.size () - 2);
-	return new UserParameters (run_parameters, folder, std::stoi (cs [1]), std::stoi (cs [2]), std::stoi (cs [3]), std::stoi (cs [4]), cs [5] == "1" || cs [5] == "true");
+	std::string video = cs.size () == 7 ? cs [6] : "";
+	if (video.size () > 1 && video [0] == '"')
+		video = video.substr (1, video.size () - 2);
+	return new UserParameters (run_parameters, folder, std::stoi (cs [1]), std::stoi (cs [2]), std::stoi (cs [3]), std::stoi (cs [4]), cs [5] == "1" || cs [5] == "true", video);
 }
 
 static string verify_slash_at_end (const string &folder)
@@ -7,6 +7,11 @@
 #include <boost/program_options.hpp>
 
 #include "image.hpp"
+#include "frame_reader.hpp"
+#include "frame_cache.hpp"
+#include "manifest.hpp"
+#include "metrics.hpp"
+#include "roi_labels.hpp"
 
 /**
  * @brief The RunParameters class represents parameters used in an experiment
@@ -21,26 +26,93 @@ public:
 	const std::string background_filename;
 	const unsigned int number_ROIs;
 	const unsigned int delta_frame;
+	/**
+	 * @brief delta_frames_sweep Other delta frame values for which bee movement
+	 * is computed in the same pass over the frames.
+	 */
+	const std::vector<unsigned int> delta_frames_sweep;
 	const unsigned int number_frames;
 	const unsigned int same_colour_threshold;
 	const unsigned int same_colour_level;
+	/**
+	 * @brief same_colour_thresholds_sweep Other same colour thresholds for which
+	 * the features are computed from the same histograms.
+	 */
+	const std::vector<unsigned int> same_colour_thresholds_sweep;
 	const unsigned int delta_velocity;
 	const bool mask_number_starts_at_0;
 	const std::string frame_filename_prefix;
 	const std::string subfolder_frames;
 	const std::string subfolder_background;
 	const std::string subfolder_mask;
+	/**
+	 * @brief decode_threads How many threads decode video frames ahead of the
+	 * analysis.
+	 */
+	const unsigned int decode_threads;
+	/**
+	 * @brief prefetch_depth How many decoded video frames can be waiting to be
+	 * analysed.
+	 */
+	const unsigned int prefetch_depth;
+	/**
+	 * @brief jobs How many folders are processed at the same time.
+	 */
+	const unsigned int jobs;
+	/**
+	 * @brief memory_budget Upper bound, in bytes, of the estimated memory used
+	 * by the folders that are processed at the same time.  Zero means there is
+	 * no bound.
+	 */
+	const size_t memory_budget;
+	/**
+	 * @brief frame_shards In how many contiguous frame ranges the frames of a
+	 * folder are split.  Each range is processed by its own thread.
+	 */
+	const unsigned int frame_shards;
+	/**
+	 * @brief use_frame_cache Whether video frames are read from a per folder
+	 * cache of decoded frames.
+	 */
+	const bool use_frame_cache;
+	/**
+	 * @brief show_progress Whether method print_progress shows anything.
+	 * Nothing is shown if several folders, frame ranges or analysis stages are
+	 * processed at the same time.
+	 */
+	const bool show_progress;
 	RunParameters (const boost::program_options::variables_map &vm);
+	/**
+	 * @brief RunParameters Copy the given parameters with another same colour
+	 * threshold and delta frame, and no sweeps.  Progress is only shown if it
+	 * is shown with the given parameters and argument show_progress is true.
+	 */
+	RunParameters (const RunParameters &parameters, unsigned int same_colour_threshold, unsigned int delta_frame, bool show_progress);
 	static boost::program_options::options_description program_options ();
+	/**
+	 * @brief print_progress Show how many frames have been processed, if
+	 * attribute show_progress is true.
+	 */
+	inline void print_progress (unsigned int count) const
+	{
+		if (this->show_progress) {
+			fprintf (stdout, "\r      %d", count);
+			fflush (stdout);
+		}
+	}
+	inline void end_progress () const
+	{
+		if (this->show_progress)
+			fprintf (stdout, "\n");
+	}
 	template<typename A, typename B, typename C>
 	inline void fold3_frames (void (*func) (unsigned int, A, B, C), A acc1, B acc2, C acc3) const
 	{
 		for (unsigned int index_frame = 0; index_frame < this->number_frames; index_frame++) {
 			func (index_frame, acc1, acc2, acc3);
-			fprintf (stdout, "\r      %d", index_frame + 1);
-			fflush (stdout);
+			this->print_progress (index_frame + 1);
 		}
-		fprintf (stdout, "\n");
+		this->end_progress ();
 	}
 	template<typename A, typename B>
 	inline void fold2_frames_ROIs (void (*func) (unsigned int, unsigned int, A, B), A acc1, B acc2) const
@@ -49,10 +121,9 @@ public:
 			for (unsigned int index_mask = 0; index_mask < this->number_ROIs; index_mask++) {
 				func (index_frame, index_mask, acc1, acc2);
 			}
-			fprintf (stdout, "\r      %d", index_frame + 1);
-			fflush (stdout);
+			this->print_progress (index_frame + 1);
 		}
-		fprintf (stdout, "\n");
+		this->end_progress ();
 	}
 	template<typename A, typename B, typename C>
 	inline void fold3_frames_ROIs (void (*func) (unsigned int, unsigned int, A, B, C), A acc1, B acc2, C acc3) const
@@ -61,10 +132,9 @@ public:
 			for (unsigned int index_mask = 0; index_mask < this->number_ROIs; index_mask++) {
 				func (index_frame, index_mask, acc1, acc2, acc3);
 			}
-			fprintf (stdout, "\r      %d", index_frame + 1);
-			fflush (stdout);
+			this->print_progress (index_frame + 1);
 		}
-		fprintf (stdout, "\n");
+		this->end_progress ();
 	}
 };
 
@@ -91,7 +161,7 @@ class UserParameters
 		      std::to_string (this->x1) + "x" + std::to_string (this->y1) + "-" +
 		      std::to_string (this->x2) + "x" + std::to_string (this->y2);
 	}
-	UserParameters (const RunParameters &run_parameters, const std::string &folder, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, bool use);
+	UserParameters (const RunParameters &run_parameters, const std::string &folder, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, bool use, const std::string &video);
 public:
 	/**
 	 * @brief folder Contains the folder where the data of a particular run of an
@@ -109,8 +179,50 @@ public:
 	const unsigned int x2;
 	const unsigned int y2;
 	const bool use;
+	/**
+	 * @brief video Filename of the video file with the frames.  If it is empty,
+	 * frames are read from image files, one per frame.
+	 */
+	const std::string video;
 	const Image background;
 	const std::vector<Image> masks;
+	/**
+	 * @brief ROIs_bounding_box The bounding rectangle of the ORed masks of the
+	 * regions of interest.
+	 *
+	 * The masks given by the fold*_ROIs methods are cropped to this rectangle,
+	 * and so are the background image and the frames in the frame pass, so
+	 * that the difference images and their histograms are computed on the
+	 * smallest region that contains every region of interest.
+	 *
+	 * Histogram equalisation still uses the statistics of the whole frame, as
+	 * the equalised colour of a pixel depends on the colour distribution of the
+	 * entire image.  Frames are therefore still decoded in full.
+	 *
+	 * If the masks are empty, this is the entire frame.
+	 */
+	const cv::Rect ROIs_bounding_box;
+	/**
+	 * @brief ROI_labels The masks of the regions of interest compiled in a label
+	 * image with the size of ROIs_bounding_box.
+	 */
+	const ROILabels ROI_labels;
+	/**
+	 * @brief frame_cache Cache of decoded video frames, or NULL if frames are
+	 * decoded from their source.
+	 */
+	FrameCache *frame_cache;
+	/**
+	 * @brief manifest Hashes of the inputs of the result files of the folder,
+	 * or NULL if the folder is not being processed.
+	 */
+	Manifest *manifest;
+	/**
+	 * @brief metrics Time and resources used to process the folder, or NULL if
+	 * they are not collected.
+	 */
+	Metrics *metrics;
+	~UserParameters ();
 	static UserParameters *parse (const RunParameters &, const std::string &csv_row);
 	inline std::string background_filename (const RunParameters &parameters) const
 	{
@@ -126,6 +238,22 @@ public:
 		result += parameters.frame_file_type;
 		return result;
 	}
+	inline std::string video_filename (const RunParameters &parameters) const
+	{
+		return this->folder + parameters.subfolder_frames + this->video;
+	}
+	inline std::string frame_cache_filename () const
+	{
+		return this->folder + "frames-cache.bin";
+	}
+	inline std::string manifest_filename () const
+	{
+		return this->folder + "results-manifest.txt";
+	}
+	inline std::string metrics_filename () const
+	{
+		return this->folder + "metrics.json";
+	}
 	inline std::string mask_filename (const RunParameters &parameters, int index_mask) const
 	{
 		return this->folder + parameters.subfolder_mask + "Mask-" + std::to_string (index_mask + (parameters.mask_number_starts_at_0 ? 0 : 1)) + "." + parameters.mask_file_type;
@@ -354,54 +482,55 @@ public:
 	template<typename A, typename B>
 	inline void fold2_frames (const RunParameters &parameters, void (*func) (const Image &, A, B), A acc1, B acc2) const
 	{
-		for (unsigned int index_frame = 1; index_frame <= parameters.number_frames; index_frame++) {
-			std::string filename = this->frame_filename (parameters, index_frame);
-			Image frame = read_image (filename);
+		this->fold2_frames (parameters, 1, parameters.number_frames, func, acc1, acc2);
+	}
+	template<typename A, typename B>
+	inline void fold2_frames (const RunParameters &parameters, unsigned int first_frame, unsigned int last_frame, void (*func) (const Image &, A, B), A acc1, B acc2) const
+	{
+		FrameReader reader (parameters, *this, first_frame, last_frame);
+		for (unsigned int index_frame = first_frame; index_frame <= last_frame; index_frame++) {
+			const Image &frame = reader.next ();
 			func (frame, acc1, acc2);
-			fprintf (stdout, "\r      %d", index_frame);
-			fflush (stdout);
+			parameters.print_progress (index_frame);
 		}
-		fprintf (stdout, "\n");
+		parameters.end_progress ();
 	}
 	template<typename A, typename B, typename C>
 	inline void fold3_frames (const RunParameters &parameters, void (*func) (const Image &, A, B, C), A acc1, B acc2, C acc3) const
 	{
+		FrameReader reader (parameters, *this);
 		for (unsigned int index_frame = 1; index_frame <= parameters.number_frames; index_frame++) {
-			std::string filename = this->frame_filename (parameters, index_frame);
-			Image frame = read_image (filename);
+			const Image &frame = reader.next ();
 			func (frame, acc1, acc2, acc3);
-			fprintf (stdout, "\r      %d", index_frame);
-			fflush (stdout);
+			parameters.print_progress (index_frame);
 		}
-		fprintf (stdout, "\n");
+		parameters.end_progress ();
 	}
 	template<typename A, typename B, typename C, typename D>
 	inline void fold4_frames (const RunParameters &parameters, void (*func) (const Image &, A, B, C, D), A acc1, B acc2, C acc3, D acc4) const
 	{
+		FrameReader reader (parameters, *this);
 		for (unsigned int index_frame = 1; index_frame <= parameters.number_frames; index_frame++) {
-			std::string filename = this->frame_filename (parameters, index_frame);
-			Image frame = read_image (filename);
+			const Image &frame = reader.next ();
 			func (frame, acc1, acc2, acc3, acc4);
-			fprintf (stdout, "\r      %d", index_frame);
-			fflush (stdout);
+			parameters.print_progress (index_frame);
 		}
-		fprintf (stdout, "\n");
+		parameters.end_progress ();
 	}
 	template<typename A, typename B, typename C, typename D>
 	inline void fold4_frames_I (const RunParameters &parameters, void (*func) (unsigned int, A, B, C, D), A acc1, B acc2, C acc3, D acc4) const
 	{
 		for (unsigned int index_frame = 0; index_frame < parameters.number_frames; index_frame++) {
 			func (index_frame, acc1, acc2, acc3, acc4);
-			fprintf (stdout, "\r      %d", index_frame + 1);
-			fflush (stdout);
+			parameters.print_progress (index_frame + 1);
 		}
-		fprintf (stdout, "\n");
+		parameters.end_progress ();
 	}
 	template<typename A>
 	inline void fold1_ROIs (void (*func) (const Image &, A), A acc1) const
 	{
 		for (unsigned int index_mask = 0; index_mask < this->masks.size (); index_mask++) {
-			func (this->masks [index_mask], acc1);
+			func (this->masks [index_mask] (this->ROIs_bounding_box), acc1);
 		}
 	}
 	template<typename A, typename B, typename C, typename D, typename E>
@@ -415,21 +544,22 @@ public:
 	inline void fold3_ROIs (const RunParameters &parameters, void (*func) (const Image &, A, B, C), A acc1, B acc2, C acc3) const
 	{
 		for (unsigned int index_mask = 0; index_mask < parameters.number_ROIs; index_mask++) {
-			func (this->masks [index_mask], acc1, acc2, acc3);
+			func (this->masks [index_mask] (this->ROIs_bounding_box), acc1, acc2, acc3);
 		}
 	}
 	template<typename A, typename B>
 	inline void fold2_ROIs (const RunParameters &parameters, void (*func) (const Image &, A, B), A acc1, B acc2) const
 	{
 		for (unsigned int index_mask = 0; index_mask < parameters.number_ROIs; index_mask++) {
-			func (this->masks [index_mask], acc1, acc2);
+			func (this->masks [index_mask] (this->ROIs_bounding_box), acc1, acc2);
 		}
 	}
-	inline void fold0_ROI_pairs (void (*func) (unsigned int, const Image &, unsigned int, const Image &)) const
+	template<typename A>
+	inline void fold1_ROI_pairs (void (*func) (unsigned int, const Image &, unsigned int, const Image &, A), A acc1) const
 	{
 		for (unsigned int index_mask_1 = 0; index_mask_1 < this->masks.size () - 1; index_mask_1++) {
 			for (unsigned int index_mask_2 = index_mask_1 + 1; index_mask_2 < this->masks.size (); index_mask_2++) {
-				func (index_mask_1 + 1, this->masks [index_mask_1], index_mask_2 + 1, this->masks [index_mask_2]);
+				func (index_mask_1 + 1, this->masks [index_mask_1], index_mask_2 + 1, this->masks [index_mask_2], acc1);
 			}
 		}
 	}
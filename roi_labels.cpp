@@ -0,0 +1,357 @@
+#include <map>
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "roi_labels.hpp"
+
+using namespace std;
+
+/**
+ * Maximum number of labels, as the label image has 16 bit pixels.
+ */
+static const unsigned int MAX_NUMBER_LABELS = 65536;
+
+/**
+ * Minimum number of rows in a stripe, so that adding the stripe histograms does
+ * not cost more than computing them.
+ */
+static const int MIN_STRIPE_ROWS = 32;
+
+static void difference_histogram_row_reference (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, const uint16_t *label, int width, uint32_t *histograms, unsigned char *equalised);
+
+static void difference_histogram_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, const uint16_t *label, int width, uint32_t *histograms, unsigned char *equalised);
+
+static void difference_bits_row_reference (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, unsigned int level, int width, uint64_t *bits, unsigned char *equalised);
+
+static void difference_bits_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, unsigned int level, int width, uint64_t *bits, unsigned char *equalised);
+
+class ROILabels::ComputeStripe:
+      public cv::ParallelLoopBody
+{
+	const Image &frame;
+	const unsigned char *const lut;
+	const Image &reference;
+	const Image &labels;
+	Image *const equalised_frame;
+	const int number_stripes;
+	const size_t block_size;
+	uint32_t *const blocks;
+public:
+	ComputeStripe (const Image &frame, const unsigned char *lut, const Image &reference, const Image &labels, Image *equalised_frame, int number_stripes, size_t block_size, uint32_t *blocks):
+	   frame (frame),
+	   lut (lut),
+	   reference (reference),
+	   labels (labels),
+	   equalised_frame (equalised_frame),
+	   number_stripes (number_stripes),
+	   block_size (block_size),
+	   blocks (blocks)
+	{
+	}
+	virtual void operator() (const cv::Range &range) const
+	{
+		for (int index_stripe = range.start; index_stripe < range.end; index_stripe++) {
+			uint32_t *histograms = this->blocks + index_stripe * this->block_size;
+			int first_row = index_stripe * this->frame.rows / this->number_stripes;
+			int last_row = (index_stripe + 1) * this->frame.rows / this->number_stripes;
+			for (int row = first_row; row < last_row; row++)
+				difference_histogram_row (
+				         this->frame.ptr<unsigned char> (row),
+				         this->lut,
+				         this->reference.ptr<unsigned char> (row),
+				         this->labels.ptr<uint16_t> (row),
+				         this->frame.cols,
+				         histograms,
+				         this->equalised_frame == NULL ? NULL : this->equalised_frame->ptr<unsigned char> (row));
+		}
+	}
+};
+
+class ROILabels::CountStripe:
+      public cv::ParallelLoopBody
+{
+	const ROILabels &labels;
+	const Image &frame;
+	const unsigned char *const lut;
+	const Image &reference;
+	const unsigned int level;
+	Image *const equalised_frame;
+	const int number_stripes;
+	uint32_t *const counts;
+public:
+	CountStripe (const ROILabels &labels, const Image &frame, const unsigned char *lut, const Image &reference, unsigned int level, Image *equalised_frame, int number_stripes, uint32_t *counts):
+	   labels (labels),
+	   frame (frame),
+	   lut (lut),
+	   reference (reference),
+	   level (level),
+	   equalised_frame (equalised_frame),
+	   number_stripes (number_stripes),
+	   counts (counts)
+	{
+	}
+	virtual void operator() (const cv::Range &range) const
+	{
+		const unsigned int number_masks = this->labels.ROI_labels.size () + 1;
+		const unsigned int words_per_row = this->labels.words_per_row;
+		static thread_local vector<uint64_t> difference_bits;
+		difference_bits.resize (words_per_row);
+		for (int index_stripe = range.start; index_stripe < range.end; index_stripe++) {
+			uint32_t *stripe_counts = this->counts + index_stripe * number_masks;
+			int first_row = index_stripe * this->frame.rows / this->number_stripes;
+			int last_row = (index_stripe + 1) * this->frame.rows / this->number_stripes;
+			for (int row = first_row; row < last_row; row++) {
+				difference_bits_row (
+				         this->frame.ptr<unsigned char> (row),
+				         this->lut,
+				         this->reference.ptr<unsigned char> (row),
+				         this->level,
+				         this->frame.cols,
+				         difference_bits.data (),
+				         this->equalised_frame == NULL ? NULL : this->equalised_frame->ptr<unsigned char> (row));
+				const uint64_t *mask = this->labels.ROI_bits.data () + (size_t) row * number_masks * words_per_row;
+				for (unsigned int index_mask = 0; index_mask < number_masks; index_mask++, mask += words_per_row) {
+					uint32_t count = 0;
+					for (unsigned int word = 0; word < words_per_row; word++)
+						count += __builtin_popcountll (difference_bits [word] & mask [word]);
+					stripe_counts [index_mask] += count;
+				}
+			}
+		}
+	}
+};
+
+ROILabels::ROILabels (const vector<Image> &masks, const cv::Rect &box):
+   labels (box.height, box.width, CV_16U),
+   number_labels (1),
+   ROI_labels (masks.size ()),
+   words_per_row ((box.width + 63) / 64),
+   ROI_bits ((size_t) box.height * (masks.size () + 1) * words_per_row, 0)
+{
+	map<vector<unsigned int>, unsigned int> set_labels;
+	set_labels [vector<unsigned int> ()] = 0;
+	vector<const unsigned char *> mask_rows (masks.size ());
+	vector<unsigned int> set;
+	for (int row = 0; row < box.height; row++) {
+		for (unsigned int index_mask = 0; index_mask < masks.size (); index_mask++)
+			mask_rows [index_mask] = masks [index_mask].ptr<unsigned char> (box.y + row) + box.x;
+		uint16_t *label = this->labels.ptr<uint16_t> (row);
+		for (int column = 0; column < box.width; column++) {
+			set.clear ();
+			for (unsigned int index_mask = 0; index_mask < masks.size (); index_mask++)
+				if (mask_rows [index_mask][column] != 0)
+					set.push_back (index_mask);
+			map<vector<unsigned int>, unsigned int>::iterator it = set_labels.find (set);
+			if (it == set_labels.end ()) {
+				if (this->number_labels == MAX_NUMBER_LABELS) {
+					cerr << "The masks of the regions of interest overlap in too many ways!\n";
+					exit (EXIT_FAILURE);
+				}
+				for (unsigned int index_mask : set)
+					this->ROI_labels [index_mask].push_back (this->number_labels);
+				it = set_labels.insert (make_pair (set, this->number_labels++)).first;
+			}
+			label [column] = it->second;
+			uint64_t *bits = this->ROI_bits.data () + (size_t) row * (masks.size () + 1) * this->words_per_row + column / 64;
+			const uint64_t bit = (uint64_t) 1 << (column % 64);
+			for (unsigned int index_mask : set)
+				bits [index_mask * this->words_per_row] |= bit;
+			if (!set.empty () || masks.empty ())
+				bits [masks.size () * this->words_per_row] |= bit;
+		}
+	}
+}
+
+void ROILabels::compute_label_histograms (const Image &frame, const unsigned char *lut, const Image &reference, vector<uint32_t> &label_histograms, Image *equalised_frame) const
+{
+	const size_t block_size = this->number_labels * NUMBER_COLOUR_LEVELS;
+	const int number_stripes = max (1, min (cv::getNumThreads (), frame.rows / MIN_STRIPE_ROWS));
+	label_histograms.assign (number_stripes * block_size, 0);
+	cv::parallel_for_ (cv::Range (0, number_stripes), ComputeStripe (frame, lut, reference, this->labels, equalised_frame, number_stripes, block_size, label_histograms.data ()));
+	for (int index_stripe = 1; index_stripe < number_stripes; index_stripe++) {
+		const uint32_t *block = label_histograms.data () + index_stripe * block_size;
+		for (size_t i = 0; i < block_size; i++)
+			label_histograms [i] += block [i];
+	}
+#ifdef DEBUG
+	vector<uint32_t> expected (block_size, 0);
+	vector<unsigned char> equalised (frame.cols);
+	for (int row = 0; row < frame.rows; row++)
+		difference_histogram_row_reference (frame.ptr<unsigned char> (row), lut, reference.ptr<unsigned char> (row), this->labels.ptr<uint16_t> (row), frame.cols, expected.data (), equalised.data ());
+	if (!equal (expected.begin (), expected.end (), label_histograms.begin ())) {
+		cerr << "The difference histogram kernel does not match its reference implementation!\n";
+		exit (EXIT_FAILURE);
+	}
+#endif
+}
+
+void ROILabels::count_differences (const Image &frame, const unsigned char *lut, const Image &reference, unsigned int level, vector<uint32_t> &counts, Image *equalised_frame) const
+{
+	const unsigned int number_masks = this->ROI_labels.size () + 1;
+	const int number_stripes = max (1, min (cv::getNumThreads (), frame.rows / MIN_STRIPE_ROWS));
+	// the stripe counts are merged into the first stripe, and the buffer is kept for the next frame
+	counts.assign (number_stripes * number_masks, 0);
+	cv::parallel_for_ (cv::Range (0, number_stripes), CountStripe (*this, frame, lut, reference, level, equalised_frame, number_stripes, counts.data ()));
+	for (int index_stripe = 1; index_stripe < number_stripes; index_stripe++)
+		for (unsigned int index_mask = 0; index_mask < number_masks; index_mask++)
+			counts [index_mask] += counts [index_stripe * number_masks + index_mask];
+	counts.resize (number_masks);
+#ifdef DEBUG
+	vector<uint64_t> difference_bits (this->words_per_row);
+	vector<unsigned char> equalised (frame.cols);
+	for (unsigned int index_mask = 0; index_mask < number_masks; index_mask++) {
+		uint32_t expected = 0;
+		for (int row = 0; row < frame.rows; row++) {
+			difference_bits_row_reference (frame.ptr<unsigned char> (row), lut, reference.ptr<unsigned char> (row), level, frame.cols, difference_bits.data (), equalised.data ());
+			const uint64_t *mask = this->ROI_bits.data () + ((size_t) row * number_masks + index_mask) * this->words_per_row;
+			for (unsigned int word = 0; word < this->words_per_row; word++)
+				expected += __builtin_popcountll (difference_bits [word] & mask [word]);
+		}
+		if (expected != counts [index_mask]) {
+			cerr << "The difference count kernel does not match its reference implementation!\n";
+			exit (EXIT_FAILURE);
+		}
+	}
+#endif
+}
+
+void ROILabels::ROIs_histograms (const vector<uint32_t> &label_histograms, uint32_t *result) const
+{
+	for (const vector<unsigned int> &labels : this->ROI_labels) {
+		fill (result, result + NUMBER_COLOUR_LEVELS, 0);
+		for (unsigned int label : labels)
+			for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+				result [colour] += label_histograms [label * NUMBER_COLOUR_LEVELS + colour];
+		result += NUMBER_COLOUR_LEVELS;
+	}
+}
+
+void ROILabels::ORed_ROIs_histogram (const vector<uint32_t> &label_histograms, uint32_t *result) const
+{
+	fill (result, result + NUMBER_COLOUR_LEVELS, 0);
+	unsigned int first_label = this->ROI_labels.empty () ? 0 : 1;
+	for (unsigned int label = first_label; label < this->number_labels; label++)
+		for (unsigned int colour = 0; colour < NUMBER_COLOUR_LEVELS; colour++)
+			result [colour] += label_histograms [label * NUMBER_COLOUR_LEVELS + colour];
+}
+
+/**
+ * Reference implementation of the difference histogram kernel.  Each pixel of
+ * the row is subject to the lookup table, if any, and the absolute difference
+ * to the reference pixel is counted in the histogram of the pixel label.
+ */
+static void difference_histogram_row_reference (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, const uint16_t *label, int width, uint32_t *histograms, unsigned char *equalised)
+{
+	for (int column = 0; column < width; column++) {
+		int pixel = lut == NULL ? frame [column] : lut [frame [column]];
+		if (equalised != NULL)
+			equalised [column] = pixel;
+		histograms [label [column] * NUMBER_COLOUR_LEVELS + abs (pixel - reference [column])]++;
+	}
+}
+
+#ifdef __SSE2__
+/**
+ * Vectorised difference histogram kernel.  The lookup table and the histogram
+ * increments are memory accesses with data dependent addresses, so they remain
+ * scalar, while the absolute difference is computed sixteen pixels at a time
+ * with saturated subtractions.  The remaining pixels of the row are handled by
+ * the reference implementation.
+ */
+static void difference_histogram_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, const uint16_t *label, int width, uint32_t *histograms, unsigned char *equalised)
+{
+	alignas (16) unsigned char buffer [16];
+	int column = 0;
+	for (; column + 16 <= width; column += 16) {
+		__m128i pixels;
+		if (lut == NULL)
+			pixels = _mm_loadu_si128 ((const __m128i *) (frame + column));
+		else {
+			for (int i = 0; i < 16; i++)
+				buffer [i] = lut [frame [column + i]];
+			pixels = _mm_load_si128 ((const __m128i *) buffer);
+		}
+		if (equalised != NULL)
+			_mm_storeu_si128 ((__m128i *) (equalised + column), pixels);
+		__m128i background = _mm_loadu_si128 ((const __m128i *) (reference + column));
+		__m128i difference = _mm_or_si128 (_mm_subs_epu8 (pixels, background), _mm_subs_epu8 (background, pixels));
+		_mm_store_si128 ((__m128i *) buffer, difference);
+		for (int i = 0; i < 16; i++)
+			histograms [label [column + i] * NUMBER_COLOUR_LEVELS + buffer [i]]++;
+	}
+	difference_histogram_row_reference (frame + column, lut, reference + column, label + column, width - column, histograms, equalised == NULL ? NULL : equalised + column);
+}
+#else
+static void difference_histogram_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, const uint16_t *label, int width, uint32_t *histograms, unsigned char *equalised)
+{
+	difference_histogram_row_reference (frame, lut, reference, label, width, histograms, equalised);
+}
+#endif
+
+/**
+ * Reference implementation of the difference bits kernel.  The bit of each
+ * pixel of the row is set if the absolute difference between the pixel, after
+ * applying the lookup table if any, and the reference pixel is equal to or
+ * higher than the given level.
+ */
+static void difference_bits_row_reference (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, unsigned int level, int width, uint64_t *bits, unsigned char *equalised)
+{
+	for (int word = 0; word < (width + 63) / 64; word++)
+		bits [word] = 0;
+	for (int column = 0; column < width; column++) {
+		int pixel = lut == NULL ? frame [column] : lut [frame [column]];
+		if (equalised != NULL)
+			equalised [column] = pixel;
+		if ((unsigned int) abs (pixel - reference [column]) >= level)
+			bits [column / 64] |= (uint64_t) 1 << (column % 64);
+	}
+}
+
+#ifdef __SSE2__
+/**
+ * Vectorised difference bits kernel.  Sixteen pixels at a time are compared
+ * with the level, and the comparison result is turned into sixteen bits with a
+ * byte mask move.
+ */
+static void difference_bits_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, unsigned int level, int width, uint64_t *bits, unsigned char *equalised)
+{
+	if (level >= NUMBER_COLOUR_LEVELS) {
+		difference_bits_row_reference (frame, lut, reference, level, width, bits, equalised);
+		return ;
+	}
+	alignas (16) unsigned char buffer [16];
+	const __m128i threshold = _mm_set1_epi8 ((char) level);
+	int column = 0;
+	for (; column + 64 <= width; column += 64) {
+		uint64_t word = 0;
+		for (int chunk = 0; chunk < 64; chunk += 16) {
+			__m128i pixels;
+			if (lut == NULL)
+				pixels = _mm_loadu_si128 ((const __m128i *) (frame + column + chunk));
+			else {
+				for (int i = 0; i < 16; i++)
+					buffer [i] = lut [frame [column + chunk + i]];
+				pixels = _mm_load_si128 ((const __m128i *) buffer);
+			}
+			if (equalised != NULL)
+				_mm_storeu_si128 ((__m128i *) (equalised + column + chunk), pixels);
+			__m128i background = _mm_loadu_si128 ((const __m128i *) (reference + column + chunk));
+			__m128i difference = _mm_or_si128 (_mm_subs_epu8 (pixels, background), _mm_subs_epu8 (background, pixels));
+			__m128i above = _mm_cmpeq_epi8 (_mm_max_epu8 (difference, threshold), difference);
+			word |= (uint64_t) (unsigned int) _mm_movemask_epi8 (above) << chunk;
+		}
+		bits [column / 64] = word;
+	}
+	if (column < width)
+		difference_bits_row_reference (frame + column, lut, reference + column, level, width - column, bits + column / 64, equalised == NULL ? NULL : equalised + column);
+}
+#else
+static void difference_bits_row (const unsigned char *frame, const unsigned char *lut, const unsigned char *reference, unsigned int level, int width, uint64_t *bits, unsigned char *equalised)
+{
+	difference_bits_row_reference (frame, lut, reference, level, width, bits, equalised);
+}
+#endif
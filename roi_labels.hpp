@@ -0,0 +1,104 @@
+#ifndef __ROI_LABELS__
+#define __ROI_LABELS__
+
+#include <stdint.h>
+#include <vector>
+
+#include "image.hpp"
+#include "histogram.hpp"
+
+/**
+ * @brief The ROILabels class is the compiled form of the masks of the regions
+ * of interest of a folder.
+ *
+ * Each pixel of the label image holds the label of the set of regions of
+ * interest the pixel belongs to.  Label zero is the empty set.  Pixels that
+ * belong to more than one region of interest have a label of their own, so the
+ * histograms of all regions of interest are computed in a single scan of an
+ * image: first the histogram of each label is computed, and then the
+ * histogram of a region of interest is the sum of the histograms of the labels
+ * that contain it.
+ */
+class ROILabels
+{
+public:
+	/**
+	 * @brief ROILabels Compile the given masks cropped to the given rectangle.
+	 */
+	ROILabels (const std::vector<Image> &masks, const cv::Rect &box);
+	/**
+	 * @brief compute_label_histograms Compute the histogram of each label of the
+	 * absolute difference between a frame and a reference image, both with the
+	 * size of the label image.
+	 *
+	 * The lookup table, if given, is applied to the frame before the difference
+	 * is taken.  This is done in a single pass over the pixels, without any
+	 * intermediate image.  If an image for the equalised frame is given, the
+	 * result of applying the lookup table is also stored there.
+	 *
+	 * Rows are split in stripes that are processed in parallel, each one with
+	 * its own block of histograms.  The blocks are afterwards added to the first
+	 * one, where the histogram of label L starts at index L *
+	 * NUMBER_COLOUR_LEVELS.
+	 *
+	 * @param frame A grey scale frame.
+	 * @param lut Lookup table applied to the frame, or NULL.
+	 * @param reference The image subtracted from the frame.
+	 * @param label_histograms Buffer where the histograms are computed.
+	 * @param equalised_frame Image where the frame after applying the lookup
+	 * table is stored, or NULL.  It must have the size of the label image.
+	 */
+	void compute_label_histograms (const Image &frame, const unsigned char *lut, const Image &reference, std::vector<uint32_t> &label_histograms, Image *equalised_frame) const;
+	/**
+	 * @brief count_differences Count the pixels of each region of interest
+	 * where the absolute difference between a frame and a reference image is
+	 * equal to or higher than the given level.
+	 *
+	 * The lookup table and the equalised frame have the same meaning as in
+	 * method compute_label_histograms.  The comparison produces one bit per
+	 * pixel, which is ANDed with the bit packed masks of the regions of interest
+	 * and counted with population count instructions.  No histogram is
+	 * computed.
+	 *
+	 * @param counts Vector where the count of each region of interest is
+	 * stored, followed by the count of the ORed regions of interest.
+	 */
+	void count_differences (const Image &frame, const unsigned char *lut, const Image &reference, unsigned int level, std::vector<uint32_t> &counts, Image *equalised_frame) const;
+	/**
+	 * @brief ROIs_histograms Store the histogram of each region of interest in
+	 * the given counts, one after the other in the order of the masks, such as
+	 * a frame of a histogram matrix.
+	 */
+	void ROIs_histograms (const std::vector<uint32_t> &label_histograms, uint32_t *result) const;
+	/**
+	 * @brief ORed_ROIs_histogram Compute the histogram of the pixels that belong
+	 * to any region of interest.  If there are no regions of interest, this is
+	 * the histogram of the entire image.
+	 */
+	void ORed_ROIs_histogram (const std::vector<uint32_t> &label_histograms, uint32_t *result) const;
+private:
+	/**
+	 * @brief labels Label image with type CV_16U.
+	 */
+	Image labels;
+	unsigned int number_labels;
+	/**
+	 * @brief ROI_labels The labels that contain each region of interest.
+	 */
+	std::vector<std::vector<unsigned int> > ROI_labels;
+	/**
+	 * @brief words_per_row Number of 64 bit words in a row of a bit packed mask.
+	 */
+	unsigned int words_per_row;
+	/**
+	 * @brief ROI_bits Bit packed masks of the regions of interest followed by
+	 * the bit packed ORed mask.  The rows of every mask are interleaved, so
+	 * that the masks of a row are next to each other in memory.  If there are
+	 * no regions of interest, the ORed mask is the entire image.
+	 */
+	std::vector<uint64_t> ROI_bits;
+	class ComputeStripe;
+	class CountStripe;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "stage_graph.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+/**
+ * Name of each action in the metrics.
+ */
+static const char *ACTION_NAMES [] = {
+	"skip",
+	"read",
+	"compute"
+};
+
+static void run_stage (const StageGraph::Stage *stage, ostream &log, bool concurrent, uint64_t *nanoseconds);
+
+StageGraph::StageGraph ():
+   number_levels (0)
+{
+}
+
+StageGraph::~StageGraph ()
+{
+	for (Stage *stage : this->stages)
+		delete stage;
+}
+
+StageGraph::Stage *StageGraph::add (const string &description, const string &filename, bool requested, bool cached, const vector<Stage *> &inputs)
+{
+	Stage *result = new Stage ();
+	result->description = description;
+	result->filename = filename;
+	result->inputs = inputs;
+	result->requested = requested;
+	result->cached = cached;
+	result->consumed = false;
+	result->action = SKIP;
+	result->level = 0;
+	this->stages.push_back (result);
+	return result;
+}
+
+void StageGraph::resolve ()
+{
+	for (Stage *stage : this->stages)
+		stage->consumed = false;
+	// consumers were added after the stages they read
+	for (vector<Stage *>::reverse_iterator it = this->stages.rbegin (); it != this->stages.rend (); it++) {
+		Stage *stage = *it;
+		if (!stage->requested && !stage->consumed)
+			stage->action = SKIP;
+		else if (stage->cached && !stage->consumed)
+			stage->action = SKIP;
+		else if (stage->cached && stage->load)
+			stage->action = LOAD;
+		else {
+			stage->action = COMPUTE;
+			for (Stage *input : stage->inputs)
+				input->consumed = true;
+		}
+	}
+	this->number_levels = 0;
+	for (Stage *stage : this->stages) {
+		stage->level = 0;
+		if (stage->action == COMPUTE)
+			for (Stage *input : stage->inputs)
+				stage->level = max (stage->level, input->level + 1);
+		if (stage->action != SKIP)
+			this->number_levels = max (this->number_levels, stage->level + 1);
+	}
+}
+
+void StageGraph::explain (ostream &log) const
+{
+	log << "  Plan of the analysis stages:\n";
+	for (const Stage *stage : this->stages) {
+		if (stage->action == SKIP && !stage->requested)
+			continue;
+		switch (stage->action) {
+		case SKIP:
+			log << "    [up to date] ";
+			break;
+		case LOAD:
+			log << "    [read]       ";
+			break;
+		case COMPUTE:
+			log << "    [compute]    ";
+			break;
+		}
+		log << stage->description << "\n";
+		if (!stage->filename.empty ())
+			log << "                 file " << stage->filename << "\n";
+		if (stage->action == LOAD) {
+			struct stat status;
+			if (stat (stage->filename.c_str (), &status) == 0)
+				log << "                 reads " << status.st_size << " bytes\n";
+		}
+		else if (stage->action == COMPUTE && stage->cost)
+			log << "                 cost: " << stage->cost () << "\n";
+		if (stage->action == COMPUTE && !stage->inputs.empty ()) {
+			log << "                 after:";
+			for (size_t index = 0; index < stage->inputs.size (); index++)
+				log << (index == 0 ? " " : "; ") << stage->inputs [index]->description;
+			log << "\n";
+		}
+	}
+}
+
+void StageGraph::run (ostream &log, Metrics *metrics) const
+{
+	// time of each stage, only measured with metrics
+	vector<uint64_t> nanoseconds (this->stages.size (), 0);
+	uint64_t *times = metrics == NULL ? NULL : nanoseconds.data ();
+	for (size_t index = 0; index < this->stages.size (); index++)
+		if (this->stages [index]->action == COMPUTE && this->stages [index]->prepare) {
+			const uint64_t start = times == NULL ? 0 : metrics_clock ();
+			this->stages [index]->prepare ();
+			if (times != NULL)
+				times [index] += metrics_clock () - start;
+		}
+	for (const Stage *stage : this->stages)
+		if (stage->action == SKIP && stage->requested)
+			log << "  File " << stage->filename << " is up to date, nothing to do.\n";
+	for (unsigned int level = 0; level < this->number_levels; level++) {
+		vector<size_t> ready;
+		for (size_t index = 0; index < this->stages.size (); index++)
+			if (this->stages [index]->action != SKIP && this->stages [index]->level == level)
+				ready.push_back (index);
+		if (ready.size () == 1) {
+			run_stage (this->stages [ready [0]], log, false, times == NULL ? NULL : times + ready [0]);
+			continue;
+		}
+		// each worker takes the next stage of the level that is not running
+		vector<ostringstream> logs (ready.size ());
+		atomic<size_t> next (0);
+		const size_t number_workers = min (ready.size (), (size_t) max (thread::hardware_concurrency (), 1u));
+		vector<thread> workers;
+		for (size_t index_worker = 0; index_worker < number_workers; index_worker++)
+			workers.push_back (thread ([this, &ready, &logs, &next, times] {
+				for (size_t index = next++; index < ready.size (); index = next++)
+					run_stage (this->stages [ready [index]], logs [index], true, times == NULL ? NULL : times + ready [index]);
+			}));
+		for (thread &worker : workers)
+			worker.join ();
+		for (const ostringstream &stage_log : logs)
+			log << stage_log.str ();
+	}
+	if (metrics != NULL)
+		for (size_t index = 0; index < this->stages.size (); index++) {
+			const Stage *stage = this->stages [index];
+			if (stage->action == SKIP)
+				continue;
+			struct stat status;
+			const uint64_t bytes_read = stage->action == LOAD && stat (stage->filename.c_str (), &status) == 0 ? status.st_size : 0;
+			metrics->add_stage (stage->description, ACTION_NAMES [stage->action], nanoseconds [index], bytes_read);
+		}
+}
+
+static void run_stage (const StageGraph::Stage *stage, ostream &log, bool concurrent, uint64_t *nanoseconds)
+{
+	const uint64_t start = nanoseconds == NULL ? 0 : metrics_clock ();
+	if (stage->action == StageGraph::LOAD)
+		stage->load (log, concurrent);
+	else if (stage->compute)
+		stage->compute (log, concurrent);
+	if (nanoseconds != NULL)
+		*nanoseconds += metrics_clock () - start;
+}
@@ -0,0 +1,106 @@
+#ifndef __STAGE_GRAPH__
+#define __STAGE_GRAPH__
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Metrics;
+
+/**
+ * @brief The StageGraph class executes the analysis stages of a folder.  Each
+ * stage is declared with the stages whose results it reads.
+ *
+ * A stage is requested if the program options ask for its result file, and it
+ * is cached if that file is up to date.  Method resolve walks the graph from
+ * the last stage to the first one, and decides what each stage does: a stage
+ * is computed if it is requested or read by a computed stage, and its file is
+ * not up to date; a stage whose file is up to date is only read if a computed
+ * stage needs its result; every other stage is skipped.  So a stage is never
+ * computed only because of a result file that is up to date.
+ *
+ * Method run executes the stages by levels.  A computed stage is in the level
+ * after the levels of the stages it reads, and read stages are in the first
+ * level.  The stages of a level are independent and run at the same time.
+ */
+class StageGraph
+{
+public:
+	enum Action {
+		SKIP,
+		LOAD,
+		COMPUTE
+	};
+	struct Stage
+	{
+		std::string description;
+		/**
+		 * @brief filename The result file of the stage, or empty if the stage
+		 * has none.
+		 */
+		std::string filename;
+		std::vector<Stage *> inputs;
+		bool requested;
+		bool cached;
+		/**
+		 * @brief prepare Called before any stage runs for the stages that are
+		 * computed, in the order they were added.  Stages computed by another
+		 * stage register in it here.
+		 */
+		std::function<void ()> prepare;
+		/**
+		 * @brief compute Compute the result of the stage and write its file.
+		 * The arguments are the stream where progress messages are written,
+		 * and whether other stages run at the same time.
+		 */
+		std::function<void (std::ostream &, bool)> compute;
+		/**
+		 * @brief load Read the result of the stage from its file.
+		 */
+		std::function<void (std::ostream &, bool)> load;
+		/**
+		 * @brief cost Describe the estimated cost of computing the stage.
+		 */
+		std::function<std::string ()> cost;
+		/**
+		 * @brief consumed Whether a computed stage reads the result of this
+		 * stage.  Set by method resolve.
+		 */
+		bool consumed;
+		Action action;
+		unsigned int level;
+	};
+	StageGraph ();
+	~StageGraph ();
+	/**
+	 * @brief add Add a stage that reads the results of the given stages, which
+	 * must have been added before.
+	 */
+	Stage *add (const std::string &description, const std::string &filename, bool requested, bool cached, const std::vector<Stage *> &inputs);
+	/**
+	 * @brief resolve Decide what each stage does, and its level.
+	 */
+	void resolve ();
+	/**
+	 * @brief explain Write the stages that are not skipped, what they do and
+	 * the cost of the computed ones, and the requested files that are up to
+	 * date.
+	 */
+	void explain (std::ostream &log) const;
+	/**
+	 * @brief run Prepare the computed stages, and run the stages level by
+	 * level.  The progress messages of stages that run at the same time are
+	 * written to the given stream after their level ends, in the order the
+	 * stages were added.
+	 *
+	 * @param metrics Where the time of each stage, including its preparation,
+	 * and the bytes read by each read stage are added, or NULL.
+	 */
+	void run (std::ostream &log, Metrics *metrics) const;
+private:
+	std::vector<Stage *> stages;
+	unsigned int number_levels;
+};
+
+#endif